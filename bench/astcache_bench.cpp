@@ -0,0 +1,116 @@
+// Бенчмарк кэша деревьев разбора (astcache.h): загрузка записи из файла
+// против обычного разбора исходника (последовательного и в -jN потоков).
+// Заодно проверяет, что загруженное дерево записывается в тот же образ.
+//
+// Сборка: cl /O2 /EHsc /I..\src\Include astcache_bench.cpp ..\src\astcache.cpp ..\src\parser.cpp
+//         ..\src\lexer.cpp ..\src\tokenizer.cpp ..\src\scan.cpp ..\src\keywords.cpp ..\src\symbols.cpp
+//         ..\src\numlit.cpp ..\src\arena.cpp ..\src\ast.cpp ..\src\threadpool.cpp ..\src\mappedfile.cpp
+//         ..\src\resolver.cpp ..\src\fold.cpp ..\src\constval.cpp ..\src\evaluator.cpp
+// Запуск: astcache_bench [число функций] [каталог кэша]
+
+#include "astcache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+// Программа из n функций с константами и таблицей; каждая вызывает предыдущую
+static std::string GenerateProgram(int n)
+{
+	std::string src = "program bench;\nconst\n  lim = 1000;\n  half = lim div 2;\n"
+		"  tab: array [0..3] of integer = (1, 2, 4, 8);\nvar g: integer;\n";
+	for (int i = 0; i < n; ++i) {
+		std::string name = "f" + std::to_string(i);
+		src += "function " + name + "(a, b: integer): integer;\nvar x, y: integer;\n  r: real;\nbegin\n"
+			"  x := a * 3 + b div 2 - (a - b) * 7 + tab[a mod 4];\n"
+			"  y := 0;\n  r := 0.5;\n"
+			"  while x > 0 do\n  begin\n"
+			"    if x mod 2 = 0 then y := y + x * 2 else y := y - 1;\n"
+			"    r := r * 1.5E0 + x;\n"
+			"    x := x - 1\n  end;\n"
+			"  repeat y := y div 2 until (y < 100) or (y > lim);\n";
+		if (i > 0)
+			src += "  for x := 1 to 10 do y := y + f" + std::to_string(i - 1) + "(x, -y);\n";
+		src += "  " + name + " := y + g - half\nend;\n";
+	}
+	src += "begin\n  g := f" + std::to_string(n - 1) + "(1, 2);\n  bench := g\nend\n";
+	return src;
+}
+
+static double Now()
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 20000;
+	std::string dir = argc > 2 ? argv[2] : ".astcache";
+	const int RUNS = 10;
+
+	std::string src = GenerateProgram(n);
+	AstCache cache(dir);
+
+	// Лучшее время из RUNS запусков; деревья освобождаются вне замера
+	double parse = 1e30, parallel = 1e30, load = 1e30, store = 1e30;
+	for (int r = 0; r < RUNS; ++r) {
+		double t = Now();
+		std::unique_ptr<Parser> P(new Parser(src.data(), src.size()));
+		P->Parse();
+		t = Now() - t;
+		if (!P->IsSuccess()) {
+			printf("parse failed\n");
+			return 1;
+		}
+		if (t < parse)
+			parse = t;
+
+		t = Now();
+		std::unique_ptr<Parser> PP(new Parser(src.data(), src.size(), 0));
+		PP->Parse();
+		t = Now() - t;
+		if (t < parallel)
+			parallel = t;
+
+		t = Now();
+		if (!cache.Store(src.data(), src.size(), *P)) {
+			printf("cannot write %s\n", cache.PathFor(AstCache::HashSource(src.data(), src.size())).c_str());
+			return 1;
+		}
+		t = Now() - t;
+		if (t < store)
+			store = t;
+
+		t = Now();
+		std::unique_ptr<Parser> L(cache.Load(src.data(), src.size()));
+		t = Now() - t;
+		if (L == nullptr) {
+			printf("load failed\n");
+			return 1;
+		}
+		if (t < load)
+			load = t;
+	}
+
+	// Загруженное дерево должно совпасть с разобранным
+	unsigned long long hash = AstCache::HashSource(src.data(), src.size());
+	Parser P(src.data(), src.size());
+	P.Parse();
+	std::unique_ptr<Parser> L(cache.Load(src.data(), src.size()));
+	std::string parsed, loaded;
+	AstCache::Serialize(hash, src.size(), P._ast, parsed);
+	AstCache::Serialize(hash, src.size(), L->_ast, loaded);
+	if (parsed != loaded) {
+		printf("round trip mismatch\n");
+		return 1;
+	}
+
+	printf("%d functions, source %zu bytes, cache %zu bytes, best of %d runs\n", n, src.size(), parsed.size(), RUNS);
+	printf("parse        : %8.3f ms\n", parse * 1e3);
+	printf("parse -j     : %8.3f ms\n", parallel * 1e3);
+	printf("cache store  : %8.3f ms\n", store * 1e3);
+	printf("cache load   : %8.3f ms  (%.1fx faster than parse)\n", load * 1e3, parse / load);
+	return 0;
+}
@@ -0,0 +1,128 @@
+// Микробенчмарк классификации слов лексическим анализатором:
+// прежняя схема (пять std::unordered_set и цепочка сравнений строк)
+// против совершенной хеш-таблицы из keywords.h.
+//
+// Сборка: cl /O2 /EHsc /I..\src\Include keywords_bench.cpp ..\src\keywords.cpp
+// keywords.h подключает parser.h и ast.h, которые собираются только MSVC
+// (исключения создаются конструктором std::exception(const char *))
+
+#include "keywords.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static std::unordered_set<std::string> NAMES = {
+	"nil", "in", "if", "then", "else", "case",
+	"of", "repeat", "until", "while",
+	"do", "for", "to", "downto",
+	"begin", "end", "with", "goto",
+	"const", "var", "array", "record",
+	"set", "file", "function", "procedure",
+	"label", "packed", "program", "true", "false"
+};
+static std::unordered_set<std::string> TYPE_NAMES = {
+	"integer", "char", "boolean", "real"
+};
+static std::unordered_set<std::string> COND_NAMES = {
+	"=", "<>", ">", ">=", "<", "<=", "in"
+};
+static std::unordered_set<std::string> FACTOR_NAMES = {
+	"*", "/", "div", "mod", "and", "^"
+};
+static std::unordered_set<std::string> TERM_NAMES = {
+	"+", "-", "or",
+};
+
+// Классификация в том виде, в каком она была в Lexer::GetToken
+static Token OldClassify(const std::string &word)
+{
+	if (TYPE_NAMES.find(word) != TYPE_NAMES.end())
+		return T_VARTYPE;
+	else if (COND_NAMES.find(word) != COND_NAMES.end())
+		return T_COND;
+	else if (FACTOR_NAMES.find(word) != FACTOR_NAMES.end())
+		return T_FACTOROP;
+	else if (TERM_NAMES.find(word) != TERM_NAMES.end())
+		return T_TERMOP;
+	else if (NAMES.find(word) == NAMES.end())
+		return T_ID;
+	else if (word == "if") return T_IF;
+	else if (word == "else") return T_ELSE;
+	else if (word == "then") return T_THEN;
+	else if (word == "begin") return T_BEGIN;
+	else if (word == "end") return T_END;
+	else if (word == "nil") return T_NIL;
+	else if (word == "const") return T_CONST;
+	else if (word == "function") return T_FUNC;
+	else if (word == "procedure") return T_PROC;
+	else if (word == "var") return T_VAR;
+	else if (word == "program") return T_PROGRAM;
+	else if (word == "label") return T_LABEL;
+	else if (word == "for") return T_FOR;
+	else if (word == "to") return T_TO;
+	else if (word == "downto") return T_DOWNTO;
+	else if (word == "do") return T_DO;
+	else if (word == "while") return T_WHILE;
+	else if (word == "repeat") return T_REPEAT;
+	else if (word == "until") return T_UNTIL;
+	else if (word == "true") return T_TRUE;
+	else if (word == "false") return T_FALSE;
+	return T_RESERVED;
+}
+
+static Token NewClassify(const char *s, size_t len)
+{
+	const Keyword *pKw = FindKeyword(s, len);
+	return pKw == nullptr ? T_ID : pKw->_tok;
+}
+
+int main()
+{
+	// Смесь, похожая на сгенерированные программы: ключевые слова, короткие и длинные имена
+	const char *samples[] = {
+		"begin", "end", "if", "then", "else", "while", "do", "for", "to", "var",
+		"integer", "real", "div", "mod", "and", "or", ":=",
+		"i", "j", "sum", "x1", "tmp", "counter", "accumulatorValue", "resultIndex42",
+		"generatedVariableNumber1234", "procedureTableEntry", "endIndex", "beginning"
+	};
+	const size_t nSamples = sizeof(samples) / sizeof(samples[0]);
+
+	std::vector<std::string> words;
+	for (size_t i = 0; i < 1000000; ++i)
+		words.push_back(samples[(i * 7919) % nSamples]);
+
+	// Сверяем результаты обеих схем
+	for (size_t i = 0; i < nSamples; ++i) {
+		std::string w = samples[i];
+		if (OldClassify(w) != NewClassify(w.data(), w.size())) {
+			printf("mismatch on '%s'\n", samples[i]);
+			return 1;
+		}
+	}
+
+	const int ROUNDS = 20;
+	typedef std::chrono::high_resolution_clock Clock;
+	unsigned long long checksum = 0;
+
+	Clock::time_point t0 = Clock::now();
+	for (int r = 0; r < ROUNDS; ++r)
+		for (const auto &w : words)
+			checksum += OldClassify(w);
+	Clock::time_point t1 = Clock::now();
+	for (int r = 0; r < ROUNDS; ++r)
+		for (const auto &w : words)
+			checksum += NewClassify(w.data(), w.size());
+	Clock::time_point t2 = Clock::now();
+
+	double total = (double)words.size() * ROUNDS;
+	double oldSec = std::chrono::duration<double>(t1 - t0).count();
+	double newSec = std::chrono::duration<double>(t2 - t1).count();
+
+	printf("unordered_set + if-chain: %8.1f Mwords/s\n", total / oldSec / 1e6);
+	printf("perfect hash table:       %8.1f Mwords/s\n", total / newSec / 1e6);
+	printf("speedup: %.1fx (checksum %llu)\n", oldSec / newSec, checksum);
+	return 0;
+}
@@ -0,0 +1,194 @@
+// Бенчмарк полного обхода дерева разбора большой программы:
+// прежняя диспетчеризация (switch по тегу и dynamic_cast к классу узла)
+// против статической диспетчеризации AstWalker из visitor.h.
+//
+// Сборка: cl /O2 /EHsc /I..\src\Include visitor_bench.cpp ..\src\parser.cpp ..\src\lexer.cpp
+//         ..\src\tokenizer.cpp ..\src\scan.cpp ..\src\keywords.cpp ..\src\symbols.cpp
+//         ..\src\numlit.cpp ..\src\arena.cpp ..\src\ast.cpp ..\src\threadpool.cpp
+//         ..\src\resolver.cpp ..\src\fold.cpp ..\src\constval.cpp ..\src\evaluator.cpp
+// Запуск: visitor_bench [число функций]
+
+#include "parser.h"
+#include "visitor.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Программа из n функций; каждая вызывает предыдущую
+static std::string GenerateProgram(int n)
+{
+	std::string src = "program bench;\nvar g: integer;\n";
+	for (int i = 0; i < n; ++i) {
+		std::string name = "f" + std::to_string(i);
+		src += "function " + name + "(a, b: integer): integer;\nvar x, y: integer;\nbegin\n"
+			"  x := a * 3 + b div 2 - (a - b) * 7;\n"
+			"  y := 0;\n"
+			"  while x > 0 do\n  begin\n"
+			"    if x mod 2 = 0 then y := y + x * 2 else y := y - 1;\n"
+			"    x := x - 1\n  end;\n"
+			"  repeat y := y div 2 until (y < 100) or (y > 1000);\n";
+		if (i > 0)
+			src += "  for x := 1 to 10 do y := y + f" + std::to_string(i - 1) + "(x, y);\n";
+		src += "  " + name + " := y + g\nend;\n";
+	}
+	src += "begin\n  g := f" + std::to_string(n - 1) + "(1, 2);\n  bench := g\nend\n";
+	return src;
+}
+
+// Обход в прежнем стиле: тег узла проверяется, а класс все равно получается dynamic_cast
+struct RttiWalker {
+	size_t _nodes;
+	size_t _sum; // Контрольная сумма по полям листьев
+
+	RttiWalker() : _nodes(0), _sum(0) {}
+
+	void Walk(Function *pFunc) {
+		WalkStatement(pFunc->seq);
+		for (auto &i : pFunc->Funcs)
+			Walk(i.second);
+	}
+
+	void WalkStatement(Statement *pStmt) {
+		++_nodes;
+		switch (pStmt->_type) {
+		case Statement::S_SEQ:
+			for (auto &i : dynamic_cast<StatementSeq *>(pStmt)->statements)
+				WalkStatement(i);
+			break;
+		case Statement::S_IF:
+		{
+			IfStatement *pIf = dynamic_cast<IfStatement *>(pStmt);
+			WalkExpression(pIf->_cond);
+			WalkStatement(pIf->_then);
+			if (pIf->_else != nullptr)
+				WalkStatement(pIf->_else);
+			break;
+		}
+		case Statement::S_WHILE:
+		{
+			WhileStatement *pWhile = dynamic_cast<WhileStatement *>(pStmt);
+			WalkExpression(pWhile->_condition);
+			WalkStatement(pWhile->_st);
+			break;
+		}
+		case Statement::S_REPEAT:
+		{
+			RepeatStatement *pRepeat = dynamic_cast<RepeatStatement *>(pStmt);
+			WalkStatement(pRepeat->_st);
+			WalkExpression(pRepeat->_condition);
+			break;
+		}
+		case Statement::S_FOR:
+		{
+			ForStatement *pFor = dynamic_cast<ForStatement *>(pStmt);
+			WalkExpression(pFor->_from);
+			WalkExpression(pFor->_to);
+			WalkStatement(pFor->_do);
+			break;
+		}
+		case Statement::S_ASSIGN:
+			WalkExpression(dynamic_cast<AssignStatement *>(pStmt)->_expr);
+			break;
+		case Statement::S_PROCCALL:
+			for (auto &i : dynamic_cast<ProcCallStatement *>(pStmt)->_params)
+				WalkExpression(i);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void WalkExpression(Expression *pExpr) {
+		++_nodes;
+		switch (pExpr->_type) {
+		case Expression::E_BINARY:
+		{
+			BinaryOp *pOp = dynamic_cast<BinaryOp *>(pExpr);
+			WalkExpression(pOp->_left);
+			WalkExpression(pOp->_right);
+			break;
+		}
+		case Expression::E_COND:
+		{
+			Condition *pCond = dynamic_cast<Condition *>(pExpr);
+			WalkExpression(pCond->_left);
+			WalkExpression(pCond->_right);
+			break;
+		}
+		case Expression::E_INDEX:
+			WalkExpression(dynamic_cast<ExprIndex *>(pExpr)->_index);
+			break;
+		case Expression::E_FUNCCALL:
+			for (auto &i : dynamic_cast<FuncCallExpr *>(pExpr)->_params)
+				WalkExpression(i);
+			break;
+		case Expression::E_ID:
+			_sum += dynamic_cast<ExprID *>(pExpr)->id;
+			break;
+		case Expression::E_CONST:
+			_sum += dynamic_cast<ExprConst *>(pExpr)->_val->_type;
+			break;
+		}
+	}
+};
+
+// Тот же подсчет через AstWalker: обработчики получают узел уже нужного класса
+struct CountingWalker : public AstWalker<CountingWalker> {
+	size_t _nodes;
+	size_t _sum;
+
+	CountingWalker() : _nodes(0), _sum(0) {}
+
+	void VisitStatement(Statement *) { ++_nodes; }
+	void VisitExpression(Expression *) { ++_nodes; }
+	void VisitID(ExprID *pEl) { ++_nodes; _sum += pEl->id; }
+	void VisitConst(ExprConst *pEl) { ++_nodes; _sum += pEl->_val->_type; }
+};
+
+template<class W>
+static double Measure(Root *pRoot, int runs, size_t &nodes, size_t &sum)
+{
+	double best = 1e30;
+	for (int r = 0; r < runs; ++r) {
+		W walker;
+		auto start = std::chrono::high_resolution_clock::now();
+		walker.Walk(pRoot);
+		auto end = std::chrono::high_resolution_clock::now();
+		double t = std::chrono::duration<double>(end - start).count();
+		if (t < best)
+			best = t;
+		nodes = walker._nodes;
+		sum = walker._sum;
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 20000;
+	const int RUNS = 20;
+
+	std::string src = GenerateProgram(n);
+	Parser P(src.data(), src.size());
+	P.Parse();
+	if (!P.IsSuccess()) {
+		printf("parse failed\n");
+		return 1;
+	}
+
+	size_t rttiNodes = 0, staticNodes = 0, rttiSum = 0, staticSum = 0;
+	double rtti = Measure<RttiWalker>(P._ast, RUNS, rttiNodes, rttiSum);
+	double stat = Measure<CountingWalker>(P._ast, RUNS, staticNodes, staticSum);
+
+	if (rttiNodes != staticNodes || rttiSum != staticSum) {
+		printf("traversal mismatch: %zu vs %zu nodes\n", rttiNodes, staticNodes);
+		return 1;
+	}
+
+	printf("%d functions, %zu nodes, best of %d runs\n", n, staticNodes, RUNS);
+	printf("dynamic_cast : %8.3f ms  %6.2f ns/node\n", rtti * 1e3, rtti * 1e9 / staticNodes);
+	printf("AstWalker    : %8.3f ms  %6.2f ns/node\n", stat * 1e3, stat * 1e9 / staticNodes);
+	return 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+// Сборка программы заранее (--emit-obj, --emit-exe). Объектный файл строит
+// CodeGenerator::EmitObject, исполняемый файл компонуется из него и маленькой среды
+// выполнения на C, main которой вызывает программу и печатает результат, как после
+// запуска JIT. Компонует компилятор C: переменная окружения PASCAL_CC, иначе cc (cl в Windows)
+
+// Расширение объектных файлов платформы
+extern const char *const OBJECT_EXT;
+
+// Исполняемый файл exe из объектного файла программы object; при ошибке false и error
+bool LinkExecutable(const std::string &object, const std::string &exe, std::string &error);
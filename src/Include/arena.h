@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#define ARENA_THREAD_LOCAL __declspec(thread)
+#else
+#define ARENA_THREAD_LOCAL __thread
+#endif
+
+// Признак того, что деструктор объекта в арене можно не вызывать.
+// По умолчанию - для тривиально разрушаемых типов; полиморфные узлы, у которых
+// кроме пустого виртуального деструктора ничего нет, объявляют это явно (ARENA_NO_DTOR).
+template<class T>
+struct ArenaSkipDtor : std::is_trivially_destructible<T> {};
+
+#define ARENA_NO_DTOR(T) template<> struct ArenaSkipDtor<T> : std::true_type {}
+
+// Арена для узлов AST и описаний типов одной компиляции.
+// Выделение - сдвиг указателя внутри блока; освобождение - разом, вместе с ареной.
+// Деструкторы вызываются только у объектов, которым они нужны (узлы с std::vector,
+// области видимости), остальные просто исчезают вместе с блоками.
+class Arena {
+	static const size_t BLOCK_SIZE = 64 * 1024;
+
+	struct Cleanup {
+		void *pObj;
+		void (*pDtor)(void *);
+	};
+
+	std::vector<char *> _blocks;
+	char *_cur;
+	char *_end;
+	std::vector<Cleanup> _cleanups;
+
+	size_t _bytesUsed;
+	size_t _bytesReserved;
+	size_t _objects;
+
+	static ARENA_THREAD_LOCAL Arena *s_pCurrent;
+
+	template<class T>
+	static void Destroy(void *p) { static_cast<T *>(p)->~T(); }
+
+	char *AllocateSlow(size_t size, size_t align);
+
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+public:
+	Arena();
+	~Arena();
+
+	void *Allocate(size_t size, size_t align)
+	{
+		char *p = (char *)(((size_t)_cur + align - 1) & ~(align - 1));
+		if (p + size > _end)
+			p = AllocateSlow(size, align);
+		_cur = p + size;
+		_bytesUsed += size;
+		return p;
+	}
+
+	template<class T, class... Args>
+	T *New(Args&&... args)
+	{
+		void *p = Allocate(sizeof(T), std::alignment_of<T>::value);
+		T *pObj = new (p) T(std::forward<Args>(args)...);
+		_objects++;
+		if (!ArenaSkipDtor<T>::value) {
+			Cleanup c = { pObj, &Destroy<T> };
+			_cleanups.push_back(c);
+		}
+		return pObj;
+	}
+
+	// Уничтожить все объекты и освободить память
+	void Reset();
+
+	size_t BytesUsed() const { return _bytesUsed; }
+	size_t BytesReserved() const { return _bytesReserved; }
+	size_t Objects() const { return _objects; }
+	size_t ObjectsWithDtor() const { return _cleanups.size(); }
+	void PrintStats(std::ostream &os) const;
+
+	// Арена, в которой создаются узлы в текущем потоке
+	static Arena *Current() { return s_pCurrent; }
+	static Arena *SetCurrent(Arena *pArena)
+	{
+		Arena *pOld = s_pCurrent;
+		s_pCurrent = pArena;
+		return pOld;
+	}
+};
+
+// Делает арену текущей на время жизни объекта
+class ArenaScope {
+	Arena *_pOld;
+public:
+	explicit ArenaScope(Arena *pArena) : _pOld(Arena::SetCurrent(pArena)) {}
+	~ArenaScope() { Arena::SetCurrent(_pOld); }
+};
+
+// Создание объекта в текущей арене
+template<class T, class... Args>
+T *ArenaNew(Args&&... args)
+{
+	return Arena::Current()->New<T>(std::forward<Args>(args)...);
+}
@@ -2,8 +2,12 @@
 
 #include <vector>
 #include <string>
-#include <map>
+#include <unordered_map>
 #include <algorithm>
+#include <cstring>
+
+#include "arena.h"
+#include "symbols.h"
 
 class Expression;
 class Function;
@@ -11,13 +15,18 @@ class Const;
 class Node;
 class ScopableNode;
 
+//       T  ,  RTTI ( dyn_cast  LLVM):
+//    static bool classof(const ScopableNode *). nullptr,    
+template<class T> T * NodeCast(ScopableNode *pNode);
+template<class T> const T * NodeCast(const ScopableNode *pNode);
+
 class Scope
 {
 public:
 	std::string name;
 	Scope *pParScope;
 
-	std::map <std::string, ScopableNode *> scope;
+	std::unordered_map <SymbolID, ScopableNode *> scope;
 
 	Scope(const std::string &name) : name(name), pParScope(nullptr) {}
 
@@ -43,7 +52,7 @@ public:
 		return pParScope == nullptr;
 	}
 
-	bool Add(std::string var, ScopableNode* val)
+	bool Add(SymbolID var, ScopableNode* val)
 	{
 		if(scope.find(var) == scope.end()) {
 			scope[var]=val;
@@ -53,18 +62,31 @@ public:
 			return false;
 	}
 
+	//   :  Get     (--lookup-stats).
+	//    :    (UnitBuilder)
+	static ARENA_THREAD_LOCAL size_t s_lookups, s_probes;
+
 	template<class T>
-	T * Get(std::string var)
+	T * Get(SymbolID var)
+	{
+		++s_lookups;
+		return Find<T>(var);
+	}
+
+private:
+	template<class T>
+	T * Find(SymbolID var)
 	{
 		T *pRes = nullptr;
 		
+		++s_probes;
 		auto res = scope.find(var);
 
-		if (res == scope.end() || (pRes = dynamic_cast<T *>(res->second)) == nullptr) {
+		if (res == scope.end() || (pRes = NodeCast<T>(res->second)) == nullptr) {
 			if (pParScope != nullptr)  {
-				pRes = pParScope->Get<T>(var);
+				pRes = pParScope->Find<T>(var);
 				// .        
-				if (!pParScope->IsRoot() && dynamic_cast<ScopableNode *>(pRes)->_type != ScopableNode::FUNC && dynamic_cast<Const *>(pRes) == nullptr)
+				if (pRes != nullptr && !pParScope->IsRoot() && static_cast<ScopableNode *>(pRes)->_type != ScopableNode::FUNC && NodeCast<Const>(pRes) == nullptr)
 					return nullptr;
 			}
 			else return nullptr;
@@ -82,13 +104,13 @@ public:
 
 class ScopableNode : public Node {
 public:
-	enum TYPE {VAR, FUNC};
+	enum TYPE {VAR, CONST, FUNC}; // CONST -   ( Const)
 
 	TYPE _type;
 
 	ScopableNode(TYPE type) : _type(type) {}
 
-	virtual ~ScopableNode() {}
+	static bool classof(const ScopableNode *) { return true; }
 };
 
 class Var : public ScopableNode
@@ -104,20 +126,50 @@ public:
 
 	Var() : Var(VOID) {}
 
+protected:
+	//  Const:   ,     isConst  TypeTable
+	//     
+	Var(ScopableNode::TYPE kind, TYPE type) : ScopableNode(kind), _type(type), isConst(true), isRef(false) {}
+
+public:
+
 	bool Is(const TYPE &t) const {
 		return _type == t;
 	}
+
+	static bool classof(const ScopableNode *pNode) { return pNode->_type == ScopableNode::VAR || pNode->_type == ScopableNode::CONST; }
+};
+
+//    .   (, , )
+//    :       ,
+//      
+class TypeTable {
+	static const Var s_types[(Var::VOID + 1) * 4];
+
+public:
+	static const Var * Get(Var::TYPE type, bool isConst = false, bool isRef = false) {
+		return &s_types[type * 4 + isConst * 2 + isRef];
+	}
 };
 
+//   isConst    Const
 class Const : public Var {
 public:
 	bool isNeg, isSet;
+	bool isArray; // ConstArray
 
-	Const(Var::TYPE t) : Var(t, true), isNeg(false) {}
+	Const(Var::TYPE t, bool isArray = false) : Var(ScopableNode::CONST, t), isNeg(false), isArray(isArray) {}
 
 	void SetNeg(bool neg) { isNeg = neg; }
 
-	virtual ~Const() {}
+	static bool classof(const ScopableNode *pNode) {
+		return pNode->_type == ScopableNode::CONST;
+	}
+
+	//    t
+	static bool IsScalar(const ScopableNode *pNode, Var::TYPE t) {
+		return classof(pNode) && !static_cast<const Const *>(pNode)->isArray && static_cast<const Var *>(pNode)->_type == t;
+	}
 };
 
 class ConstInteger : public Const
@@ -125,6 +177,8 @@ class ConstInteger : public Const
 public:
 	unsigned long long _val;
 	ConstInteger(const unsigned long long &i) : Const(Var::INTEGER), _val(i) {}
+
+	static bool classof(const ScopableNode *pNode) { return IsScalar(pNode, Var::INTEGER); }
 };
 
 class ConstBoolean : public Const
@@ -132,6 +186,8 @@ class ConstBoolean : public Const
 public:
 	bool _val;
 	ConstBoolean(bool i) : Const(Var::BOOLEAN), _val(i) {}
+
+	static bool classof(const ScopableNode *pNode) { return IsScalar(pNode, Var::BOOLEAN); }
 };
 
 class ConstReal : public Const
@@ -139,26 +195,45 @@ class ConstReal : public Const
 public:
 	double _val;
 	ConstReal(double i) : Const(Var::REAL), _val(i) {}
+
+	static bool classof(const ScopableNode *pNode) { return IsScalar(pNode, Var::REAL); }
+};
+
+//  -: const t: array [lo..hi] of T = (...).
+// _type -  ;   ,  -  double
+class ConstArray : public Const
+{
+public:
+	long long _low;
+	std::vector<unsigned long long> _vals;
+
+	ConstArray(Var::TYPE t, long long low) : Const(t, true), _low(low) {}
+
+	static bool classof(const ScopableNode *pNode) {
+		return Const::classof(pNode) && static_cast<const Const *>(pNode)->isArray;
+	}
+
+	double GetReal(size_t i) const {
+		double d;
+		memcpy(&d, &_vals[i], sizeof(d));
+		return d;
+	}
 };
 
 class ParamList {
 public:
-	typedef std::pair<std::string, Var *> func_param;
+	typedef std::pair<SymbolID, Var *> func_param;
 	std::vector<func_param> _params;
 
-	virtual ~ParamList() {
-		for (auto &i : _params)
-			delete i.second;
-	}
 };
 
 class Expression
 {
 public:
-	enum TYPE{E_BINARY, E_COND, E_CONST, E_ID, E_FUNCCALL};
+	enum TYPE{E_BINARY, E_COND, E_CONST, E_ID, E_FUNCCALL, E_INDEX};
 	bool isNeg;
 	TYPE _type;
-	Var *_pVar;
+	const Var *_pVar; //   TypeTable
 
 	Expression(TYPE type) :_type(type), isNeg(false), _pVar(nullptr) {}
 
@@ -168,23 +243,22 @@ public:
 		return (pT1->_type > pT2->_type ? pT2 : pT1);
 	}
 
-	const Var * GetVar(Scope *scp) {
+	const Var * GetVar() {
 		if (_pVar == nullptr)
-			CalculateVar(scp);
+			CalculateVarTree();
 
 		return _pVar;
 	}
 
-	virtual void CalculateVar(Scope *scp) = 0;
-
+	//          ,
+	//        .
+	//       (NameResolver)
+	void CalculateVarTree();
 
+	virtual void CalculateVar() = 0;
 
-	virtual ~Expression() {
-		delete _pVar;
-	}
 };
 
-
 class BinaryOp : public Expression {
 public:
 	enum OP { MUL, DIV, INT_DIV, MOD, AND, ADD, SUB, OR};
@@ -195,9 +269,9 @@ public:
 
 	BinaryOp(Expression *l, Expression *r, OP o) : Expression(E_BINARY), _left(l), _right(r), _op(o) {}
 
-	void CalculateVar(Scope *scp) final {
-		const Var *pLeftT = _left->GetVar(scp);
-		const Var *pRightT = _right->GetVar(scp);
+	void CalculateVar() final {
+		const Var *pLeftT = _left->GetVar();
+		const Var *pRightT = _right->GetVar();
 
 		if (pLeftT->_type >= Var::VOID || pRightT->_type >= Var::VOID)
 			throw std::exception("invalid type");
@@ -211,28 +285,44 @@ public:
 		else if (_op == DIV)
 			ResT = Var::REAL;
 
-		_pVar = new Var(ResT);
+		_pVar = TypeTable::Get(ResT);
 	}
 
-	virtual ~BinaryOp() {
-		delete _left;
-		delete _right;
-	}
 };
 class ExprID : public Expression {
 public:
 
-	std::string id;
+	SymbolID id;
+	Var *_pNode; // ,  NameResolver
+
+	ExprID(SymbolID name) : Expression(E_ID), id(name), _pNode(nullptr) {}
+
+	void CalculateVar() final {
+		if (_pNode == nullptr)
+			throw std::exception("unresolved name");
+
+		_pVar = TypeTable::Get(_pNode->_type, _pNode->isConst, _pNode->isRef);
+	}
+};
+
+//   : id[_index]
+class ExprIndex : public Expression {
+public:
+	SymbolID _id;
+	Expression *_index;
+	ConstArray *_pNode; // ,  NameResolver
 
-	ExprID(const std::string& name) : Expression(E_ID), id(name) {}
+	ExprIndex(SymbolID name, Expression *index) : Expression(E_INDEX), _id(name), _index(index), _pNode(nullptr) {}
 
-	void CalculateVar(Scope *scp) final {
-		auto inc = scp->Get<Var>(id);
+	void CalculateVar() final {
+		if (_pNode == nullptr)
+			throw std::exception("unresolved name");
 
-		if (inc == nullptr)
-			throw std::exception();
+		auto IndexT = _index->GetVar();
+		if (IndexT->_type != Var::INTEGER && IndexT->_type != Var::CHAR)
+			throw std::exception("invalid index type");
 
-		_pVar = new Var(*inc);
+		_pVar = TypeTable::Get(_pNode->_type);
 	}
 };
 
@@ -242,13 +332,10 @@ public:
 
 	ExprConst(Const *val = nullptr) : Expression(E_CONST), _val(val) {}
 
-	void CalculateVar(Scope *scp) final {
-		_pVar = new Var(*_val);
+	void CalculateVar() final {
+		_pVar = TypeTable::Get(_val->_type, true);
 	}
 
-	virtual ~ExprConst() {
-		delete _val;
-	}
 };
 
 class Condition : public Expression {
@@ -261,9 +348,9 @@ public:
 
 	Condition(Expression *l, Expression *r, OP o) : Expression(E_COND), _left(l), _right(r), _op(o) {}
 
-	void CalculateVar(Scope *scp) final {
-		auto LeftV = _left->GetVar(scp);
-		auto RightV = _right->GetVar(scp);
+	void CalculateVar() final {
+		auto LeftV = _left->GetVar();
+		auto RightV = _right->GetVar();
 
 		if (_op == IN)
 			throw std::exception("not supported yet");
@@ -271,13 +358,9 @@ public:
 		if (LeftV->_type >= Var::VOID)
 			throw std::exception("invalid type");
 
-		_pVar = new Var(Var::BOOLEAN);
+		_pVar = TypeTable::Get(Var::BOOLEAN);
 	}
 
-	virtual ~Condition() {
-		delete _left;
-		delete _right;
-	}
 };
 
 class Statement : public Node {
@@ -287,7 +370,6 @@ public:
 	TYPE _type;
 	Statement(TYPE type) : _type(type) {}
 
-	virtual ~Statement() {}
 };
 
 class IfStatement : public Statement {
@@ -299,12 +381,6 @@ public:
 
 public:
 	IfStatement(Expression *expr, Statement *th, Statement *el) : Statement(S_IF), _cond(expr), _then(th), _else(el) {}
-	virtual ~IfStatement()
-	{
-		delete _cond;
-		delete _then;
-		delete _else;
-	}
 };
 class WhileStatement : public Statement {
 public:
@@ -314,11 +390,6 @@ public:
 
 public:
 	WhileStatement(Expression *cond, Statement *st) : Statement(S_WHILE), _condition(cond), _st(st) {}
-	virtual ~WhileStatement()
-	{
-		delete _condition;
-		delete _st;
-	}
 };
 class StatementSeq : public Statement
 {
@@ -332,10 +403,6 @@ public:
 		statements.push_back(st);
 	}
 
-	virtual ~StatementSeq() {
-		for (auto &i : statements)
-			delete i;
-	}
 };
 class RepeatStatement : public Statement {
 public:
@@ -345,34 +412,24 @@ public:
 
 	RepeatStatement(Expression *cond, StatementSeq *st) : Statement(S_REPEAT), _condition(cond), _st(st) {}
 
-	virtual ~RepeatStatement()
-	{
-		delete _condition;
-		delete _st;
-	}
 };
 class AssignStatement : public Statement {
 public:
-	std::string _var;
+	SymbolID _var;
 	Expression *_expr;
+	Var *_pNode; // ,  NameResolver
 
-	AssignStatement(const std::string& var, Expression * expr) : Statement(S_ASSIGN), _var(var), _expr(expr) {}
+	AssignStatement(SymbolID var, Expression * expr) : Statement(S_ASSIGN), _var(var), _expr(expr), _pNode(nullptr) {}
 
-	virtual ~AssignStatement() {
-		delete _expr;
-	}
 };
 class ProcCallStatement : public Statement {
 public:
-	std::string _id;
+	SymbolID _id;
 	std::vector<Expression *> _params;
+	Function *_pFunc; // ,  NameResolver
 
-	ProcCallStatement(const std::string& var, const std::vector<Expression *> par) : Statement(S_PROCCALL), _id(var), _params(par) {}
+	ProcCallStatement(SymbolID var, const std::vector<Expression *> par) : Statement(S_PROCCALL), _id(var), _params(par), _pFunc(nullptr) {}
 
-	virtual ~ProcCallStatement() {
-		for (auto &i : _params)
-			delete i;
-	}
 };
 
 class ForStatement : public Statement {
@@ -380,65 +437,51 @@ class ForStatement : public Statement {
 public:
 	enum TYPE{ TO, DOWNTO };
 
-	std::string _var;
+	SymbolID _var;
 	Expression *_from;
 	Expression *_to;
 
 	Statement *_do;
 	TYPE _type;
+	Var *_pNode; //  ,  NameResolver
 
-	ForStatement(const std::string& var, Expression * from, Expression * to, Statement *d, TYPE type) :
-		Statement(S_FOR), _var(var), _from(from), _to(to), _do(d), _type(type) {}
+	ForStatement(SymbolID var, Expression * from, Expression * to, Statement *d, TYPE type) :
+		Statement(S_FOR), _var(var), _from(from), _to(to), _do(d), _type(type), _pNode(nullptr) {}
 
-	virtual ~ForStatement()
-	{
-		delete _from;
-		delete _to;
-		delete _do;
-	}
 };
 
 class Function : public ScopableNode {
 public:
-	std::string _ID; //  
+	SymbolID _ID; //  
 	ParamList *_params; //  
 
 	Var *_prtype; //   (VOID  )
 
 	Scope scp; //   
 
-	std::vector<std::pair<std::string, Var *>> Vars; //    
-	std::vector<std::pair<std::string, Function *>> Funcs; //   
+	std::vector<std::pair<SymbolID, Var *>> Vars; //    
+	std::vector<std::pair<SymbolID, Function *>> Funcs; //   
 
 	StatementSeq *seq; //  
 
-	bool add(const std::string &name, ScopableNode *pNode) {
+	bool add(SymbolID name, ScopableNode *pNode) {
 		if (!scp.Add(name, pNode))
 			return false;
 
 		switch (pNode->_type) {
 		case ScopableNode::VAR:
-			Vars.push_back({ name, dynamic_cast<Var *>(pNode) });
+		case ScopableNode::CONST:
+			Vars.push_back({ name, static_cast<Var *>(pNode) });
 			break;
 		case ScopableNode::FUNC:
-			Funcs.push_back({ name, dynamic_cast<Function *>(pNode) });
+			Funcs.push_back({ name, static_cast<Function *>(pNode) });
 			break;
 		}
 		return true;
 	}
 
-	Function(const std::string& id, ParamList *par, Var::TYPE rtype = Var::VOID) : ScopableNode(ScopableNode::FUNC),  scp(_ID), _ID(id), _params(par) {
-		_prtype = new Var(rtype);
-	}
-
-	virtual ~Function() {
-		for (auto &i : Vars)
-			delete i.second;
-		for (auto &i : Funcs)
-			delete i.second;
-
-		delete _prtype;
-		delete seq;
+	Function(SymbolID id, ParamList *par, Var::TYPE rtype = Var::VOID) : ScopableNode(ScopableNode::FUNC),  scp(SymName(id)), _ID(id), _params(par), seq(nullptr) {
+		_prtype = ArenaNew<Var>(rtype);
 	}
 
 	unsigned GetNumOfParams() const {
@@ -448,37 +491,132 @@ public:
 		return 0;
 	}
 
-
-	std::string GetID()
+	SymbolID GetID()
 	{
 		return _ID;
 	}
+
+	const std::string &GetName()
+	{
+		return SymName(_ID);
+	}
+
+	static bool classof(const ScopableNode *pNode) { return pNode->_type == ScopableNode::FUNC; }
 };
 
 class FuncCallExpr : public Expression {
 public:
-	std::string _name;
+	SymbolID _name;
 	std::vector<Expression *> _params;
+	Function *_pFunc; //  ,  NameResolver
 
-	FuncCallExpr(const std::string& s, const std::vector<Expression *>& par) : Expression(E_FUNCCALL), _name(s), _params(par) {}
+	FuncCallExpr(SymbolID s, const std::vector<Expression *>& par, Function *pFunc = nullptr) :
+		Expression(E_FUNCCALL), _name(s), _params(par), _pFunc(pFunc) {}
 
-	virtual ~FuncCallExpr() {
-		for (auto &i : _params)
-			delete i;
-	}
-	void CalculateVar(Scope *scp) final {
-		_pVar = new Var(*scp->Get<Function>(_name)->_prtype);
+	void CalculateVar() final {
+		if (_pFunc == nullptr)
+			throw std::exception("unresolved name");
+
+		_pVar = TypeTable::Get(_pFunc->_prtype->_type);
 	}
 };
 
+//     (unit)
+struct UnitSymbol {
+	SymbolID unit; //  
+	SymbolID name;
+	ScopableNode *pNode;
+};
+
 class Root : public Function
 {
 public:
+	bool isUnit; //  (unit ... interface ... implementation),   
+	std::vector<SymbolID> Uses; //   uses   
+	//     uses:     Root,
+	//     Vars  Funcs -     
+	std::vector<UnitSymbol> Imports;
+	//   :    ( -     implementation)
+	std::vector<std::pair<SymbolID, ScopableNode *>> Interface;
 
-	Root() : Function("", nullptr, Var::INTEGER) {
+	Root() : Function(Intern(""), nullptr, Var::INTEGER), isUnit(false) {
 	}
 
-	virtual ~Root()
-	{
+	bool Import(SymbolID unit, SymbolID name, ScopableNode *pNode) {
+		if (!scp.Add(name, pNode))
+			return false;
+		UnitSymbol sym = { unit, name, pNode };
+		Imports.push_back(sym);
+		return true;
 	}
 };
+
+template<class T>
+T * NodeCast(ScopableNode *pNode)
+{
+	return pNode != nullptr && T::classof(pNode) ? static_cast<T *>(pNode) : nullptr;
+}
+
+template<class T>
+const T * NodeCast(const ScopableNode *pNode)
+{
+	return pNode != nullptr && T::classof(pNode) ? static_cast<const T *>(pNode) : nullptr;
+}
+
+inline void Expression::CalculateVarTree()
+{
+	//   -      
+	std::vector<std::pair<Expression *, bool>> stack;
+	stack.push_back({ this, false });
+
+	while (!stack.empty()) {
+		Expression *pEl = stack.back().first;
+		if (pEl->_pVar != nullptr) {
+			stack.pop_back();
+			continue;
+		}
+
+		if (!stack.back().second) {
+			stack.back().second = true;
+
+			Expression *pLeft = nullptr, *pRight = nullptr;
+			if (pEl->_type == E_BINARY) {
+				pLeft = static_cast<BinaryOp *>(pEl)->_left;
+				pRight = static_cast<BinaryOp *>(pEl)->_right;
+			}
+			else if (pEl->_type == E_COND) {
+				pLeft = static_cast<Condition *>(pEl)->_left;
+				pRight = static_cast<Condition *>(pEl)->_right;
+			}
+			else if (pEl->_type == E_INDEX)
+				pLeft = static_cast<ExprIndex *>(pEl)->_index;
+
+			if (pRight != nullptr)
+				stack.push_back({ pRight, false });
+			if (pLeft != nullptr)
+				stack.push_back({ pLeft, false });
+			continue;
+		}
+
+		stack.pop_back();
+		pEl->CalculateVar();
+	}
+}
+
+//    :      
+ARENA_NO_DTOR(Var);
+ARENA_NO_DTOR(Const);
+ARENA_NO_DTOR(ConstInteger);
+ARENA_NO_DTOR(ConstBoolean);
+ARENA_NO_DTOR(ConstReal);
+ARENA_NO_DTOR(BinaryOp);
+ARENA_NO_DTOR(ExprID);
+ARENA_NO_DTOR(ExprIndex);
+ARENA_NO_DTOR(ExprConst);
+ARENA_NO_DTOR(Condition);
+ARENA_NO_DTOR(Statement);
+ARENA_NO_DTOR(IfStatement);
+ARENA_NO_DTOR(WhileStatement);
+ARENA_NO_DTOR(RepeatStatement);
+ARENA_NO_DTOR(AssignStatement);
+ARENA_NO_DTOR(ForStatement);
\ No newline at end of file
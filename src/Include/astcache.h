@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "parser.h"
+
+// Кэш деревьев разбора (режим --ast-cache).
+// Дерево удачно разобранного исходника вместе с таблицами областей видимости
+// сериализуется в файл <каталог>/<хеш исходника>.ast; при следующей компиляции того же
+// текста файл отображается в память и дерево строится прямо из него, без лексического
+// и синтаксического анализа. Сохраняется результат разбора до NameResolver: имена
+// хранятся таблицей строк и при загрузке заново интернируются.
+//
+// Формат: заголовок фиксированного размера (сигнатура, версия, размер и хеш исходника,
+// размер и хеш данных), затем таблица имен и подпрограммы в порядке Funcs (объемлющая
+// раньше вложенных) с параметрами, объявлениями и телами. Числа - LEB128, вещественные -
+// 8 байт; выражения записаны в обратном обходе, поэтому загружаются по явному стеку.
+// Запись другой версии, не того исходника или с испорченными данными не загружается.
+class AstCache {
+	std::string _dir;
+
+public:
+	// Меняется при любом изменении формата, узлов дерева или результата разбора
+	static const unsigned VERSION = 1;
+
+	explicit AstCache(const std::string &dir) : _dir(dir) {}
+
+	static unsigned long long HashSource(const char *src, size_t size);
+	// Файл записи для исходника с хешем hash
+	std::string PathFor(unsigned long long hash) const;
+
+	// Анализатор с деревом из кэша; nullptr - записи нет или ее нельзя использовать
+	Parser * Load(const char *src, size_t size) const;
+	// Записывает дерево удачно разобранного исходника (до свертки констант);
+	// false - записать не удалось, компиляция от этого не зависит
+	bool Store(const char *src, size_t size, const Parser &P) const;
+
+	// Образ записи в памяти и его загрузка в пустой анализатор (Parser()).
+	// hash и size - хеш (HashSource) и размер исходника
+	static void Serialize(unsigned long long hash, size_t size, const Root *pRoot, std::string &image);
+	static bool Deserialize(unsigned long long hash, size_t size, const char *data, size_t dataSize, Parser &P);
+};
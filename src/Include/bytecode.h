@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+#include "constval.h"
+#include "visitor.h"
+
+// Регистровый байткод для интерпретатора (vm.h) - замена JIT для коротких программ.
+// Регистры функции - ячейки ее кадра: сначала параметры, затем результат, переменные
+// и временные значения выражений. Кадр вызываемой функции начинается с регистров,
+// куда вызывающая положила аргументы, так что параметры не копируются.
+// Глобальные переменные - регистры кадра Root, который лежит в начале памяти,
+// поэтому тело программы работает с ними как с обычными регистрами, а остальные
+// функции - командами GETG/SETG по номеру ячейки.
+// Целые, символы и логические значения хранятся в long long со знаковым расширением
+// из разрядности типа (как ConstValue), вещественные - в double.
+
+// Ячейка памяти: регистр кадра или глобальная переменная
+union Slot {
+	long long i;
+	double d;
+};
+
+// Команды и число их операндов (для листинга).
+// _I - целые операции в 32 битах с переполнением, как в сгенерированном коде;
+// результат операций типов CHAR и BOOLEAN приводится к разрядности командами NORM_C и NORM_B.
+// Переходы J<сравнение>_I - сравнение целых регистров b и c с переходом на a
+#define BYTECODE_OPS(X) \
+	X(MOV, 2)    /* a = b */ \
+	X(LOADI, 2)  /* a = b (целое) */ \
+	X(LOADK, 2)  /* a = consts[b] */ \
+	X(GETG, 2)   /* a = глобальная b */ \
+	X(SETG, 2)   /* глобальная a = b */ \
+	X(ADDR, 2)   /* a = адрес регистра b */ \
+	X(LOADR, 2)  /* a = *b */ \
+	X(STORER, 2) /* *a = b */ \
+	X(ADD_I, 3) X(SUB_I, 3) X(MUL_I, 3) X(DIV_I, 3) X(MOD_I, 3) X(AND_I, 3) X(OR_I, 3) \
+	X(ADDK_I, 3) /* a = b + c (целое) */ \
+	X(NEG_I, 2) \
+	X(ADD_R, 3) X(SUB_R, 3) X(MUL_R, 3) X(DIV_R, 3) X(NEG_R, 2) \
+	X(NORM_C, 2) X(NORM_B, 2) \
+	X(I2R, 2) X(R2I, 2) X(R2C, 2) X(R2B, 2) X(I2B, 2) \
+	X(EQ_I, 3) X(NE_I, 3) X(LT_I, 3) X(LE_I, 3) X(GT_I, 3) X(GE_I, 3) \
+	X(EQ_R, 3) X(NE_R, 3) X(LT_R, 3) X(LE_R, 3) X(GT_R, 3) X(GE_R, 3) \
+	X(JMP, 1) \
+	X(LOOP, 1)   /* обратный переход цикла на a, считается как итерация (vm.h) */ \
+	X(JF, 2)     /* переход на b, если не a */ \
+	X(JEQ_I, 3) X(JNE_I, 3) X(JLT_I, 3) X(JLE_I, 3) X(JGT_I, 3) X(JGE_I, 3) \
+	X(TAB, 3)    /* a = tables[c][b] */ \
+	X(CALL, 3)   /* a = funcs[b](аргументы с регистра c) */ \
+	X(RET, 1)    /* возврат регистра a (a < 0 - процедура) */
+
+enum OpCode {
+#define BYTECODE_ENUM(name, n) OP_##name,
+	BYTECODE_OPS(BYTECODE_ENUM)
+#undef BYTECODE_ENUM
+	OP_COUNT
+};
+
+struct Instr {
+	unsigned op;
+	int a, b, c;
+};
+
+struct Bytecode {
+	struct Func {
+		SymbolID name;
+		Function *pFunc; // Подпрограмма дерева: по ней строится машинный код (tiering.h)
+		unsigned entry; // Первая команда в code
+		int nParams;
+		int nLocals; // Результат и переменные: обнуляются при вызове
+		int nRegs; // Размер кадра
+	};
+
+	// Константная таблица: значения в tableData с first, по правилам ConstValue::OfTable
+	struct Table {
+		long long low;
+		size_t size;
+		size_t first;
+	};
+
+	std::vector<Instr> code;
+	std::vector<Func> funcs; // funcs[0] - Root
+	std::vector<Slot> consts;
+	std::vector<Table> tables;
+	std::vector<Slot> tableData;
+	int nGlobals; // Ячейки Root: результат программы и глобальные переменные
+	std::vector<Var *> globals; // Переменные по глобальным ячейкам; у результата - nullptr
+
+	Bytecode() : nGlobals(0) {}
+
+	void Clear();
+	// Листинг команд по функциям
+	void Dump(std::ostream &out) const;
+};
+
+// Перевод дерева разбора в байткод: после NameResolver, ConstFolder и CallGraph.
+// Ошибки - исключения с теми же сообщениями, что у CodeGenerator
+class BytecodeGenerator : public AstVisitor<BytecodeGenerator> {
+	friend class AstVisitor<BytecodeGenerator>;
+
+	// Где лежит значение переменной
+	struct Location {
+		enum KIND { REG, GLOBAL };
+		KIND kind;
+		int index; // Регистр кадра или номер глобальной ячейки
+		bool isRef; // В ячейке адрес переменной (параметр var)
+	};
+
+	// Узел выражения, ожидающий значений операндов
+	struct Pending {
+		Expression *pEl;
+		Var::TYPE to; // Тип, к которому приводится значение узла
+		int dst; // Регистр результата; -1 - любой свободный
+		Var::TYPE opType; // Тип операндов бинарной операции или сравнения
+		Function *pFunc; // Вызываемая функция
+		int args; // Регистр первого аргумента вызова
+		unsigned next; // Номер следующего операнда
+		size_t base; // Начало регистров операндов в _operands
+		int top; // Первый свободный регистр до узла
+	};
+
+	Bytecode *_pCode;
+	int _top; // Первый свободный регистр кадра
+	int _maxTop;
+
+	std::unordered_map<const Function *, int> _funcs;
+	std::unordered_map<const ConstArray *, int> _tables;
+	std::unordered_map<const Var *, Location> _globals;
+	std::unordered_map<const Var *, Location> _locals; // Переменные текущей функции
+	std::unordered_map<unsigned long long, int> _constIndex; // Номера в consts по битам значения
+
+	std::vector<Pending> _stack;
+	std::vector<int> _operands;
+
+	int NewReg();
+	size_t Emit(OpCode op, int a = 0, int b = 0, int c = 0);
+	// Переход, цель которого станет известна позже (Patch)
+	void Patch(size_t jump, size_t target);
+	size_t Here() const { return _pCode->code.size(); }
+
+	const Location &Find(const Var *pVar);
+	int TableIndex(ConstArray *pArr);
+	void LoadConst(int dst, const ConstValue &v);
+	// Значение var-переменной в регистре без копирования; -1 - копия нужна
+	int InPlace(Expression *pExpr, Var::TYPE to);
+	void EmitCast(int dst, int src, Var::TYPE from, Var::TYPE to);
+	void EmitNegate(int dst, int src, Var::TYPE type);
+
+	// Значение выражения, приведенное к типу to, в регистре dst (-1 - в новом).
+	// Временные регистры освобождает вызывающий
+	int GenExpression(Expression *pRoot, Var::TYPE to, int dst = -1);
+	// То же, но переменная нужного типа остается в своем регистре
+	int GenValue(Expression *pExpr, Var::TYPE to);
+	int GenNode(Pending &frame, const int *pOps, int dst);
+	int GenAddress(Expression *pArg, int dst);
+	// Переход (номер команды для Patch), выполняемый, когда условие ложно
+	size_t GenJumpUnless(Expression *pCond);
+	void Store(const Var *pVar, Expression *pExpr);
+
+	void GenFunction(Function *pFunc);
+
+	void VisitSeq(StatementSeq *pEl);
+	void VisitIf(IfStatement *pEl);
+	void VisitFor(ForStatement *pEl);
+	void VisitWhile(WhileStatement *pEl);
+	void VisitAssign(AssignStatement *pEl);
+	void VisitProcCall(ProcCallStatement *pEl);
+	void VisitRepeat(RepeatStatement *pEl);
+
+public:
+	BytecodeGenerator() : _pCode(nullptr), _top(0), _maxTop(0) {}
+
+	void Generate(Root *pRoot, Bytecode &code);
+};
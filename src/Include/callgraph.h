@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.h"
+#include "visitor.h"
+
+// Удаление недостижимых подпрограмм: отдельный проход после ConstFolder.
+// Граф вызовов строится от тела Root (у модуля - от подпрограмм интерфейса):
+// просматриваются только тела уже достижимых подпрограмм, а подпрограммы,
+// до которых вызовы не доходят, убираются из Funcs вместе с вложенными,
+// так что генерация кода (и плоское дерево) их не видит.
+// Вложенная подпрограмма видна только внутри объемлющей, поэтому у недостижимой
+// подпрограммы все вложенные тоже недостижимы.
+// Имена уже связаны (NameResolver), после удаления их никто не ищет.
+class CallGraph : public AstWalker<CallGraph> {
+	friend class AstVisitor<CallGraph>;
+	friend class AstWalker<CallGraph>;
+
+	std::unordered_set<const Function *> _live;
+	std::vector<Function *> _pending; // Достижимые, тела которых еще не просмотрены
+	std::vector<Function *> _dead; // Удаленные подпрограммы (без вложенных в них)
+	size_t _total; // Подпрограмм в программе, не считая Root
+	size_t _nodes; // Операторов и выражений в просмотренных телах
+	bool _counting; // Обход удаленных тел для CountRemovedNodes
+
+	void Reach(Function *pFunc);
+	void Remove(Function *pFunc);
+	size_t CountRoutines(const Function *pFunc) const;
+
+	void VisitStatement(Statement *) { ++_nodes; }
+	void VisitExpression(Expression *) { ++_nodes; }
+	void VisitProcCall(ProcCallStatement *pEl) { ++_nodes; Reach(pEl->_pFunc); }
+	void VisitCall(FuncCallExpr *pEl) { ++_nodes; Reach(pEl->_pFunc); }
+
+public:
+	CallGraph() : _total(0), _nodes(0), _counting(false) {}
+
+	// При перезагрузке (hotreload.h) не применяется: измененное тело может вызвать
+	// подпрограмму, которой в модуле прошлой сборки нет
+	void Prune(Root *pRoot);
+
+	size_t Total() const { return _total; }
+	size_t Live() const { return _live.size() - 1; }
+	size_t Removed() const { return _total - Live(); }
+
+	// Размер достижимых тел; размер удаленных считается отдельным обходом
+	size_t LiveNodes() const { return _nodes; }
+	size_t CountRemovedNodes();
+};
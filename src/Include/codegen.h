@@ -3,41 +3,77 @@
 #include "commondf.h"
 
 #include <llvm/Analysis/Passes.h>
+#include <llvm/Bitcode/ReaderWriter.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/JIT.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Linker/Linker.h>
 #include <llvm/PassManager.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetRegistry.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/Transforms/Scalar.h>
 
+#include <chrono>
 #include <unordered_map>
+#include <unordered_set>
 #include <deque>
 
+#include "flatast.h"
 #include "parser.h"
+#include "visitor.h"
 
-class CodeGenerator {
+class CodeGenerator : public AstVisitor<CodeGenerator, llvm::Value *> {
+	friend class AstVisitor<CodeGenerator, llvm::Value *>;
 private:
 	static CodeGenerator *m_pInst;
-	CodeGenerator();
+	// Уровень оптимизации (-O0..-O3) и размера (-Os - 1) для всех модулей, в том числе модулей
+	// программы (units.h) и многоуровневого выполнения
+	static unsigned m_OptLevel;
+	static unsigned m_SizeLevel;
+	explicit CodeGenerator(llvm::LLVMContext &context);
 	virtual ~CodeGenerator();
 private:
 	llvm::LLVMContext &m_Context;
 	llvm::Module *m_pMainModule;
 	llvm::FunctionPassManager *m_pOurFPM;
 	llvm::ExecutionEngine *m_pExe;
+	// Кэш машинного кода (jitcache.h); с ним программа выполняется через MCJIT
+	llvm::ObjectCache *m_pCache;
 	llvm::IRBuilder<> *m_pBuilder;
 	string m_ErrorString;
+	double m_GenTime;
+	double m_OptTime;
 
 	std::unordered_map<ScopableNode *, llvm::Value *> m_ValueMap;
+	// Имена в модуле LLVM объявлений из интерфейсов модулей ("модуль.имя"); у остальных - свое имя
+	std::unordered_map<const ScopableNode *, std::string> m_LinkNames;
 	
 	Scope *m_pCurScope;
 
+	void CreateModule(const std::string &name);
+	// Исполняющая среда для m_pMainModule под процессор машины с генерацией кода по m_OptLevel
+	bool CreateEngine();
+	static llvm::CodeGenOpt::Level CodeGenLevel();
 	llvm::Value * GenRoot(Root *pEl);
+	// Модуль (unit): глобальные переменные и подпрограммы без тела Root
+	void GenUnit(Root *pUnit);
+	// Внешние объявления для импортированных из интерфейсов модулей подпрограмм и переменных
+	void DeclareImports(Root *pRoot);
+	const std::string &LinkName(Function *pFunc);
 
 	llvm::Value * GenStatement(Statement *pEl);
 	llvm::Value * GenStmntSeq(StatementSeq *pEl);
@@ -48,21 +84,63 @@ private:
 	llvm::Value * GenRepeatStatement(RepeatStatement *pEl);
 	llvm::Value * GenIfStatement(IfStatement *pEl);
 
+	// Обработчики операторов для GenStatement (AstVisitor)
+	llvm::Value * VisitSeq(StatementSeq *pEl) { return GenStmntSeq(pEl); }
+	llvm::Value * VisitIf(IfStatement *pEl) { return GenIfStatement(pEl); }
+	llvm::Value * VisitFor(ForStatement *pEl) { return GenForStatement(pEl); }
+	llvm::Value * VisitWhile(WhileStatement *pEl) { return GenWhileStatement(pEl); }
+	llvm::Value * VisitAssign(AssignStatement *pEl) { return GenAssignStatement(pEl); }
+	llvm::Value * VisitProcCall(ProcCallStatement *pEl) { return GenProcCallStatement(pEl); }
+	llvm::Value * VisitRepeat(RepeatStatement *pEl) { return GenRepeatStatement(pEl); }
+
 	llvm::Value * GenExpression(Expression *pEl);
 	llvm::Value * GenExprConst(ExprConst *pEl);
 	llvm::Value * GenExprID(ExprID *pEl, bool getRef = false);
-	llvm::Value * GenBinaryOp(BinaryOp *pEl);
-	llvm::Value * GenFuncCallExpr(FuncCallExpr *pEl);
-	llvm::Value * GenCondition(Condition *pEl);
+	llvm::Value * GenExprIndex(ExprIndex *pEl, llvm::Value *pIndex);
+	// Операнды уже вычислены и приведены к нужному типу
+	llvm::Value * GenBinaryOp(BinaryOp *pEl, const Var *pType, llvm::Value *pLeft, llvm::Value *pRight);
+	llvm::Value * GenFuncCallExpr(Function *pFunc, std::vector<llvm::Value *> &ArgsV);
+	llvm::Value * GenCondition(Condition *pEl, const Var *pBestT, llvm::Value *pLeft, llvm::Value *pRight);
 	
 	llvm::Function * GenFunctionHeader(Function *pFunc);
 	llvm::Value * GenFunctionBody(Function *pFunc);
 	llvm::Value * GenFunction(Function *pEl);
 
+	// Многоуровневое выполнение: подпрограммы, тела которых уже построены
+	std::unordered_set<const Function *> m_TieredBodies;
+	// Переходник void(i64 *mem, i64 *args, i64 *res) к pFunc для интерпретатора (vm.h)
+	llvm::Function * GenTieredThunk(Function *pFunc);
+	// Значение типа type в ячейке интерпретатора (i64 со знаковым расширением или double)
+	llvm::Value * LoadSlot(llvm::Value *pSlot, Var::TYPE type);
+	void StoreSlot(llvm::Value *pSlot, llvm::Value *pV, Var::TYPE type);
+
 	llvm::Type * GetType(const Var *pV);
+	llvm::Type * GetType(Var::TYPE type, bool isRef = false);
 	llvm::Constant * GetConstValue(const Const *pC);
+	// Данные константной таблицы (ConstArray::_vals) как массив элементов type
+	llvm::Constant * GetConstTable(Var::TYPE type, const unsigned long long *pVals, size_t size);
+	// Элемент таблицы с нижней границей low по индексу типа INTEGER
+	llvm::Value * CreateTableLoad(llvm::Value *pTable, Var::TYPE type, long long low,
+		llvm::Value *pIndex, const std::string &name);
 
 	llvm::Value * ExpressionCaster(Expression *pExp, const Var *pTo);
+	llvm::Value * CastValue(llvm::Value *pV, Var::TYPE from, Var::TYPE to);
+	llvm::Value * CreateBinaryOp(BinaryOp::OP op, Var::TYPE type, llvm::Value *pLeft, llvm::Value *pRight);
+	llvm::Value * CreateCompare(Condition::OP op, Var::TYPE type, llvm::Value *pLeft, llvm::Value *pRight);
+
+	// Генерация по плоскому дереву
+	const FlatAST *m_pFlat;
+	std::vector<llvm::Value *> m_FlatValues; // Значения узлов выражений по номерам
+	std::vector<llvm::Value *> m_FlatVars; // Память переменных по номерам
+	std::vector<llvm::Function *> m_FlatFuncs;
+
+	void GenFlat(const FlatAST &flat);
+	llvm::Function * FlatGenFunctionHeader(FlatIdx f);
+	void FlatGenFunctionBody(FlatIdx f);
+	void FlatGenStatement(FlatIdx i);
+	llvm::Value * FlatGenExpression(FlatIdx ref, Var::TYPE to);
+	llvm::Value * FlatAlloca(llvm::Function *pFunction, FlatIdx v);
+	llvm::Constant * GetFlatConst(FlatIdx c, Var::TYPE type);
 
 	llvm::Value *CreateEntryBlockAlloca(llvm::Function *TheFunction,
 		const std::string &VarName, Var *pVarType, bool IsGlobal = false) {
@@ -70,13 +148,14 @@ private:
 		if (IsGlobal || pVarType->isConst) {
 			llvm::Constant *pDefValue;
 			if (pVarType->isConst) {
-				Const *pC = dynamic_cast<Const *>(pVarType);
+				Const *pC = static_cast<Const *>(pVarType);
 				pDefValue = GetConstValue(pC);
 			}
 			else pDefValue = llvm::Constant::getNullValue(GetType(pVarType));
 			
 
-			return new llvm::GlobalVariable(*m_pMainModule, GetType(pVarType), pVarType->isConst,
+			// Тип берется у значения: у константной таблицы это массив
+			return new llvm::GlobalVariable(*m_pMainModule, pDefValue->getType(), pVarType->isConst,
 				llvm::GlobalVariable::LinkageTypes::CommonLinkage, pDefValue, VarName);
 		}
 
@@ -89,9 +168,55 @@ private:
 
 public:
 
+	// Имя точки входа программы в объектном файле (EmitObject), ее вызывает main среды выполнения
+	static const char *const AOT_ENTRY;
+
 	static CodeGenerator * getInstance();
-	bool Generate(Parser *pP);
+	// До первой сборки. 0 - без оптимизации; 1 и выше - оптимизация функций при построении тел
+	// и уровень генерации машинного кода; sizeLevel - предпочтение размера кода скорости.
+	// На tests/*.pas Optimize занимает 6-8 мс на программу против 1 мс построения тел, а циклы
+	// с вызовами после встраивания на -O2 выполняются втрое быстрее, чем на -O0
+	static void SetOptLevel(unsigned optLevel, unsigned sizeLevel);
+	// Все, от чего кроме модуля зависит машинный код: платформа, процессор и уровни оптимизации
+	static std::string TargetKey();
+	// pFlat != nullptr - код строится по плоскому дереву вместо pP->_ast.
+	// eager - машинный код всех подпрограмм строится до запуска, иначе при первом вызове.
+	// pCache != nullptr - модуль целиком компилирует MCJIT, беря объект из кэша, если он там есть;
+	// ленивой компиляции и Regenerate тогда нет
+	bool Generate(Parser *pP, const FlatAST *pFlat = nullptr, bool eager = false, llvm::ObjectCache *pCache = nullptr);
+	// Горячая перезагрузка (hotreload.h): значения глобальных переменных, констант и функций
+	// переносятся с узлов прошлого дерева на узлы нового (rebind), тела funcs строятся заново
+	// в том же модуле, а их прежний машинный код перенаправляется на новый
+	bool Regenerate(Parser *pP, const std::vector<std::pair<ScopableNode *, ScopableNode *>> &rebind,
+		const std::vector<Function *> &funcs);
+	// Модуль (units.h) компилируется в свой модуль LLVM в отдельном контексте и записывается
+	// биткодом в path. Можно вызывать из нескольких потоков одновременно
+	static bool GenerateUnit(Parser *pP, const std::string &path, std::string &error);
+	// Компоновка с программой скомпилированного модуля из файла биткода (после Generate)
+	bool LinkUnit(const std::string &path);
+	// Межпроцедурная оптимизация всего модуля перед выполнением (после LinkUnit): встраивание,
+	// развертка и векторизация циклов. Не для горячей перезагрузки: встроенное в вызывающих
+	// тело не заменить перестройкой одной функции
+	void Optimize();
+	// Машинный код программы для процессора этой машины в объектный файл path (после Optimize)
+	// вместо выполнения. Точка входа переименовывается в AOT_ENTRY, остальные символы
+	// становятся локальными; модуль после этого выполнять нельзя
+	bool EmitObject(const std::string &path, std::string &error);
+	// Многоуровневое выполнение (tiering.h): модуль с заголовками всех подпрограмм и без тел.
+	// Глобальные переменные Root - внешние объявления по адресам globals (память интерпретатора)
+	bool BeginTiered(Parser *pP, const std::unordered_map<const Var *, void *> &globals, std::string &error);
+	// Тела pFunc и еще не построенных подпрограмм, достижимых из нее вызовами, и машинный код
+	// переходника к ней (NativeFunc из vm.h); nullptr при ошибке
+	void * CompileTiered(Parser *pP, Function *pFunc, std::string &error);
 	void Release();
 	void Dump();
+	void Dump(Function *pFunc);
 	int Execute();
+	// Число подпрограмм модуля, для которых уже построен машинный код; total - всех с телом
+	size_t CompiledRoutines(size_t &total) const;
+
+	// Время построения и оптимизации тел функций при последней сборке Generate, мс
+	double GenTime() const { return m_GenTime; }
+	// Время последнего Optimize, мс
+	double OptTime() const { return m_OptTime; }
 };
\ No newline at end of file
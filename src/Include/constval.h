@@ -0,0 +1,30 @@
+#pragma once
+
+#include "ast.h"
+
+// Значение, вычисленное при компиляции (ConstFolder, PureEvaluator).
+// Операции повторяют сгенерированный код: целые 32-битные с переполнением, CHAR - 8 бит,
+// логические - 1 бит, приведения как в CodeGenerator::CastValue, сравнения как в CreateCompare.
+// Операции с неопределенным в коде результатом возвращают false и не вычисляются
+struct ConstValue {
+	Var::TYPE _type;
+	long long _int; // Целые - со знаковым расширением из разрядности типа, логические - 0 или 1
+	double _real;
+
+	// Целое значение в разрядности типа, как в регистре сгенерированного кода
+	static long long Normalize(Var::TYPE type, unsigned long long v);
+
+	static ConstValue Of(const Const *pC);
+	// Элемент таблицы по индексу; false - индекс за границами
+	static bool OfTable(const ConstArray *pArr, long long index, ConstValue &v);
+	// Новый узел константы; для CHAR узлов нет
+	Const * MakeConst() const;
+
+	bool Cast(Var::TYPE to);
+	void Negate();
+
+	// Операнды уже приведены к типу операции type
+	static bool Apply(BinaryOp::OP op, Var::TYPE type, const ConstValue &l, const ConstValue &r, ConstValue &res);
+	// Операнды уже приведены к общему типу
+	static bool Compare(Condition::OP op, const ConstValue &l, const ConstValue &r, ConstValue &res);
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "constval.h"
+#include "visitor.h"
+
+// Вычисление вызовов чистых функций при компиляции.
+// Чистая функция работает только со своими параметрами, локальными переменными
+// и константами: не читает и не пишет глобальные и объемлющие переменные,
+// не имеет параметров по ссылке и вызывает только чистые функции.
+// Тело исполняется интерпретатором дерева разбора по правилам сгенерированного кода
+// (ConstValue). Вычисление прерывается без результата при чтении неинициализированной
+// переменной, операции с неопределенным результатом, превышении числа шагов
+// или глубины рекурсии.
+class PureEvaluator : public AstVisitor<PureEvaluator, bool> {
+	friend class AstVisitor<PureEvaluator, bool>;
+
+	static const size_t STEP_BUDGET = 1 << 20; // Операторов и узлов выражений на вызов
+	static const unsigned MAX_DEPTH = 256; // Вложенных вызовов
+
+	typedef std::unordered_map<const Var *, ConstValue> Frame; // Инициализированные переменные
+	typedef std::pair<const Function *, std::vector<unsigned long long>> CallKey;
+
+	// Узел выражения, ожидающий значений операндов
+	struct EvalFrame {
+		Expression *pEl;
+		unsigned next;
+		size_t base; // Начало значений операндов в _values
+	};
+
+	std::unordered_set<const Function *> _pure;
+	std::map<CallKey, std::pair<bool, ConstValue>> _results; // Уже вычисленные вызовы
+
+	Frame *_pFrame;
+	size_t _steps;
+	unsigned _depth;
+	std::vector<EvalFrame> _stack;
+	std::vector<ConstValue> _values;
+
+	bool Step() { return ++_steps <= STEP_BUDGET; }
+
+	bool VisitStatement(Statement *) { return false; }
+	bool VisitEmpty(Statement *) { return Step(); }
+	bool VisitSeq(StatementSeq *pEl);
+	bool VisitIf(IfStatement *pEl);
+	bool VisitFor(ForStatement *pEl);
+	bool VisitWhile(WhileStatement *pEl);
+	bool VisitAssign(AssignStatement *pEl);
+	bool VisitProcCall(ProcCallStatement *pEl);
+	bool VisitRepeat(RepeatStatement *pEl);
+
+	bool Eval(Expression *pExpr, Var::TYPE to, ConstValue &res);
+	bool Compute(Expression *pEl, const ConstValue *pOps, ConstValue &res);
+	bool EvalArgs(Function *pFunc, const std::vector<Expression *> &params, std::vector<ConstValue> &args);
+	bool Invoke(Function *pFunc, const std::vector<ConstValue> &args, ConstValue &res);
+
+public:
+	PureEvaluator() : _pFrame(nullptr), _steps(0), _depth(0) {}
+
+	// Находит чистые функции программы; имена уже связаны (NameResolver)
+	void Analyze(Root *pRoot);
+
+	bool IsPure(const Function *pFunc) const { return _pure.count(pFunc) != 0; }
+
+	// Результат вызова чистой функции с аргументами, приведенными к типам параметров.
+	// false - при компиляции вызов не вычисляется
+	bool Call(Function *pFunc, const std::vector<ConstValue> &args, ConstValue &res);
+};
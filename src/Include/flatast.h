@@ -0,0 +1,99 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+
+// Номер узла, переменной или функции в плоском дереве
+typedef unsigned FlatIdx;
+const FlatIdx FLAT_NONE = 0xFFFFFFFF;
+
+// Плоское представление программы.
+// Узлы лежат в параллельных массивах (вид, операция, флаги, тип результата и три операнда)
+// и ссылаются друг на друга 32-битными номерами; списки детей - отрезки массива _extra,
+// значения констант - в _consts, имена - номера таблицы имен.
+// Узлы записаны в обратном обходе: дети всегда раньше родителя, поэтому семантический
+// анализ - один проход по массиву, а поддерево выражения занимает сплошной отрезок.
+//
+// Операнды по видам узлов:
+//   F_CONST    a - номер в _consts, тип сразу в _type
+//   F_ID       a - переменная, b - имя
+//   F_BINARY   a, b - левый и правый операнды, _op - BinaryOp::OP
+//   F_COND     a, b - левый и правый операнды, _op - Condition::OP
+//   F_CALL     a - функция, b, c - отрезок _extra с корнями аргументов
+//   F_INDEX    a - переменная-таблица, b - индекс
+//   F_SEQ      b, c - отрезок _extra с операторами
+//   F_IF       a - условие, b - then, c - else (FLAT_NONE, если нет)
+//   F_WHILE    a - условие, b - тело
+//   F_REPEAT   a - условие, b - тело
+//   F_FOR      a - переменная, b - отрезок _extra [от, до, тело], _op - ForStatement::TYPE
+//   F_ASSIGN   a - переменная, b - выражение
+//   F_PROCCALL a - выражение F_CALL
+//   F_EMPTY    -
+// Выражение в операторе задается номером в _extra, где лежат начало и корень его отрезка.
+class FlatAST {
+public:
+	enum KIND {
+		F_CONST, F_ID, F_BINARY, F_COND, F_CALL, F_INDEX,
+		F_SEQ, F_IF, F_WHILE, F_REPEAT, F_FOR, F_ASSIGN, F_PROCCALL, F_EMPTY
+	};
+
+	enum FLAGS {
+		NEG = 1,  // Унарный минус над результатом выражения
+		ADDR = 2  // Переменная передается по ссылке: нужен адрес, а не значение
+	};
+
+	// Переменная, параметр, константа или возвращаемое значение функции
+	struct VarInfo {
+		SymbolID _name;
+		unsigned char _type; // Var::TYPE
+		bool _isConst, _isRef, _isGlobal;
+		FlatIdx _const; // Номер в _consts для констант (первого элемента у таблиц)
+		FlatIdx _size; // Число элементов таблицы, 0 у остальных
+		int _low; // Нижняя граница индекса таблицы
+	};
+
+	struct FuncInfo {
+		SymbolID _name;
+		FlatIdx _parent; // FLAT_NONE у Root
+		FlatIdx _result; // Переменная результата (FLAT_NONE у процедур)
+		FlatIdx _firstParam, _nParams; // Параметры - отрезок _vars
+		FlatIdx _firstVar, _nVars; // Переменные и константы - отрезок _vars
+		FlatIdx _body; // Узел F_SEQ
+	};
+
+	// Узлы
+	std::vector<unsigned char> _kind, _op, _flags, _type;
+	std::vector<FlatIdx> _a, _b, _c;
+
+	std::vector<FlatIdx> _extra;
+	std::vector<unsigned long long> _consts; // Целые как есть, вещественные - битами double
+	std::vector<VarInfo> _vars;
+	std::vector<FuncInfo> _funcs; // _funcs[0] - Root; родитель всегда раньше вложенных
+
+	// Строит плоское дерево по дереву разбора с уже связанными именами (NameResolver)
+	void Build(Root *pRoot);
+
+	// Вычисляет типы всех выражений и проверяет их одним проходом по узлам.
+	// При ошибке бросает исключение, как Expression::CalculateVar
+	void Check();
+
+	size_t Size() const { return _kind.size(); }
+	size_t BytesUsed() const;
+	void PrintStats(std::ostream &os) const;
+
+	double GetReal(FlatIdx c) const;
+	unsigned long long GetInteger(FlatIdx c) const { return _consts[c]; }
+
+	// Начало и корень отрезка выражения, записанного в _extra[ref]
+	FlatIdx ExprBegin(FlatIdx ref) const { return _extra[ref]; }
+	FlatIdx ExprRoot(FlatIdx ref) const { return _extra[ref + 1]; }
+
+private:
+	struct Builder;
+
+	FlatIdx AddNode(KIND kind, FlatIdx a = FLAT_NONE, FlatIdx b = FLAT_NONE, FlatIdx c = FLAT_NONE);
+	FlatIdx AddConst(const Const *pC);
+};
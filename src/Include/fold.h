@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "ast.h"
+#include "evaluator.h"
+#include "visitor.h"
+
+// Свертка констант: отдельный проход после NameResolver.
+// Константные подвыражения (литералы, скалярные константы, элементы таблиц с постоянным
+// индексом и операции над ними) заменяются узлами ExprConst с готовым значением, так что
+// в код попадают непосредственные операнды вместо загрузок и вычислений.
+// Вызовы чистых функций с постоянными аргументами вычисляются (PureEvaluator).
+// Значения считаются по правилам сгенерированного кода (ConstValue). Операции, результат
+// которых в коде не определен (деление на ноль, вещественное вне диапазона целого),
+// не сворачиваются и остаются до выполнения.
+// Новые узлы создаются в текущей арене (ArenaScope дерева разбора).
+class ConstFolder : public AstVisitor<ConstFolder> {
+	friend class AstVisitor<ConstFolder>;
+
+	// Операнд, ожидающий свертки: ссылка на него в родителе и номер следующего его операнда
+	struct Frame {
+		Expression **ppSlot;
+		unsigned next;
+	};
+	std::vector<Frame> _stack;
+
+	PureEvaluator _eval;
+	size_t _folded; // Свернутых операций
+	size_t _refs; // Подставленных ссылок на константы
+	size_t _calls; // Вычисленных вызовов
+
+	void VisitSeq(StatementSeq *pEl);
+	void VisitIf(IfStatement *pEl);
+	void VisitFor(ForStatement *pEl);
+	void VisitWhile(WhileStatement *pEl);
+	void VisitAssign(AssignStatement *pEl);
+	void VisitProcCall(ProcCallStatement *pEl);
+	void VisitRepeat(RepeatStatement *pEl);
+
+	void FoldFunction(Function *pFunc);
+	// Ссылка на следующий сворачиваемый операнд pEl (аргументы по ссылке пропускаются)
+	Expression ** NextOperand(Expression *pEl, unsigned &next);
+	// Узел с уже свернутыми операндами или его значение
+	Expression * FoldNode(Expression *pEl);
+
+public:
+	ConstFolder() : _folded(0), _refs(0), _calls(0) {}
+
+	// Тела, не разобранные при перезагрузке (hotreload.h), пропускаются.
+	// evalCalls == false - вызовы не вычисляются, и код функции не зависит от тел вызываемых
+	void Fold(Root *pRoot, bool evalCalls = true);
+	// Свернутое выражение; имена в нем уже связаны
+	Expression * FoldExpression(Expression *pExpr);
+	// Значение константного выражения (объявление const) новым узлом;
+	// nullptr - выражение не константное
+	Const * Evaluate(Expression *pExpr);
+
+	size_t Folded() const { return _folded; }
+	size_t Refs() const { return _refs; }
+	size_t Calls() const { return _calls; }
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "codegen.h"
+#include "parser.h"
+
+// Время последнего изменения (с точностью файловой системы) и размер файла; false, если файл недоступен
+bool GetSourceStamp(const std::string &path, unsigned long long &time, unsigned long long &size);
+
+// Горячая перезагрузка программы (режим --watch).
+// Ключ подпрограммы - хеш ее собственных лексем (без вложенных подпрограмм), объявлений
+// всех объемлющих подпрограмм и заголовков всех подпрограмм программы. Если заголовки
+// не изменились, при перезагрузке заново разбираются, генерируются и компилируются только
+// тела подпрограмм с новым ключом, остальные остаются в модуле и машинном коде прошлой
+// сборки; иначе программа собирается целиком.
+// Глобальные переменные сохраняют значения между перезагрузками. Модули (uses) не
+// поддерживаются: такая программа отвергается с сообщением об ошибке.
+class HotReloader {
+	std::string _path;
+	unsigned _nThreads;
+
+	// Последняя удачная сборка: дерево (тела есть только у перестроенных подпрограмм)
+	// и ключи подпрограмм в порядке Parser::_routines
+	std::unique_ptr<Parser> _parser;
+	std::vector<unsigned long long> _keys;
+	std::vector<unsigned long long> _declKeys; // Хеши собственных объявлений
+	unsigned long long _interface; // Хеш заголовков всех подпрограмм
+
+	size_t _rebuilt, _reused;
+
+	void ComputeKeys(const Parser &P, std::vector<unsigned long long> &keys,
+		std::vector<unsigned long long> &declKeys, unsigned long long &iface) const;
+
+	HotReloader(const HotReloader &) = delete;
+	HotReloader &operator=(const HotReloader &) = delete;
+
+public:
+	// nThreads - как у Parser: разбор всегда идет по массиву лексем
+	HotReloader(const std::string &path, unsigned nThreads);
+
+	// Первая сборка или перезагрузка из файла. При ошибке разбора работающий код
+	// прошлой сборки не меняется, а после ошибки генерации следующая сборка будет полной
+	bool Load(CodeGenerator *pGen);
+
+	size_t Rebuilt() const { return _rebuilt; }
+	size_t Reused() const { return _reused; }
+};
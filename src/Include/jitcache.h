@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+// Кэш машинного кода JIT на диске (режим --jit-cache).
+// Ключ записи - хеш биткода оптимизированного модуля вместе с описанием цели
+// (CodeGenerator::TargetKey: платформа, процессор, его возможности и уровень оптимизации),
+// запись - <каталог>/<ключ>.o: объектный файл и хеш его содержимого. При попадании MCJIT
+// загружает объект вместо работы генератора машинного кода.
+// Каталог можно делить между процессами: запись появляется переименованием временного
+// файла, испорченная не загружается. Размер каталога ограничен: после записи удаляются
+// давно не использованные (по времени изменения, которое обновляется при попадании)
+class JitCache : public llvm::ObjectCache {
+	std::string _dir;
+	unsigned long long _capacity;
+	std::string _target;
+	// Модуль, для которого MCJIT последним запрашивал объект, и его ключ: следом
+	// за промахом тот же модуль приходит в notifyObjectCompiled
+	const llvm::Module *_pKeyModule;
+	unsigned long long _key;
+	size_t _hits;
+	size_t _misses;
+
+	unsigned long long Key(const llvm::Module *M);
+	std::string PathFor(unsigned long long key) const;
+	// Удаляет старые записи, пока каталог больше _capacity; keep не удаляется
+	void Evict(const std::string &keep) const;
+
+	JitCache(const JitCache &) = delete;
+	JitCache &operator=(const JitCache &) = delete;
+
+public:
+	// Меняется при изменении формата записи
+	static const unsigned VERSION = 1;
+
+	// capacity - предел размера каталога в байтах
+	JitCache(const std::string &dir, unsigned long long capacity, const std::string &target);
+
+	void notifyObjectCompiled(const llvm::Module *M, const llvm::MemoryBuffer *Obj) override;
+	llvm::MemoryBuffer *getObject(const llvm::Module *M) override;
+
+	size_t Hits() const { return _hits; }
+	size_t Misses() const { return _misses; }
+	// Число записей и их общий размер
+	void Usage(size_t &entries, unsigned long long &bytes) const;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "parser.h"
+#include <cstring>
+
+// Зарезервированное слово или знак операции
+struct Keyword {
+	const char *_name;
+	unsigned char _len;
+	Token _tok;
+	int _subKind; // BinaryOp::OP, Condition::OP или Var::TYPE; -1, если не нужен
+};
+
+// Размер совершенной хеш-таблицы (степень двойки)
+static const unsigned KEYWORD_TABLE_SIZE = 256;
+
+// Хеш-функция, не дающая коллизий на множестве ключевых слов и операций.
+// Коэффициенты подобраны перебором; при добавлении слова их надо подобрать заново
+// и переставить записи в таблице keywords.cpp.
+inline unsigned KeywordHash(const char *s, size_t len)
+{
+	return ((unsigned char)s[0] * 9u + (unsigned char)s[len - 1] * 10u + (unsigned)len)
+		& (KEYWORD_TABLE_SIZE - 1);
+}
+
+extern const Keyword KEYWORD_TABLE[KEYWORD_TABLE_SIZE];
+
+// Поиск лексемы за одно обращение к таблице. nullptr - обычный идентификатор.
+inline const Keyword *FindKeyword(const char *s, size_t len)
+{
+	if (len == 0)
+		return nullptr;
+	const Keyword &kw = KEYWORD_TABLE[KeywordHash(s, len)];
+	if (kw._len != len || memcmp(kw._name, s, len) != 0)
+		return nullptr;
+	return &kw;
+}
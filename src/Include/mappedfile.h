@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Файл исходного текста, отображенный в память только для чтения.
+// Если отобразить файл не удалось (канал, устройство и т.п.), IsOpen() вернет false
+// и вызывающий код должен читать исходник через std::istream.
+class MappedFile {
+	const char *_data;
+	size_t _size;
+	bool _isOpen;
+
+#ifdef _WIN32
+	void *_hFile;
+	void *_hMapping;
+#else
+	int _fd;
+#endif
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string &path);
+	void Close();
+
+	bool IsOpen() const { return _isOpen; }
+	const char *Data() const { return _data; }
+	size_t Size() const { return _size; }
+};
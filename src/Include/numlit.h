@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+// Значение числового литерала
+struct NumLiteral {
+	bool _isReal;
+	unsigned long long _integer;
+	double _real;
+};
+
+// Разбор числового литерала (цифры [. цифры] [E [+-] цифры]) за один проход, без копирования.
+// Литерал без точки и с неотрицательным порядком (или без него) - целый, иначе вещественный.
+// Вещественные значения округляются к ближайшему double по правилам IEEE (алгоритм
+// Эйзеля-Лемира, в редких неоднозначных случаях - strtod).
+// false - литерал записан неверно или целое значение не помещается в 64 бита
+bool ParseNumLiteral(const char *s, size_t len, NumLiteral &res);
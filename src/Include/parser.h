@@ -1,11 +1,13 @@
 #pragma once
 
 #include "ast.h"
+#include "symbols.h"
 #include <string>
 #include <istream>
 #include <iostream>
 #include <map>
-#include <unordered_set>
+#include <memory>
+#include <vector>
 
 
 enum Token {
@@ -59,103 +61,305 @@ enum Token {
   //)
   T_RBR,
   //nil
-  T_NIL
+  T_NIL,
+  //[
+  T_LSBR,
+  //]
+  T_RSBR,
+  //..
+  T_DOTDOT,
+  // Типизированные константы-массивы
+  T_ARRAY,
+  T_OF,
+  // Модули
+  T_UNIT,
+  T_INTERFACE,
+  T_IMPLEMENTATION,
+  T_USES,
+  // Зарезервированное слово, которое пока не поддерживается
+  T_RESERVED
 };
 
-static std::unordered_set<std::string> NAMES = {
-	"nil", "in", "if", "then", "else", "case", 
-	"of", "repeat", "until", "while", 
-	"do", "for", "to", "downto", 
-	"begin", "end", "with", "goto",
-	"const", "var", "array", "record", 
-	"set", "file", "function", "procedure", 
-	"label", "packed", "program", "true", "false"
-	
-};
-static std::unordered_set<std::string> TYPE_NAMES = {
-	"integer", "char", "boolean", "real"
-};
-static std::unordered_set<std::string> COND_NAMES = {
-	"=", "<>", ">", ">=", 
-	"<", "<=", "in"
-};
-static std::unordered_set<std::string> FACTOR_NAMES = {
-	"*", "/", "div", 
-	"mod", "and", "^"
-};
+// Ссылка на текст лексемы: смещение и длина внутри буфера исходника
+// (или внутри _stringValue при чтении из потока)
+struct StrRef {
+	const char *_data;
+	size_t _size;
 
-static std::unordered_set<std::string> TERM_NAMES = {
-	"+", "-", "or",
-};
+	StrRef() : _data(nullptr), _size(0) {}
+	StrRef(const char *data, size_t size) : _data(data), _size(size) {}
 
+	std::string str() const { return std::string(_data, _size); }
+	char operator[](size_t i) const { return _data[i]; }
+};
 
 // Лексический анализатор
+// Работает в одном из двух режимов: чтение из std::istream (каналы, stdin)
+// или разбор буфера в памяти (отображенный файл) без копирования лексем.
 class Lexer {
-  std::istream &_input;
+  std::istream *_input;
   int _lastChar;
 
+  // Режим буфера
+  const char *_buf;
+  const char *_cur;
+  const char *_end;
+  size_t _tokOffset;
+  size_t _tokLength;
+
+  // Вид операции или простого типа последней лексемы (-1, если нет)
+  int _subKind;
+  // Номер имени для T_ID
+  SymbolID _symbol;
+  SymbolTable *_pSymbols;
+
   unsigned _curLine;
 
+  Token Classify(const char *s, size_t len);
+  Token GetStreamToken();
+  Token GetBufferToken();
+
 public:
   Lexer(std::istream &input)
-	  : _input(input), _lastChar(' '), _IDName(""), _stringValue(""), _curLine(0) { }
+	  : _input(&input), _lastChar(' '), _buf(nullptr), _cur(nullptr), _end(nullptr),
+	    _tokOffset(0), _tokLength(0), _subKind(-1), _symbol(0), _pSymbols(SymbolTable::getInstance()), _curLine(0), _IDName(""), _stringValue("") { }
+
+  // pSymbols - таблица, в которую заносятся имена (по умолчанию глобальная)
+  Lexer(const char *buf, size_t size, SymbolTable *pSymbols = nullptr)
+	  : _input(nullptr), _lastChar(' '), _buf(buf), _cur(buf), _end(buf + size),
+	    _tokOffset(0), _tokLength(0), _subKind(-1), _symbol(0),
+	    _pSymbols(pSymbols != nullptr ? pSymbols : SymbolTable::getInstance()), _curLine(0), _IDName(""), _stringValue("") { }
 
   ~Lexer() {}
 
   // Получение очередной лексемы из потока
-  Token GetToken();
+  Token GetToken() { return (_input != nullptr) ? GetStreamToken() : GetBufferToken(); }
   unsigned GetLine() { return _curLine; }
 
+  // Текст последней лексемы
+  StrRef GetValue() const
+  {
+	  if (_input != nullptr)
+		  return StrRef(_stringValue.data(), _stringValue.size());
+	  return StrRef(_buf + _tokOffset, _tokLength);
+  }
+  // BinaryOp::OP для T_TERMOP/T_FACTOROP, Condition::OP для T_COND, Var::TYPE для T_VARTYPE
+  int GetSubKind() const { return _subKind; }
+  SymbolID GetSymbol() const { return _symbol; }
+
   std::string _IDName;
   std::string _stringValue;
 };
 
+// Лексема в плоском массиве, построенном предварительным разбором (tokenizer.h)
+struct TokenInfo {
+  Token _tok;
+  int _subKind;
+  SymbolID _symbol;
+  unsigned _line;
+  size_t _offset; // Текст лексемы - [_offset, _offset + _length) в буфере исходника
+  size_t _length;
+};
+
+// Источник интерфейсов модулей из uses (реализация - UnitBuilder, units.h).
+// Анализатор знает только этот интерфейс, поэтому разбор собирается без генератора кода и LLVM
+class UnitSource {
+public:
+	virtual ~UnitSource() {}
+
+	// Интерфейс модуля name; nullptr - модуль не найден или в нем ошибка
+	virtual const Root * Find(SymbolID name) = 0;
+};
+
 // Синтаксический анализатор.
 // =====================================================================
 
 class Parser {
 public:
-	std::istream &_input;
 	Lexer *_lex;
+	Arena _arena; // Владеет всеми узлами _ast
 	Root *_ast;
 	Token _currentToken;
 
+	// Режим плоского массива лексем: _lex == nullptr, лексемы берутся из _pTokens по индексу
+	const char *_buf;
+	size_t _bufSize;
+	unsigned _nThreads;
+	std::vector<TokenInfo> _tokens;
+	const TokenInfo *_pTokens; // _tokens или массив анализатора-владельца
+	size_t _nTokens;
+	size_t _pos;
+
+	// Тела подпрограмм, отложенные для параллельного разбора (только в режиме массива)
+	struct BodyJob {
+		Function *pFunc;
+		size_t begin, end; // Номера лексем begin и парного ему end
+		bool skip; // Тело не нужно (горячая перезагрузка), seq остается nullptr
+		bool failed;
+		unsigned errLine;
+		size_t errPos;
+	};
+	std::vector<BodyJob> _bodies;
+	std::vector<std::unique_ptr<Arena>> _bodyArenas; // Владеют узлами отложенных тел
+
+	// Границы подпрограмм в массиве лексем (только в режиме массива), в порядке текста:
+	// объемлющая подпрограмма всегда раньше вложенных, _routines[0] - Root
+	struct RoutineRange {
+		Function *pFunc;
+		size_t parent; // Номер объемлющей подпрограммы ((size_t)-1 у Root)
+		size_t begin, decls, body, end; // Заголовок [begin, decls), объявления [decls, body), тело [body, end)
+		size_t job; // Номер в _bodies ((size_t)-1, если тело разобрано сразу)
+	};
+	std::vector<RoutineRange> _routines;
+	size_t _curRoutine;
+
+	unsigned _errLine;
+	size_t _errPos;
+
+	// Модули (units.h): откуда брать исходники модулей из uses (nullptr - uses не поддерживается)
+	UnitSource *_pUnits;
+	bool _interfaceOnly; // Разбор модуля заканчивается на implementation
+	bool _headersOnly; // Подпрограммы без тел (интерфейс модуля)
+	// Текст интерфейса модуля - [_interfaceBegin, _interfaceEnd) в буфере исходника
+	size_t _interfaceBegin, _interfaceEnd;
+
+	// Анализатор одного тела: читает массив лексем владельца начиная с pos
+	Parser(const Parser &owner, size_t pos)
+		: _lex(nullptr), _ast(nullptr), _currentToken(owner._pTokens[pos]._tok), _buf(owner._buf), _bufSize(owner._bufSize),
+		  _nThreads(1), _pTokens(owner._pTokens), _nTokens(owner._nTokens), _pos(pos), _curRoutine(0),
+		  _errLine(0), _errPos((size_t)-1),
+		  _pUnits(nullptr), _interfaceOnly(false), _headersOnly(false), _interfaceBegin(0), _interfaceEnd(0), _isValid(true) {}
+
+	void ParseBody(Function *pFunc);
+	size_t FindBodyEnd(size_t pos) const;
+	void ParseDeferredBodies(size_t errPos);
+
 public:
-	Parser(std::istream &input) : _input(input), _isValid(true) {
-		_lex = new Lexer(_input);
+	Parser(std::istream &input) : _ast(nullptr), _buf(nullptr), _bufSize(0), _nThreads(0), _pTokens(nullptr), _nTokens(0), _pos(0),
+		_curRoutine(0), _errLine(0), _errPos((size_t)-1),
+		_pUnits(nullptr), _interfaceOnly(false), _headersOnly(false), _interfaceBegin(0), _interfaceEnd(0), _isValid(true) {
+		_lex = new Lexer(input);
 		NextToken();
   }
 
+	// Разбор исходника, целиком лежащего в памяти (например, отображенного файла)
+	Parser(const char *buf, size_t size) : _ast(nullptr), _buf(buf), _bufSize(size), _nThreads(0), _pTokens(nullptr), _nTokens(0), _pos(0),
+		_curRoutine(0), _errLine(0), _errPos((size_t)-1),
+		_pUnits(nullptr), _interfaceOnly(false), _headersOnly(false), _interfaceBegin(0), _interfaceEnd(0), _isValid(true) {
+		_lex = new Lexer(buf, size);
+		NextToken();
+	}
+
+	// Анализатор без исходника: дерево в _arena строит загрузчик кэша (astcache.h)
+	Parser() : _lex(nullptr), _ast(nullptr), _currentToken(T_EOF), _buf(nullptr), _bufSize(0), _nThreads(0),
+		_pTokens(nullptr), _nTokens(0), _pos(0), _curRoutine(0), _errLine(0), _errPos((size_t)-1),
+		  _pUnits(nullptr), _interfaceOnly(false), _headersOnly(false), _interfaceBegin(0), _interfaceEnd(0), _isValid(true) {}
+
+	// Исходник в памяти предварительно разбивается на лексемы в nThreads потоков
+	// (0 - по числу ядер); разбор идет уже по готовому массиву, а тела подпрограмм
+	// разбираются параллельно в тех же nThreads потоках
+	Parser(const char *buf, size_t size, unsigned nThreads)
+		: _lex(nullptr), _ast(nullptr), _currentToken(T_EOF), _buf(buf), _bufSize(size), _nThreads(nThreads),
+		  _pTokens(nullptr), _nTokens(0), _pos(0), _curRoutine(0), _errLine(0), _errPos((size_t)-1),
+		  _pUnits(nullptr), _interfaceOnly(false), _headersOnly(false), _interfaceBegin(0), _interfaceEnd(0), _isValid(true) {}
+
 	~Parser() 
 	{ 
 		delete _lex; 
-		delete _ast;
+		// Дерево целиком освобождается вместе с _arena
 	}
 
 	void Parse();
+	// Parse() по частям: сначала заголовки и объявления (тела в режиме массива только
+	// откладываются), затем отложенные тела и сообщение об ошибке.
+	// Между ними можно пометить ненужные тела в _bodies (BodyJob::skip)
+	void ParseHeaders();
+	void ParseBodies();
+
+	// Статистика арены дерева и арен параллельно разобранных тел
+	void PrintArenaStats(std::ostream &os) const;
 
 	std::string GetCurrentValue()
 	{
-		std::string res = _lex->_stringValue;
+		std::string res = GetValue().str();
+		NextToken();
+		return res;
+	}
+
+	SymbolID GetCurrentSymbol()
+	{
+		SymbolID res = (_lex != nullptr) ? _lex->GetSymbol() : _pTokens[_pos]._symbol;
+		NextToken();
+		return res;
+	}
+
+	int GetCurrentSubKind()
+	{
+		int res = (_lex != nullptr) ? _lex->GetSubKind() : _pTokens[_pos]._subKind;
 		NextToken();
 		return res;
 	}
 
 	void ParseDeclarations(Function *func);
+	void ParseUnit();
+	void ParseUses();
+	void ImportUnit(SymbolID name);
+	bool ImplementHeader(Function *pFunc);
 	Statement * ParseStatement();
 	StatementSeq * ParseStmntSeq();
-	Const * ParseConst();
+	Const * ParseConst(Function *func);
+	Const * ParseNumber(bool neg = false);
+	long long ParseBound();
+	unsigned long long ParseTableValue(Var::TYPE type);
+	ConstArray * ParseConstArray();
 	Function * ParseFunction(Function *par, bool isFunc);
 	ParamList * ParseParamList();
 	Expression * ParseExpression();
-	Expression * ParseSimpleExpression();
-	Expression * ParseTerm();
-	Expression * ParseFactor();
 
 	bool _isValid;
 	bool IsSuccess() const { return _isValid; }
 
-	void NextToken() { _currentToken = _lex->GetToken(); }
+	void NextToken()
+	{
+		if (_lex != nullptr)
+			_currentToken = _lex->GetToken();
+		else
+		{
+			// Последняя лексема массива - T_EOF, дальше не двигаемся
+			if (_pos + 1 < _nTokens)
+				_pos++;
+			_currentToken = _pTokens[_pos]._tok;
+		}
+	}
+
+	// Смещение текущей лексемы в буфере исходника (не в режиме чтения из потока)
+	size_t GetOffset() const
+	{
+		if (_lex != nullptr)
+			return _lex->GetValue()._data - _buf;
+		return _pTokens[_pos]._offset;
+	}
+
+	// Лексема на n позиций впереди текущей (только в режиме массива)
+	const TokenInfo &Peek(size_t n) const
+	{
+		size_t i = _pos + n;
+		return _pTokens[i < _nTokens ? i : _nTokens - 1];
+	}
+
+	StrRef GetValue() const
+	{
+		if (_lex != nullptr)
+			return _lex->GetValue();
+		return StrRef(_buf + _pTokens[_pos]._offset, _pTokens[_pos]._length);
+	}
+
+	unsigned GetLine() const
+	{
+		if (_lex != nullptr)
+			return _lex->GetLine();
+		return _nTokens == 0 ? 0 : _pTokens[_pos]._line;
+	}
 
 	bool Is(const Token& tok)//Проверка, равен ли текущий токен tok
 	{
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+
+#include "ast.h"
+#include "visitor.h"
+
+// Разрешение имен: отдельный проход между разбором и генерацией кода.
+// Каждое имя в выражениях и операторах один раз ищется по цепочке областей видимости
+// и связывается с объявлением (поля _pNode и _pFunc узлов), так что вычисление типов,
+// генерация кода и построение плоского дерева больше не ищут имена.
+// При неизвестном имени или имени не того вида бросает исключение.
+class NameResolver : public AstWalker<NameResolver> {
+	friend class AstVisitor<NameResolver>;
+	friend class AstWalker<NameResolver>;
+
+	Scope *_pScope; // Область видимости текущей функции
+	size_t _lookups; // Поисков имен за последний Resolve
+
+	void EnterFunction(Function *pFunc) { _pScope = &pFunc->scp; }
+
+	void VisitFor(ForStatement *pEl);
+	void VisitAssign(AssignStatement *pEl);
+	void VisitProcCall(ProcCallStatement *pEl);
+	void VisitID(ExprID *pEl);
+	void VisitIndex(ExprIndex *pEl);
+	void VisitCall(FuncCallExpr *pEl);
+
+	Var * FindVar(SymbolID name);
+	// Переменная, которой присваивается значение: константы не подходят
+	Var * FindTarget(SymbolID name);
+	Function * FindFunction(SymbolID name, size_t nArgs);
+
+public:
+	NameResolver() : _pScope(nullptr), _lookups(0) {}
+
+	// Тела, не разобранные при перезагрузке (hotreload.h), пропускаются
+	void Resolve(Root *pRoot);
+	// Одно выражение в области видимости pScope: значение объявления const при разборе
+	void ResolveExpression(Scope *pScope, Expression *pExpr);
+
+	size_t Lookups() const { return _lookups; }
+};
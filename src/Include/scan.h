@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+// Ядра поиска конца серии символов для лексического анализатора в режиме буфера.
+// Реализация (AVX2, SSE2 или скалярная) выбирается один раз при запуске по возможностям процессора.
+// Все функции возвращают указатель на первый символ, не входящий в серию, или end.
+struct ScanKernels {
+	// Пробелы, табуляции и переводы строк; lines увеличивается на число '\n' и '\r' в серии
+	const char *(*SkipSpaces)(const char *p, const char *end, unsigned &lines);
+	// Латинские буквы и цифры
+	const char *(*SkipAlnum)(const char *p, const char *end);
+	// Десятичные цифры
+	const char *(*SkipDigits)(const char *p, const char *end);
+
+	const char *name;
+};
+
+extern const ScanKernels g_Scan;
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Номер имени в глобальной таблице имен
+typedef unsigned SymbolID;
+
+// Таблица интернированных имен.
+// Каждое различное имя получает 32-битный номер один раз, при лексическом анализе;
+// дальше AST и области видимости сравнивают и хешируют только номера.
+class SymbolTable {
+	static SymbolTable *m_pInst;
+
+	std::deque<std::string> _names; // Имена по номерам (deque не перемещает строки)
+	std::vector<unsigned> _hashes; // Хеши имен по номерам
+	std::vector<SymbolID> _slots; // Открытая адресация: номер + 1, 0 - свободно
+
+	static unsigned Hash(const char *s, size_t len);
+	void Grow();
+
+public:
+	// Отдельные таблицы используются потоками предварительного разбора,
+	// после чего их имена переносятся в глобальную (getInstance)
+	SymbolTable();
+
+	static SymbolTable * getInstance();
+
+	SymbolID Intern(const char *s, size_t len);
+	SymbolID Intern(const std::string &s) { return Intern(s.data(), s.size()); }
+
+	const std::string &Name(SymbolID id) const { return _names[id]; }
+	size_t Size() const { return _names.size(); }
+};
+
+inline SymbolID Intern(const std::string &s)
+{
+	return SymbolTable::getInstance()->Intern(s);
+}
+
+inline const std::string &SymName(SymbolID id)
+{
+	return SymbolTable::getInstance()->Name(id);
+}
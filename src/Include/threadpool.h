@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Простой пул потоков с общей очередью задач
+class ThreadPool {
+	std::vector<std::thread> _workers;
+	std::deque<std::function<void()>> _tasks;
+	std::mutex _mutex;
+	std::condition_variable _hasTask;
+	std::condition_variable _allDone;
+	unsigned _active;
+	bool _stop;
+
+	void WorkerLoop();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+public:
+	// 0 - по числу аппаратных потоков
+	explicit ThreadPool(unsigned nThreads = 0);
+	~ThreadPool();
+
+	unsigned Size() const { return (unsigned)_workers.size(); }
+
+	void Run(const std::function<void()> &task);
+	// Ожидание завершения всех поставленных задач
+	void Wait();
+
+	// Выполнить fn(i) для i из [0, n) и дождаться завершения
+	void ParallelFor(size_t n, const std::function<void(size_t)> &fn);
+
+	static unsigned HardwareThreads();
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "bytecode.h"
+#include "codegen.h"
+#include "threadpool.h"
+#include "vm.h"
+
+// Многоуровневое выполнение (--tiered): программа начинает работу в интерпретаторе
+// байткода, а функции, которые VM отмечает горячими, по одной компилируются JIT
+// в фоновом потоке и подставляются в ее таблицу переходов.
+// Машинный код работает с той же памятью: глобальные переменные модуля LLVM объявлены
+// внешними и отображены на ячейки Root. Замены кадра на ходу нет, поэтому уже начатые
+// вызовы и тело Root дорабатывают в интерпретаторе.
+// LLVM запускается только при первой горячей функции и только в фоновом потоке
+class TieredRunner {
+	Parser *_pParser;
+	const Bytecode &_code;
+	VirtualMachine &_vm;
+	CodeGenerator *_pGen;
+	ThreadPool _compiler; // Один поток: к LLVM обращается только он
+	std::atomic<bool> _stop;
+
+	// Пишет фоновый поток, читать после Stop
+	bool _failed;
+	std::string _error;
+	size_t _compiled;
+	double _compileTime;
+
+	void Compile(int func);
+
+	TieredRunner(const TieredRunner &) = delete;
+	TieredRunner &operator=(const TieredRunner &) = delete;
+
+public:
+	// Функции, набравшие threshold вызовов и итераций циклов, отдаются компилятору
+	TieredRunner(Parser *pP, const Bytecode &code, VirtualMachine &vm, unsigned threshold);
+	~TieredRunner();
+
+	// После выполнения программы: начатая компиляция дожидается, очередь отбрасывается
+	void Stop();
+
+	size_t Compiled() const { return _compiled; }
+	double CompileTime() const { return _compileTime; }
+	// Ошибка генерации, после которой горячие функции остаются в интерпретаторе
+	const std::string &Error() const { return _error; }
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "parser.h"
+
+#include <vector>
+
+// Параллельный предварительный разбор исходника в плоский массив лексем.
+// Буфер режется на куски по пробельным символам вне строковых литералов,
+// куски разбираются независимо в пуле потоков и склеиваются с пересчетом
+// смещений, номеров строк и номеров имен. Последняя лексема массива - T_EOF.
+// При лексической ошибке возвращает false и номер строки в errLine.
+bool PreTokenize(const char *buf, size_t size, unsigned nThreads,
+	std::vector<TokenInfo> &tokens, unsigned &errLine);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mappedfile.h"
+#include "parser.h"
+
+// Модули (unit ... interface ... implementation ... end) и их раздельная компиляция.
+// Модуль name лежит в файле name.pas рядом с программой. Каждый модуль компилируется
+// в свой модуль LLVM, который записывается биткодом в каталог сборки и подключается
+// к программе при компоновке (CodeGenerator::LinkUnit). Программа и другие модули
+// читают из модуля только интерфейс: его объявления копируются в их деревья, а код
+// остается в модуле. Поэтому пересобираемые модули друг от друга не зависят
+// и компилируются параллельно, а граф uses нужен, чтобы найти циклы и решить,
+// что пересобирать: модуль пересобирается, если изменился его исходник или интерфейс
+// одного из модулей, которые он использует. Правка внутри implementation
+// пересобирает только сам модуль.
+class UnitBuilder : public UnitSource {
+	struct Unit {
+		SymbolID _name;
+		std::string _path;
+		MappedFile _file;
+		std::unique_ptr<Parser> _pIface; // Заголовок и интерфейс, разобранные один раз для всех uses
+		bool _loading; // Интерфейс еще разбирается: uses этого модуля - цикл
+		unsigned long long _ifaceHash; // Текст интерфейса и интерфейсы модулей из его uses
+		unsigned long long _key; // Ключ сборки: версия, исходник и интерфейсы модулей из uses
+		std::unique_ptr<Parser> _pParser; // Полный разбор пересобираемого модуля
+		std::string _error;
+	};
+
+	std::string _srcDir; // Каталог исходников модулей (с разделителем в конце или пустой)
+	std::string _outDir;
+	unsigned _nThreads;
+	std::unordered_map<SymbolID, std::unique_ptr<Unit>> _units;
+	std::vector<Unit *> _order; // Используемые модули раньше использующих
+	std::string _error;
+	size_t _compiled;
+	double _buildTime;
+
+	void Fail(const std::string &error);
+	std::string BitcodePath(const Unit *pUnit) const;
+	std::string StampPath(const Unit *pUnit) const;
+	bool IsUpToDate(const Unit *pUnit) const;
+	void Compile(Unit *pUnit);
+
+	UnitBuilder(const UnitBuilder &) = delete;
+	UnitBuilder &operator=(const UnitBuilder &) = delete;
+
+public:
+	// Меняется при любом изменении кода, который генерируется для модуля
+	static const unsigned VERSION = 1;
+
+	// nThreads - потоки компиляции модулей (0 - по числу ядер)
+	UnitBuilder(const std::string &srcDir, const std::string &outDir, unsigned nThreads)
+		: _srcDir(srcDir), _outDir(outDir), _nThreads(nThreads), _compiled(0), _buildTime(0.0) {}
+
+	// Интерфейс модуля для uses (Root модуля, Interface); nullptr - модуль не найден,
+	// в нем ошибка или модули используют друг друга по кругу (Error())
+	const Root * Find(SymbolID name) override;
+
+	// Компиляция модулей, изменившихся с прошлой сборки; false - ошибка (Error())
+	bool Build();
+
+	// Файлы биткода всех модулей программы для LinkUnit
+	std::vector<std::string> Objects() const;
+
+	size_t Count() const { return _order.size(); }
+	size_t Compiled() const { return _compiled; }
+	double BuildTime() const { return _buildTime; }
+	const std::string &Error() const { return _error; }
+};
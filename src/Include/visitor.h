@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "ast.h"
+
+// Адрес операнда pEl с номером i в порядке вычисления, nullptr - операнды кончились.
+// Через адрес обходчик может заменить операнд (ConstFolder)
+inline Expression ** OperandSlot(Expression *pEl, unsigned i) {
+	switch (pEl->_type) {
+	case Expression::E_BINARY:
+	{
+		BinaryOp *pOp = static_cast<BinaryOp *>(pEl);
+		return i == 0 ? &pOp->_left : i == 1 ? &pOp->_right : nullptr;
+	}
+	case Expression::E_COND:
+	{
+		Condition *pCond = static_cast<Condition *>(pEl);
+		return i == 0 ? &pCond->_left : i == 1 ? &pCond->_right : nullptr;
+	}
+	case Expression::E_INDEX:
+		return i == 0 ? &static_cast<ExprIndex *>(pEl)->_index : nullptr;
+	case Expression::E_FUNCCALL:
+	{
+		auto &params = static_cast<FuncCallExpr *>(pEl)->_params;
+		return i < params.size() ? &params[i] : nullptr;
+	}
+	default:
+		return nullptr;
+	}
+}
+
+// Операнд pEl с номером i, nullptr - операнды кончились
+inline Expression * Operand(Expression *pEl, unsigned i) {
+	Expression **ppOp = OperandSlot(pEl, i);
+	return ppOp != nullptr ? *ppOp : nullptr;
+}
+
+// Статическая диспетчеризация по узлам дерева разбора (CRTP).
+// Обработчик выбирается по тегу _type узла и static_cast, без виртуальных вызовов и RTTI.
+// Derived задает только нужные обработчики VisitXxx; остальные сводятся к VisitStatement
+// и VisitExpression, которые по умолчанию возвращают R().
+// Если обработчики Derived закрытые, AstVisitor должен быть его другом.
+template<class Derived, class R = void>
+class AstVisitor {
+protected:
+	Derived &Self() { return static_cast<Derived &>(*this); }
+
+public:
+	R DispatchStatement(Statement *pStmt) {
+		switch (pStmt->_type) {
+		case Statement::S_SEQ:
+			return Self().VisitSeq(static_cast<StatementSeq *>(pStmt));
+		case Statement::S_IF:
+			return Self().VisitIf(static_cast<IfStatement *>(pStmt));
+		case Statement::S_FOR:
+			return Self().VisitFor(static_cast<ForStatement *>(pStmt));
+		case Statement::S_WHILE:
+			return Self().VisitWhile(static_cast<WhileStatement *>(pStmt));
+		case Statement::S_ASSIGN:
+			return Self().VisitAssign(static_cast<AssignStatement *>(pStmt));
+		case Statement::S_PROCCALL:
+			return Self().VisitProcCall(static_cast<ProcCallStatement *>(pStmt));
+		case Statement::S_REPEAT:
+			return Self().VisitRepeat(static_cast<RepeatStatement *>(pStmt));
+		case Statement::S_EMPTY:
+			return Self().VisitEmpty(pStmt);
+		default:
+			throw std::exception("undefined statement type");
+		}
+	}
+
+	R DispatchExpression(Expression *pExpr) {
+		switch (pExpr->_type) {
+		case Expression::E_BINARY:
+			return Self().VisitBinary(static_cast<BinaryOp *>(pExpr));
+		case Expression::E_COND:
+			return Self().VisitCondition(static_cast<Condition *>(pExpr));
+		case Expression::E_CONST:
+			return Self().VisitConst(static_cast<ExprConst *>(pExpr));
+		case Expression::E_ID:
+			return Self().VisitID(static_cast<ExprID *>(pExpr));
+		case Expression::E_FUNCCALL:
+			return Self().VisitCall(static_cast<FuncCallExpr *>(pExpr));
+		case Expression::E_INDEX:
+			return Self().VisitIndex(static_cast<ExprIndex *>(pExpr));
+		default:
+			throw std::exception("undefined expression type");
+		}
+	}
+
+	R VisitStatement(Statement *) { return R(); }
+	R VisitSeq(StatementSeq *pEl) { return Self().VisitStatement(pEl); }
+	R VisitIf(IfStatement *pEl) { return Self().VisitStatement(pEl); }
+	R VisitFor(ForStatement *pEl) { return Self().VisitStatement(pEl); }
+	R VisitWhile(WhileStatement *pEl) { return Self().VisitStatement(pEl); }
+	R VisitAssign(AssignStatement *pEl) { return Self().VisitStatement(pEl); }
+	R VisitProcCall(ProcCallStatement *pEl) { return Self().VisitStatement(pEl); }
+	R VisitRepeat(RepeatStatement *pEl) { return Self().VisitStatement(pEl); }
+	R VisitEmpty(Statement *pEl) { return Self().VisitStatement(pEl); }
+
+	R VisitExpression(Expression *) { return R(); }
+	R VisitBinary(BinaryOp *pEl) { return Self().VisitExpression(pEl); }
+	R VisitCondition(Condition *pEl) { return Self().VisitExpression(pEl); }
+	R VisitConst(ExprConst *pEl) { return Self().VisitExpression(pEl); }
+	R VisitID(ExprID *pEl) { return Self().VisitExpression(pEl); }
+	R VisitCall(FuncCallExpr *pEl) { return Self().VisitExpression(pEl); }
+	R VisitIndex(ExprIndex *pEl) { return Self().VisitExpression(pEl); }
+};
+
+// Обход всей программы: функции (объемлющие раньше вложенных), операторы и выражения
+// в порядке исходного текста. Обработчик узла вызывается до обхода его детей,
+// EnterFunction - перед телом функции. Тела, которых нет (hotreload.h), пропускаются.
+// Выражения обходятся по явному стеку, так что их глубина не ограничена стеком вызовов.
+template<class Derived>
+class AstWalker : public AstVisitor<Derived, void> {
+	std::vector<Expression *> _stack; // Непросмотренные узлы выражения
+
+public:
+	void EnterFunction(Function *) {}
+
+	void Walk(Function *pFunc) {
+		this->Self().EnterFunction(pFunc);
+		if (pFunc->seq != nullptr)
+			WalkStatement(pFunc->seq);
+
+		for (auto &i : pFunc->Funcs)
+			Walk(i.second);
+	}
+
+	void WalkStatement(Statement *pStmt) {
+		this->DispatchStatement(pStmt);
+
+		switch (pStmt->_type) {
+		case Statement::S_SEQ:
+			for (auto &i : static_cast<StatementSeq *>(pStmt)->statements)
+				WalkStatement(i);
+			break;
+		case Statement::S_IF:
+		{
+			IfStatement *pIf = static_cast<IfStatement *>(pStmt);
+			WalkExpression(pIf->_cond);
+			WalkStatement(pIf->_then);
+			if (pIf->_else != nullptr)
+				WalkStatement(pIf->_else);
+			break;
+		}
+		case Statement::S_WHILE:
+		{
+			WhileStatement *pWhile = static_cast<WhileStatement *>(pStmt);
+			WalkExpression(pWhile->_condition);
+			WalkStatement(pWhile->_st);
+			break;
+		}
+		case Statement::S_REPEAT:
+		{
+			RepeatStatement *pRepeat = static_cast<RepeatStatement *>(pStmt);
+			WalkStatement(pRepeat->_st);
+			WalkExpression(pRepeat->_condition);
+			break;
+		}
+		case Statement::S_FOR:
+		{
+			ForStatement *pFor = static_cast<ForStatement *>(pStmt);
+			WalkExpression(pFor->_from);
+			WalkExpression(pFor->_to);
+			WalkStatement(pFor->_do);
+			break;
+		}
+		case Statement::S_ASSIGN:
+			WalkExpression(static_cast<AssignStatement *>(pStmt)->_expr);
+			break;
+		case Statement::S_PROCCALL:
+			for (auto &i : static_cast<ProcCallStatement *>(pStmt)->_params)
+				WalkExpression(i);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void WalkExpression(Expression *pRoot) {
+		// Обработчик может сам обходить выражения, поэтому стек начинается с текущей вершины
+		size_t base = _stack.size();
+		_stack.push_back(pRoot);
+
+		while (_stack.size() > base) {
+			Expression *pEl = _stack.back();
+			_stack.pop_back();
+			this->DispatchExpression(pEl);
+
+			// Дети кладутся в обратном порядке, чтобы левый был обработан первым
+			size_t first = _stack.size();
+			for (unsigned i = 0; Expression *pOp = Operand(pEl, i); ++i)
+				_stack.push_back(pOp);
+			std::reverse(_stack.begin() + first, _stack.end());
+		}
+	}
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "bytecode.h"
+
+// Интерпретатор байткода (bytecode.h). Память - один массив ячеек: глобальные
+// переменные (кадр Root), над ними кадры вызовов. Команды выбираются переходом
+// по таблице адресов меток (computed goto) в конце каждого обработчика; компилятор
+// без этого расширения (MSVC) получает обычный switch в цикле.
+// Ошибки времени выполнения, которые в машинном коде не проверяются или роняют
+// процесс (деление на ноль, индекс за границами таблицы, переполнение стека),
+// здесь - исключения
+
+// Машинный код подпрограммы (tiering.h): аргументы лежат в ячейках args, как их кладет
+// CALL, адреса var-параметров - номера ячеек от mem; результат записывается в res
+typedef void (*NativeFunc)(Slot *mem, Slot *args, Slot *res);
+
+class VirtualMachine {
+	struct CallInfo {
+		const Instr *ret; // Команда после CALL
+		Slot *regs; // Кадр вызывающей функции
+		int dst; // Регистр результата в нем
+		int func; // Вызывающая функция
+	};
+
+	std::unique_ptr<Slot[]> _mem;
+	size_t _size; // Ячеек памяти
+	std::vector<CallInfo> _calls;
+
+	// Многоуровневое выполнение: вызовы и итерации циклов каждой функции считаются,
+	// и на threshold-м событии функция передается onHot. Подставленный машинный код
+	// вызывается вместо интерпретации
+	std::function<void(int)> _onHot;
+	unsigned _threshold;
+	std::vector<unsigned> _counts;
+	std::unique_ptr<std::atomic<NativeFunc>[]> _native;
+	// Глобальные ячейки целых, символов и логических значений: машинный код пишет
+	// в них только младшие байты
+	std::vector<std::pair<int, Var::TYPE>> _narrow;
+
+	void WidenGlobals();
+
+	VirtualMachine(const VirtualMachine &) = delete;
+	VirtualMachine &operator=(const VirtualMachine &) = delete;
+
+public:
+	static const size_t DEFAULT_SIZE = 1 << 20; // 8 Мб, как стек потока
+
+	explicit VirtualMachine(size_t size = DEFAULT_SIZE)
+		: _mem(new Slot[size]), _size(size), _threshold(0) {}
+
+	// До Run: onHot вызывается в потоке Run по одному разу для каждой функции,
+	// набравшей threshold вызовов и итераций циклов (0 - счетчики выключены)
+	void SetHotHandler(unsigned threshold, const std::function<void(int)> &onHot);
+	// Подстановка машинного кода функции: из любого потока, пока жива VM.
+	// Уже начатые вызовы доработают в интерпретаторе
+	void Install(int func, NativeFunc code);
+
+	// Глобальная ячейка index лежит по адресу Memory() + index
+	Slot *Memory() { return _mem.get(); }
+
+	// Выполняет программу и возвращает результат Root
+	int Run(const Bytecode &code);
+};
@@ -0,0 +1,52 @@
+#include "aot.h"
+#include "codegen.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#ifdef _WIN32
+const char *const OBJECT_EXT = ".obj";
+#else
+const char *const OBJECT_EXT = ".o";
+#endif
+
+bool LinkExecutable(const std::string &object, const std::string &exe, std::string &error)
+{
+	// Среда выполнения пишется рядом с исполняемым файлом и удаляется после компоновки
+	std::string runtime = exe + ".rt.c";
+	{
+		std::ofstream out(runtime);
+		out << "#include <stdio.h>\n"
+		       "int " << CodeGenerator::AOT_ENTRY << "(void);\n"
+		       "int main(void)\n"
+		       "{\n"
+		       "\tint res = " << CodeGenerator::AOT_ENTRY << "();\n"
+		       "\tprintf(\"\\nResult: %d\\n\", res);\n"
+		       "\treturn 0;\n"
+		       "}\n";
+		if (!out) {
+			error = "cannot write " + runtime;
+			return false;
+		}
+	}
+
+	const char *cc = getenv("PASCAL_CC");
+#ifdef _WIN32
+	std::string command = std::string(cc != nullptr ? cc : "cl") + " /nologo /O2 /Fe\"" + exe + "\" /Fo\""
+		+ exe + ".rt" + OBJECT_EXT + "\" \"" + runtime + "\" \"" + object + "\"";
+#else
+	std::string command = std::string(cc != nullptr ? cc : "cc") + " -O2 -o \"" + exe + "\" \""
+		+ runtime + "\" \"" + object + "\"";
+#endif
+	int res = system(command.c_str());
+	remove(runtime.c_str());
+#ifdef _WIN32
+	remove((exe + ".rt" + OBJECT_EXT).c_str());
+#endif
+	if (res != 0) {
+		error = "linking failed: " + command;
+		return false;
+	}
+	return true;
+}
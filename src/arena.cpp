@@ -0,0 +1,51 @@
+#include "arena.h"
+
+#include <cstdlib>
+
+ARENA_THREAD_LOCAL Arena *Arena::s_pCurrent = nullptr;
+
+Arena::Arena() : _cur(nullptr), _end(nullptr), _bytesUsed(0), _bytesReserved(0), _objects(0) {}
+
+Arena::~Arena()
+{
+	Reset();
+}
+
+char *Arena::AllocateSlow(size_t size, size_t align)
+{
+	// Крупные объекты получают собственный блок
+	size_t blockSize = size + align > BLOCK_SIZE ? size + align : BLOCK_SIZE;
+
+	char *pBlock = (char *)malloc(blockSize);
+	if (pBlock == nullptr)
+		throw std::bad_alloc();
+
+	_blocks.push_back(pBlock);
+	_bytesReserved += blockSize;
+	_cur = pBlock;
+	_end = pBlock + blockSize;
+
+	return (char *)(((size_t)_cur + align - 1) & ~(align - 1));
+}
+
+void Arena::Reset()
+{
+	// В обратном порядке создания, как у обычных объектов
+	for (auto it = _cleanups.rbegin(); it != _cleanups.rend(); ++it)
+		it->pDtor(it->pObj);
+	_cleanups.clear();
+
+	for (auto &i : _blocks)
+		free(i);
+	_blocks.clear();
+
+	_cur = _end = nullptr;
+	_bytesUsed = _bytesReserved = _objects = 0;
+}
+
+void Arena::PrintStats(std::ostream &os) const
+{
+	os << "Arena: " << _objects << " objects (" << _cleanups.size() << " with destructors), "
+	   << _bytesUsed << " bytes used, " << _bytesReserved << " bytes in "
+	   << _blocks.size() << " blocks" << std::endl;
+}
@@ -0,0 +1,17 @@
+#include "ast.h"
+
+ARENA_THREAD_LOCAL size_t Scope::s_lookups = 0;
+ARENA_THREAD_LOCAL size_t Scope::s_probes = 0;
+
+// Порядок совпадает с TypeTable::Get: тип, затем константа, затем ссылка
+#define TYPE_ROW(t) Var(t, false, false), Var(t, false, true), Var(t, true, false), Var(t, true, true)
+
+const Var TypeTable::s_types[(Var::VOID + 1) * 4] = {
+	TYPE_ROW(Var::REAL),
+	TYPE_ROW(Var::INTEGER),
+	TYPE_ROW(Var::CHAR),
+	TYPE_ROW(Var::BOOLEAN),
+	TYPE_ROW(Var::VOID)
+};
+
+#undef TYPE_ROW
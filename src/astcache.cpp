@@ -0,0 +1,761 @@
+#include "astcache.h"
+#include "mappedfile.h"
+#include "visitor.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[8] = { 'P', 'A', 'S', 'A', 'S', 'T', '\r', '\n' };
+
+// Сигнатура, версия, резерв, размер и хеш исходника, размер и хеш данных
+const size_t HEADER_SIZE = 8 + 4 + 4 + 8 + 8 + 8 + 8;
+
+// Вид объявления или значения константы
+enum DeclKind { D_VAR, D_INTEGER, D_REAL, D_BOOLEAN, D_ARRAY };
+
+// Флаги подпрограммы
+enum FuncFlags {
+	F_PARAMS = 1, // Есть список параметров (нет только у Root)
+	F_BODY = 2,   // Тело разобрано
+	F_NAMED = 4   // Имя подпрограммы в ее области видимости - возвращаемое значение
+};
+
+// Выражение - узлы в обратном обходе до EXPR_END; старший бит вида - унарный минус
+const unsigned char EXPR_END = 0x7F;
+const unsigned char EXPR_NEG = 0x80;
+
+void PutFixed(string &out, unsigned long long v, int bytes)
+{
+	for (int i = 0; i < bytes; ++i)
+		out.push_back((char)(v >> (8 * i)));
+}
+
+unsigned long long GetFixed(const char *p, int bytes)
+{
+	unsigned long long v = 0;
+	for (int i = 0; i < bytes; ++i)
+		v |= (unsigned long long)(unsigned char)p[i] << (8 * i);
+	return v;
+}
+
+// Хеш по 8 байт за шаг: исходник и запись хешируются при каждой загрузке,
+// и побайтовый FNV-1a (hotreload.cpp) занимал заметную ее часть
+unsigned long long HashBytes(const char *p, size_t size)
+{
+	const unsigned long long K = 0x9E3779B97F4A7C15ULL;
+	unsigned long long h = size * K;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		unsigned long long w;
+		memcpy(&w, p + i, sizeof(w));
+		h = (h ^ w) * K;
+		h ^= h >> 32;
+	}
+	if (i < size)
+		h = (h ^ GetFixed(p + i, (int)(size - i))) * K;
+	h ^= h >> 29;
+	h *= K;
+	return h ^ (h >> 32);
+}
+
+struct Writer {
+	string _out;
+	unordered_map<SymbolID, unsigned> _names; // Номера имен в записи
+	vector<SymbolID> _order; // Имена по номерам
+	vector<pair<Expression *, unsigned>> _stack;
+
+	void Byte(unsigned v) { _out.push_back((char)v); }
+
+	void Uint(unsigned long long v) {
+		while (v >= 0x80) {
+			_out.push_back((char)(v | 0x80));
+			v >>= 7;
+		}
+		_out.push_back((char)v);
+	}
+
+	void Int(long long v) { Uint(((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63)); }
+
+	void Real(double d) {
+		unsigned long long bits;
+		memcpy(&bits, &d, sizeof(bits));
+		PutFixed(_out, bits, 8);
+	}
+
+	void Name(SymbolID id) {
+		auto it = _names.find(id);
+		if (it == _names.end()) {
+			it = _names.insert(make_pair(id, (unsigned)_order.size())).first;
+			_order.push_back(id);
+		}
+		Uint(it->second);
+	}
+
+	void WriteConst(const Const *pC);
+	void WriteDecl(const Var *pVar);
+	void WriteExpression(Expression *pRoot);
+	void WriteSeq(const StatementSeq *pSeq);
+	void WriteStatement(const Statement *pStmt);
+	void WriteFunction(const Function *pFunc);
+};
+
+void Writer::WriteConst(const Const *pC)
+{
+	if (const ConstArray *pArr = NodeCast<ConstArray>(pC)) {
+		Byte(D_ARRAY);
+		Byte(pArr->_type);
+		Int(pArr->_low);
+		Uint(pArr->_vals.size());
+		for (auto v : pArr->_vals)
+			Uint(v);
+		return;
+	}
+
+	switch (pC->_type) {
+	case Var::INTEGER:
+		Byte(D_INTEGER);
+		Uint(static_cast<const ConstInteger *>(pC)->_val);
+		break;
+	case Var::REAL:
+		Byte(D_REAL);
+		Real(static_cast<const ConstReal *>(pC)->_val);
+		break;
+	case Var::BOOLEAN:
+		Byte(D_BOOLEAN);
+		Byte(static_cast<const ConstBoolean *>(pC)->_val ? 1 : 0);
+		break;
+	default:
+		throw exception("unsupported constant");
+	}
+}
+
+void Writer::WriteDecl(const Var *pVar)
+{
+	if (pVar->isConst)
+		WriteConst(static_cast<const Const *>(pVar));
+	else {
+		Byte(D_VAR);
+		Byte(pVar->_type);
+	}
+}
+
+void Writer::WriteExpression(Expression *pRoot)
+{
+	// Обратный обход по явному стеку: узел пишется после всех своих операндов
+	_stack.push_back(make_pair(pRoot, 0u));
+	while (!_stack.empty()) {
+		auto &top = _stack.back();
+		Expression *pNext = Operand(top.first, top.second);
+		if (pNext != nullptr) {
+			top.second++;
+			_stack.push_back(make_pair(pNext, 0u));
+			continue;
+		}
+
+		Expression *pEl = top.first;
+		_stack.pop_back();
+		Byte(pEl->_type | (pEl->isNeg ? EXPR_NEG : 0));
+		switch (pEl->_type) {
+		case Expression::E_CONST:
+			WriteConst(static_cast<ExprConst *>(pEl)->_val);
+			break;
+		case Expression::E_ID:
+			Name(static_cast<ExprID *>(pEl)->id);
+			break;
+		case Expression::E_BINARY:
+			Byte(static_cast<BinaryOp *>(pEl)->_op);
+			break;
+		case Expression::E_COND:
+			Byte(static_cast<Condition *>(pEl)->_op);
+			break;
+		case Expression::E_INDEX:
+			Name(static_cast<ExprIndex *>(pEl)->_id);
+			break;
+		case Expression::E_FUNCCALL:
+			Name(static_cast<FuncCallExpr *>(pEl)->_name);
+			Uint(static_cast<FuncCallExpr *>(pEl)->_params.size());
+			break;
+		}
+	}
+	Byte(EXPR_END);
+}
+
+void Writer::WriteSeq(const StatementSeq *pSeq)
+{
+	Uint(pSeq->statements.size());
+	for (auto i : pSeq->statements)
+		WriteStatement(i);
+}
+
+void Writer::WriteStatement(const Statement *pStmt)
+{
+	Byte(pStmt->_type);
+	switch (pStmt->_type) {
+	case Statement::S_SEQ:
+		WriteSeq(static_cast<const StatementSeq *>(pStmt));
+		break;
+	case Statement::S_IF:
+	{
+		const IfStatement *pIf = static_cast<const IfStatement *>(pStmt);
+		WriteExpression(pIf->_cond);
+		WriteStatement(pIf->_then);
+		Byte(pIf->_else != nullptr ? 1 : 0);
+		if (pIf->_else != nullptr)
+			WriteStatement(pIf->_else);
+		break;
+	}
+	case Statement::S_FOR:
+	{
+		const ForStatement *pFor = static_cast<const ForStatement *>(pStmt);
+		Name(pFor->_var);
+		Byte(pFor->_type);
+		WriteExpression(pFor->_from);
+		WriteExpression(pFor->_to);
+		WriteStatement(pFor->_do);
+		break;
+	}
+	case Statement::S_WHILE:
+	{
+		const WhileStatement *pWhile = static_cast<const WhileStatement *>(pStmt);
+		WriteExpression(pWhile->_condition);
+		WriteStatement(pWhile->_st);
+		break;
+	}
+	case Statement::S_REPEAT:
+	{
+		const RepeatStatement *pRepeat = static_cast<const RepeatStatement *>(pStmt);
+		WriteExpression(pRepeat->_condition);
+		WriteSeq(pRepeat->_st);
+		break;
+	}
+	case Statement::S_ASSIGN:
+	{
+		const AssignStatement *pAssign = static_cast<const AssignStatement *>(pStmt);
+		Name(pAssign->_var);
+		WriteExpression(pAssign->_expr);
+		break;
+	}
+	case Statement::S_PROCCALL:
+	{
+		const ProcCallStatement *pCall = static_cast<const ProcCallStatement *>(pStmt);
+		Name(pCall->_id);
+		Uint(pCall->_params.size());
+		for (auto i : pCall->_params)
+			WriteExpression(i);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void Writer::WriteFunction(const Function *pFunc)
+{
+	auto it = pFunc->scp.scope.find(pFunc->_ID);
+	unsigned flags = (pFunc->_params != nullptr ? F_PARAMS : 0) | (pFunc->seq != nullptr ? F_BODY : 0) |
+		(it != pFunc->scp.scope.end() && it->second == pFunc->_prtype ? F_NAMED : 0);
+
+	Name(pFunc->_ID);
+	Byte(pFunc->_prtype->_type);
+	Byte(flags);
+	if (pFunc->_params != nullptr) {
+		Uint(pFunc->_params->_params.size());
+		for (auto &i : pFunc->_params->_params) {
+			Name(i.first);
+			Byte(i.second->_type);
+			Byte(i.second->isRef ? 1 : 0);
+		}
+	}
+
+	Uint(pFunc->Vars.size());
+	for (auto &i : pFunc->Vars) {
+		Name(i.first);
+		WriteDecl(i.second);
+	}
+
+	if (pFunc->seq != nullptr)
+		WriteSeq(pFunc->seq);
+}
+
+// Чтение записи; при любом несоответствии формату бросает исключение
+struct Reader {
+	const unsigned char *_p, *_end;
+	vector<SymbolID> _names;
+	vector<Expression *> _values; // Операнды загружаемого выражения
+
+	Reader(const char *data, size_t size) : _p((const unsigned char *)data), _end((const unsigned char *)data + size) {}
+
+	static void Fail() { throw exception("corrupted AST cache"); }
+
+	unsigned Byte() {
+		if (_p == _end)
+			Fail();
+		return *_p++;
+	}
+
+	unsigned long long Uint() {
+		unsigned long long v = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7) {
+			unsigned b = Byte();
+			v |= (unsigned long long)(b & 0x7F) << shift;
+			if ((b & 0x80) == 0)
+				return v;
+		}
+		Fail();
+		return 0;
+	}
+
+	long long Int() {
+		unsigned long long v = Uint();
+		return (long long)(v >> 1) ^ -(long long)(v & 1);
+	}
+
+	double Real() {
+		if (_end - _p < 8)
+			Fail();
+		unsigned long long bits = GetFixed((const char *)_p, 8);
+		_p += 8;
+		double d;
+		memcpy(&d, &bits, sizeof(d));
+		return d;
+	}
+
+	// Число элементов: каждый занимает хотя бы байт, так что лишней памяти не выделить
+	size_t Count() {
+		unsigned long long n = Uint();
+		if (n > (unsigned long long)(_end - _p))
+			Fail();
+		return (size_t)n;
+	}
+
+	unsigned Enum(unsigned last) {
+		unsigned v = Byte();
+		if (v > last)
+			Fail();
+		return v;
+	}
+
+	Var::TYPE Type() { return (Var::TYPE)Enum(Var::VOID); }
+
+	SymbolID Name() {
+		unsigned long long i = Uint();
+		if (i >= _names.size())
+			Fail();
+		return _names[(size_t)i];
+	}
+
+	void ReadNames();
+	Const * ReadConst(unsigned kind);
+	Var * ReadDecl();
+	Expression * ReadExpression();
+	StatementSeq * ReadSeq();
+	Statement * ReadStatement();
+	void ReadFunctions(Parser &P);
+};
+
+void Reader::ReadNames()
+{
+	size_t n = Count();
+	_names.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		size_t len = Count();
+		_names[i] = SymbolTable::getInstance()->Intern((const char *)_p, len);
+		_p += len;
+	}
+}
+
+Const * Reader::ReadConst(unsigned kind)
+{
+	switch (kind) {
+	case D_INTEGER:
+		return ArenaNew<ConstInteger>(Uint());
+	case D_REAL:
+		return ArenaNew<ConstReal>(Real());
+	case D_BOOLEAN:
+		return ArenaNew<ConstBoolean>(Byte() != 0);
+	case D_ARRAY:
+	{
+		Var::TYPE type = Type();
+		long long low = Int();
+		ConstArray *pArr = ArenaNew<ConstArray>(type, low);
+		size_t n = Count();
+		pArr->_vals.resize(n);
+		for (size_t i = 0; i < n; ++i)
+			pArr->_vals[i] = Uint();
+		return pArr;
+	}
+	default:
+		Fail();
+		return nullptr;
+	}
+}
+
+Var * Reader::ReadDecl()
+{
+	unsigned kind = Enum(D_ARRAY);
+	if (kind != D_VAR)
+		return ReadConst(kind);
+	return ArenaNew<Var>(Type());
+}
+
+Expression * Reader::ReadExpression()
+{
+	size_t base = _values.size();
+	while (true) {
+		unsigned tag = Byte();
+		if (tag == EXPR_END)
+			break;
+
+		Expression *pEl = nullptr;
+		switch (tag & ~EXPR_NEG) {
+		case Expression::E_CONST:
+		{
+			unsigned kind = Enum(D_BOOLEAN);
+			if (kind == D_VAR)
+				Fail();
+			pEl = ArenaNew<ExprConst>(ReadConst(kind));
+			break;
+		}
+		case Expression::E_ID:
+			pEl = ArenaNew<ExprID>(Name());
+			break;
+		case Expression::E_BINARY:
+		case Expression::E_COND:
+		{
+			// Последний допустимый код операции: у BinaryOp и Condition разные перечисления
+			unsigned last = (tag & ~EXPR_NEG) == Expression::E_BINARY ? (unsigned)BinaryOp::OR : (unsigned)Condition::IN;
+			unsigned op = Enum(last);
+			if (_values.size() < base + 2)
+				Fail();
+			Expression *pRight = _values.back();
+			_values.pop_back();
+			Expression *pLeft = _values.back();
+			_values.pop_back();
+			if ((tag & ~EXPR_NEG) == Expression::E_BINARY)
+				pEl = ArenaNew<BinaryOp>(pLeft, pRight, (BinaryOp::OP)op);
+			else
+				pEl = ArenaNew<Condition>(pLeft, pRight, (Condition::OP)op);
+			break;
+		}
+		case Expression::E_INDEX:
+		{
+			SymbolID id = Name();
+			if (_values.size() < base + 1)
+				Fail();
+			Expression *pIndex = _values.back();
+			_values.pop_back();
+			pEl = ArenaNew<ExprIndex>(id, pIndex);
+			break;
+		}
+		case Expression::E_FUNCCALL:
+		{
+			SymbolID id = Name();
+			size_t n = Count();
+			if (_values.size() < base + n)
+				Fail();
+			vector<Expression *> args(_values.end() - n, _values.end());
+			_values.resize(_values.size() - n);
+			pEl = ArenaNew<FuncCallExpr>(id, args);
+			break;
+		}
+		default:
+			Fail();
+		}
+
+		if ((tag & EXPR_NEG) != 0)
+			pEl->Negate();
+		_values.push_back(pEl);
+	}
+
+	if (_values.size() != base + 1)
+		Fail();
+	Expression *pRes = _values.back();
+	_values.pop_back();
+	return pRes;
+}
+
+StatementSeq * Reader::ReadSeq()
+{
+	StatementSeq *pSeq = ArenaNew<StatementSeq>();
+	size_t n = Count();
+	pSeq->statements.reserve(n);
+	for (size_t i = 0; i < n; ++i)
+		pSeq->AddStatement(ReadStatement());
+	return pSeq;
+}
+
+Statement * Reader::ReadStatement()
+{
+	// Поля читаются по порядку записи, поэтому каждое - отдельным оператором
+	switch (Enum(Statement::S_EMPTY)) {
+	case Statement::S_SEQ:
+		return ReadSeq();
+	case Statement::S_IF:
+	{
+		Expression *pCond = ReadExpression();
+		Statement *pThen = ReadStatement();
+		Statement *pElse = Byte() != 0 ? ReadStatement() : nullptr;
+		return ArenaNew<IfStatement>(pCond, pThen, pElse);
+	}
+	case Statement::S_FOR:
+	{
+		SymbolID var = Name();
+		ForStatement::TYPE type = (ForStatement::TYPE)Enum(ForStatement::DOWNTO);
+		Expression *pFrom = ReadExpression();
+		Expression *pTo = ReadExpression();
+		Statement *pDo = ReadStatement();
+		return ArenaNew<ForStatement>(var, pFrom, pTo, pDo, type);
+	}
+	case Statement::S_WHILE:
+	{
+		Expression *pCond = ReadExpression();
+		Statement *pSt = ReadStatement();
+		return ArenaNew<WhileStatement>(pCond, pSt);
+	}
+	case Statement::S_REPEAT:
+	{
+		Expression *pCond = ReadExpression();
+		StatementSeq *pSt = ReadSeq();
+		return ArenaNew<RepeatStatement>(pCond, pSt);
+	}
+	case Statement::S_ASSIGN:
+	{
+		SymbolID var = Name();
+		Expression *pExpr = ReadExpression();
+		return ArenaNew<AssignStatement>(var, pExpr);
+	}
+	case Statement::S_PROCCALL:
+	{
+		SymbolID id = Name();
+		vector<Expression *> params(Count());
+		for (auto &i : params)
+			i = ReadExpression();
+		return ArenaNew<ProcCallStatement>(id, params);
+	}
+	default:
+		return ArenaNew<Statement>(Statement::S_EMPTY);
+	}
+}
+
+void Reader::ReadFunctions(Parser &P)
+{
+	// Объявления добавляются в области видимости в том же порядке, что и при разборе,
+	// поэтому совпадают и таблицы, и списки Vars и Funcs
+	size_t n = Count();
+	if (n == 0)
+		Fail();
+	vector<Function *> funcs(n);
+
+	for (size_t i = 0; i < n; ++i) {
+		size_t parent = i == 0 ? 0 : (size_t)Uint();
+		if (i != 0 && parent >= i)
+			Fail();
+		SymbolID id = Name();
+		Var::TYPE rtype = Type();
+		unsigned flags = Byte();
+
+		ParamList *pList = nullptr;
+		if ((flags & F_PARAMS) != 0) {
+			pList = ArenaNew<ParamList>();
+			pList->_params.resize(Count());
+			for (auto &p : pList->_params) {
+				p.first = Name();
+				Var::TYPE type = Type();
+				bool isRef = Byte() != 0;
+				p.second = ArenaNew<Var>(type, false, isRef);
+			}
+		}
+
+		Function *pFunc;
+		if (i == 0) {
+			Root *pRoot = ArenaNew<Root>();
+			pRoot->_ID = id;
+			pRoot->scp.name = SymName(id);
+			pRoot->_params = pList;
+			P._ast = pRoot;
+			pFunc = pRoot;
+		}
+		else {
+			pFunc = ArenaNew<Function>(id, pList, rtype);
+			pFunc->scp.SetParScope(&funcs[parent]->scp);
+		}
+		funcs[i] = pFunc;
+
+		if (pList != nullptr) {
+			for (auto &p : pList->_params)
+				pFunc->scp.Add(p.first, p.second);
+		}
+		// Имя с другим объявлением флага не получает, поэтому порядок здесь не важен
+		if ((flags & F_NAMED) != 0)
+			pFunc->scp.Add(id, pFunc->_prtype);
+
+		size_t nVars = Count();
+		for (size_t v = 0; v < nVars; ++v) {
+			SymbolID name = Name();
+			if (!pFunc->add(name, ReadDecl()))
+				Fail();
+		}
+
+		pFunc->seq = (flags & F_BODY) != 0 ? ReadSeq() : nullptr;
+
+		if (i != 0 && !funcs[parent]->add(id, pFunc))
+			Fail();
+	}
+}
+
+}
+
+unsigned long long AstCache::HashSource(const char *src, size_t size)
+{
+	return HashBytes(src, size);
+}
+
+string AstCache::PathFor(unsigned long long hash) const
+{
+	ostringstream os;
+	os << _dir << '/' << hex << setw(16) << setfill('0') << hash << ".ast";
+	return os.str();
+}
+
+void AstCache::Serialize(unsigned long long hash, size_t size, const Root *pRoot, string &image)
+{
+	// Подпрограммы по уровням вложенности: объемлющая всегда раньше вложенных,
+	// вложенные одной подпрограммы - в порядке Funcs
+	vector<pair<const Function *, size_t>> funcs;
+	funcs.push_back(make_pair(static_cast<const Function *>(pRoot), (size_t)0));
+	for (size_t i = 0; i < funcs.size(); ++i) {
+		for (auto &f : funcs[i].first->Funcs)
+			funcs.push_back(make_pair(static_cast<const Function *>(f.second), i));
+	}
+
+	Writer body;
+	body.Uint(funcs.size());
+	for (size_t i = 0; i < funcs.size(); ++i) {
+		if (i != 0)
+			body.Uint(funcs[i].second);
+		body.WriteFunction(funcs[i].first);
+	}
+
+	// Таблица имен известна только после записи тел, но при загрузке нужна первой
+	Writer data;
+	data.Uint(body._order.size());
+	for (auto id : body._order) {
+		const string &name = SymName(id);
+		data.Uint(name.size());
+		data._out += name;
+	}
+	data._out += body._out;
+
+
+	image.clear();
+	image.reserve(HEADER_SIZE + data._out.size());
+	image.append(MAGIC, sizeof(MAGIC));
+	PutFixed(image, VERSION, 4);
+	PutFixed(image, 0, 4);
+	PutFixed(image, size, 8);
+	PutFixed(image, hash, 8);
+	PutFixed(image, data._out.size(), 8);
+	PutFixed(image, HashBytes(data._out.data(), data._out.size()), 8);
+	image += data._out;
+}
+
+bool AstCache::Deserialize(unsigned long long hash, size_t size, const char *data, size_t dataSize, Parser &P)
+{
+	if (dataSize < HEADER_SIZE || memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+		return false;
+	if (GetFixed(data + 8, 4) != VERSION || GetFixed(data + 16, 8) != size || GetFixed(data + 24, 8) != hash ||
+		GetFixed(data + 32, 8) != dataSize - HEADER_SIZE)
+		return false;
+
+	// Недописанный или испорченный файл
+	if (HashBytes(data + HEADER_SIZE, dataSize - HEADER_SIZE) != GetFixed(data + 40, 8))
+		return false;
+
+	ArenaScope arenaScope(&P._arena);
+	try {
+		Reader reader(data + HEADER_SIZE, dataSize - HEADER_SIZE);
+		reader.ReadNames();
+		reader.ReadFunctions(P);
+		return reader._p == reader._end;
+	}
+	catch (const exception &) {
+		return false;
+	}
+}
+
+Parser * AstCache::Load(const char *src, size_t size) const
+{
+	unsigned long long hash = HashSource(src, size);
+	MappedFile file;
+	if (!file.Open(PathFor(hash)))
+		return nullptr;
+
+	Parser *P = new Parser();
+	if (!Deserialize(hash, size, file.Data(), file.Size(), *P)) {
+		delete P;
+		return nullptr;
+	}
+	return P;
+}
+
+bool AstCache::Store(const char *src, size_t size, const Parser &P) const
+{
+	unsigned long long hash = HashSource(src, size);
+	string image;
+	try {
+		Serialize(hash, size, P._ast, image);
+	}
+	catch (const exception &) {
+		return false;
+	}
+
+#ifdef _WIN32
+	_mkdir(_dir.c_str());
+	int pid = _getpid();
+#else
+	mkdir(_dir.c_str(), 0777);
+	int pid = (int)getpid();
+#endif
+
+	// Файл пишется под временным именем и переименовывается: одновременная компиляция
+	// того же исходника не увидит недописанную запись
+	string path = PathFor(hash);
+	ostringstream tmp;
+	tmp << path << '.' << pid << ".tmp";
+
+	ofstream out(tmp.str(), ios::out | ios::binary | ios::trunc);
+	out.write(image.data(), image.size());
+	out.close();
+	if (!out) {
+		remove(tmp.str().c_str());
+		return false;
+	}
+
+	if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+		// rename в Windows не заменяет существующий файл
+		remove(path.c_str());
+		if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+			remove(tmp.str().c_str());
+			return false;
+		}
+	}
+	return true;
+}
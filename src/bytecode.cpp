@@ -0,0 +1,654 @@
+#include "bytecode.h"
+
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+
+namespace {
+
+const char *s_opNames[] = {
+#define BYTECODE_NAME(name, n) #name,
+	BYTECODE_OPS(BYTECODE_NAME)
+#undef BYTECODE_NAME
+};
+
+const int s_opOperands[] = {
+#define BYTECODE_OPERANDS(name, n) n,
+	BYTECODE_OPS(BYTECODE_OPERANDS)
+#undef BYTECODE_OPERANDS
+};
+
+// Операнд без побочных эффектов: его вычисление не меняет переменных
+bool IsLeaf(const Expression *pExpr)
+{
+	return pExpr->_type == Expression::E_ID || pExpr->_type == Expression::E_CONST;
+}
+
+}
+
+void Bytecode::Clear()
+{
+	code.clear();
+	funcs.clear();
+	consts.clear();
+	tables.clear();
+	tableData.clear();
+	nGlobals = 0;
+	globals.clear();
+}
+
+void Bytecode::Dump(std::ostream &out) const
+{
+	for (size_t f = 0; f < funcs.size(); ++f) {
+		size_t end = f + 1 < funcs.size() ? funcs[f + 1].entry : code.size();
+		out << SymName(funcs[f].name) << ": " << funcs[f].nParams << " params, "
+			<< funcs[f].nRegs << " registers\n";
+		for (size_t i = funcs[f].entry; i < end; ++i) {
+			const Instr &ins = code[i];
+			out << std::setw(6) << i << "  " << std::left << std::setw(8) << s_opNames[ins.op] << std::right;
+			int n = s_opOperands[ins.op];
+			const int ops[] = { ins.a, ins.b, ins.c };
+			for (int k = 0; k < n; ++k)
+				out << (k == 0 ? " " : ", ") << ops[k];
+			out << '\n';
+		}
+	}
+}
+
+void BytecodeGenerator::Generate(Root *pRoot, Bytecode &code)
+{
+	if (!pRoot->Imports.empty())
+		throw std::exception("units are not supported by the bytecode interpreter");
+
+	code.Clear();
+	_pCode = &code;
+	_funcs.clear();
+	_tables.clear();
+	_globals.clear();
+	_constIndex.clear();
+
+	// Номера функций - в порядке генерации (Root, затем вложенные в глубину),
+	// чтобы вызов мог ссылаться на функцию, код которой еще не построен
+	std::vector<Function *> pending(1, pRoot);
+	while (!pending.empty()) {
+		Function *pFunc = pending.back();
+		pending.pop_back();
+		int n = (int)_funcs.size();
+		_funcs[pFunc] = n;
+		for (auto it = pFunc->Funcs.rbegin(); it != pFunc->Funcs.rend(); ++it)
+			pending.push_back(it->second);
+	}
+	code.funcs.resize(_funcs.size());
+
+	// Глобальные ячейки: результат программы и переменные Root
+	int index = 0;
+	Location loc = { Location::GLOBAL, 0, false };
+	loc.index = index++;
+	_globals[pRoot->_prtype] = loc;
+	code.globals.push_back(nullptr);
+	for (auto &i : pRoot->Vars) {
+		if (i.second->isConst)
+			continue;
+		loc.index = index++;
+		_globals[i.second] = loc;
+		code.globals.push_back(i.second);
+	}
+	code.nGlobals = index;
+
+	GenFunction(pRoot);
+	_pCode = nullptr;
+}
+
+void BytecodeGenerator::GenFunction(Function *pFunc)
+{
+	if (pFunc->seq == nullptr)
+		throw std::exception(("no body for '" + pFunc->GetName() + "'").c_str());
+
+	bool inRoot = _funcs[pFunc] == 0;
+	_locals.clear();
+	_top = 0;
+
+	Bytecode::Func func;
+	func.name = pFunc->_ID;
+	func.pFunc = pFunc;
+	func.entry = (unsigned)Here();
+	func.nParams = (int)pFunc->GetNumOfParams();
+
+	if (inRoot) {
+		// Кадр Root лежит в начале памяти: глобальные ячейки - его регистры
+		for (auto &i : _globals) {
+			Location loc = i.second;
+			loc.kind = Location::REG;
+			_locals[i.first] = loc;
+		}
+		_top = _pCode->nGlobals;
+	}
+	else {
+		for (int i = 0; i < func.nParams; ++i) {
+			Var *pParam = pFunc->_params->_params[i].second;
+			Location loc = { Location::REG, NewReg(), pParam->isRef };
+			_locals[pParam] = loc;
+		}
+		if (pFunc->_prtype->_type != Var::VOID) {
+			Location loc = { Location::REG, NewReg(), false };
+			_locals[pFunc->_prtype] = loc;
+		}
+		// Константы подставлены в выражения (ConstFolder), таблицы общие для всех вызовов
+		for (auto &i : pFunc->Vars) {
+			if (i.second->isConst)
+				continue;
+			Location loc = { Location::REG, NewReg(), false };
+			_locals[i.second] = loc;
+		}
+	}
+	func.nLocals = _top - func.nParams;
+	_maxTop = _top;
+
+	DispatchStatement(pFunc->seq);
+
+	auto it = _locals.find(pFunc->_prtype);
+	Emit(OP_RET, it != _locals.end() ? it->second.index : -1);
+
+	func.nRegs = _maxTop;
+	_pCode->funcs[_funcs[pFunc]] = func;
+
+	for (auto &i : pFunc->Funcs)
+		GenFunction(i.second);
+}
+
+int BytecodeGenerator::NewReg()
+{
+	int reg = _top++;
+	if (_top > _maxTop)
+		_maxTop = _top;
+	return reg;
+}
+
+size_t BytecodeGenerator::Emit(OpCode op, int a, int b, int c)
+{
+	Instr ins = { (unsigned)op, a, b, c };
+	_pCode->code.push_back(ins);
+	return _pCode->code.size() - 1;
+}
+
+void BytecodeGenerator::Patch(size_t jump, size_t target)
+{
+	// У JF цель во втором операнде, у остальных переходов - в первом
+	Instr &ins = _pCode->code[jump];
+	if (ins.op == OP_JF)
+		ins.b = (int)target;
+	else
+		ins.a = (int)target;
+}
+
+const BytecodeGenerator::Location & BytecodeGenerator::Find(const Var *pVar)
+{
+	auto it = _locals.find(pVar);
+	if (it != _locals.end())
+		return it->second;
+	it = _globals.find(pVar);
+	if (it != _globals.end())
+		return it->second;
+	throw std::exception("Unknown variable name");
+}
+
+int BytecodeGenerator::TableIndex(ConstArray *pArr)
+{
+	auto it = _tables.find(pArr);
+	if (it != _tables.end())
+		return it->second;
+
+	Bytecode::Table table = { pArr->_low, pArr->_vals.size(), _pCode->tableData.size() };
+	for (size_t k = 0; k < table.size; ++k) {
+		ConstValue v;
+		ConstValue::OfTable(pArr, pArr->_low + (long long)k, v);
+		Slot s;
+		if (v._type == Var::REAL)
+			s.d = v._real;
+		else
+			s.i = v._int;
+		_pCode->tableData.push_back(s);
+	}
+	_pCode->tables.push_back(table);
+	return _tables[pArr] = (int)_pCode->tables.size() - 1;
+}
+
+void BytecodeGenerator::LoadConst(int dst, const ConstValue &v)
+{
+	if (v._type != Var::REAL) {
+		// Целые уже в разрядности типа, то есть не длиннее 32 бит
+		Emit(OP_LOADI, dst, (int)v._int);
+		return;
+	}
+
+	unsigned long long bits;
+	memcpy(&bits, &v._real, sizeof(bits));
+	auto it = _constIndex.find(bits);
+	if (it == _constIndex.end()) {
+		Slot s;
+		s.d = v._real;
+		_pCode->consts.push_back(s);
+		it = _constIndex.insert(std::make_pair(bits, (int)_pCode->consts.size() - 1)).first;
+	}
+	Emit(OP_LOADK, dst, it->second);
+}
+
+int BytecodeGenerator::InPlace(Expression *pExpr, Var::TYPE to)
+{
+	if (pExpr->_type != Expression::E_ID || pExpr->isNeg)
+		return -1;
+	const Var *pVar = static_cast<ExprID *>(pExpr)->_pNode;
+	if (pVar == nullptr || pVar->isConst || pVar->_type != to)
+		return -1;
+	const Location &loc = Find(pVar);
+	return loc.kind == Location::REG && !loc.isRef ? loc.index : -1;
+}
+
+void BytecodeGenerator::EmitCast(int dst, int src, Var::TYPE from, Var::TYPE to)
+{
+	// Приведения как в CodeGenerator::CastValue
+	OpCode op = OP_MOV;
+	if (from == to)
+		op = OP_MOV;
+	else if (from == Var::VOID || to == Var::VOID)
+		throw std::exception("illegal type cast");
+	else if (from == Var::REAL)
+		op = to == Var::INTEGER ? OP_R2I : to == Var::CHAR ? OP_R2C : OP_R2B;
+	else if (to == Var::REAL)
+		op = OP_I2R;
+	else if (to == Var::BOOLEAN)
+		op = OP_I2B;
+	else if (to == Var::CHAR && from == Var::INTEGER)
+		op = OP_NORM_C;
+
+	if (op != OP_MOV || dst != src)
+		Emit(op, dst, src);
+}
+
+void BytecodeGenerator::EmitNegate(int dst, int src, Var::TYPE type)
+{
+	if (type == Var::REAL) {
+		Emit(OP_NEG_R, dst, src);
+		return;
+	}
+	Emit(OP_NEG_I, dst, src);
+	if (type == Var::CHAR)
+		Emit(OP_NORM_C, dst, dst);
+	else if (type == Var::BOOLEAN)
+		Emit(OP_NORM_B, dst, dst);
+}
+
+int BytecodeGenerator::GenValue(Expression *pExpr, Var::TYPE to)
+{
+	int reg = InPlace(pExpr, to);
+	return reg >= 0 ? reg : GenExpression(pExpr, to);
+}
+
+int BytecodeGenerator::GenAddress(Expression *pArg, int dst)
+{
+	// По ссылке передается адрес переменной, как в CodeGenerator::GenExprID
+	if (pArg->_type != Expression::E_ID)
+		throw std::exception("cannot pass by reference");
+	const Var *pVar = static_cast<ExprID *>(pArg)->_pNode;
+	if (pVar->isConst)
+		throw std::exception("Unknown variable name");
+
+	const Location &loc = Find(pVar);
+	if (loc.kind == Location::GLOBAL)
+		Emit(OP_LOADI, dst, loc.index);
+	else if (loc.isRef)
+		Emit(OP_MOV, dst, loc.index);
+	else
+		Emit(OP_ADDR, dst, loc.index);
+	return dst;
+}
+
+int BytecodeGenerator::GenExpression(Expression *pRoot, Var::TYPE to, int dst)
+{
+	// Обратный обход по явному стеку, как в CodeGenerator::GenExpression: операнды
+	// вычисляются слева направо, значение узла - в регистре над регистрами его операндов,
+	// которые после него свободны. Переменная-операнд читается прямо из своего регистра,
+	// если до операции больше ничего не вычисляется (остальные операнды - листья),
+	// иначе вызов между чтением и операцией мог бы ее изменить
+	size_t bottom = _stack.size();
+	Pending root = { pRoot, to, dst, Var::VOID, nullptr, -1, 0, 0, 0 };
+	_stack.push_back(root);
+	bool entered = false;
+	int res = -1;
+
+	while (_stack.size() > bottom) {
+		Pending &frame = _stack.back();
+		Expression *pEl = frame.pEl;
+
+		if (!entered) {
+			entered = true;
+			frame.base = _operands.size();
+			frame.top = _top;
+			switch (pEl->_type) {
+			case Expression::E_BINARY:
+				frame.opType = pEl->GetVar()->_type;
+				break;
+			case Expression::E_COND:
+			{
+				Condition *pCond = static_cast<Condition *>(pEl);
+				frame.opType = Expression::GetBestType(pCond->_left->GetVar(), pCond->_right->GetVar())->_type;
+				break;
+			}
+			case Expression::E_FUNCCALL:
+			{
+				FuncCallExpr *pCall = static_cast<FuncCallExpr *>(pEl);
+				frame.pFunc = pCall->_pFunc;
+				if (frame.pFunc->GetNumOfParams() != pCall->_params.size())
+					throw std::exception("Incorrect # arguments passed");
+				// Аргументы - подряд над занятыми регистрами: с них начнется кадр вызываемой
+				frame.args = _top;
+				for (unsigned i = 0; i < frame.pFunc->GetNumOfParams(); ++i)
+					NewReg();
+				break;
+			}
+			default:
+				break;
+			}
+		}
+
+		// Следующий операнд, тип, к которому его нужно привести, и его регистр
+		Expression *pNext = nullptr;
+		Var::TYPE nextTo = Var::VOID;
+		int nextDst = -1;
+		bool last = true;
+		bool isRef = false;
+		switch (pEl->_type) {
+		case Expression::E_BINARY:
+			if (frame.next < 2) {
+				BinaryOp *pOp = static_cast<BinaryOp *>(pEl);
+				pNext = frame.next == 0 ? pOp->_left : pOp->_right;
+				last = frame.next == 1 || IsLeaf(pOp->_right);
+				nextTo = frame.opType;
+			}
+			break;
+		case Expression::E_COND:
+			if (frame.next < 2) {
+				Condition *pCond = static_cast<Condition *>(pEl);
+				pNext = frame.next == 0 ? pCond->_left : pCond->_right;
+				last = frame.next == 1 || IsLeaf(pCond->_right);
+				nextTo = frame.opType;
+			}
+			break;
+		case Expression::E_FUNCCALL:
+			if (frame.next < frame.pFunc->GetNumOfParams()) {
+				const Var *pParam = frame.pFunc->_params->_params[frame.next].second;
+				pNext = static_cast<FuncCallExpr *>(pEl)->_params[frame.next];
+				nextTo = pParam->_type;
+				nextDst = frame.args + (int)frame.next;
+				isRef = pParam->isRef;
+			}
+			break;
+		case Expression::E_INDEX:
+			if (frame.next < 1) {
+				pNext = static_cast<ExprIndex *>(pEl)->_index;
+				nextTo = Var::INTEGER;
+			}
+			break;
+		default:
+			break;
+		}
+
+		if (pNext != nullptr) {
+			frame.next++;
+			if (isRef) {
+				_operands.push_back(GenAddress(pNext, nextDst));
+				continue;
+			}
+			int reg = nextDst < 0 && last ? InPlace(pNext, nextTo) : -1;
+			if (reg >= 0) {
+				_operands.push_back(reg);
+				continue;
+			}
+			Pending child = { pNext, nextTo, nextDst, Var::VOID, nullptr, -1, 0, 0, 0 };
+			_stack.push_back(child);
+			entered = false;
+			continue;
+		}
+
+		// Все операнды готовы: их регистры свободны, как только узел вычислен
+		_top = frame.top;
+		int reg = frame.dst >= 0 ? frame.dst : NewReg();
+		Var::TYPE type = pEl->GetVar()->_type;
+
+		if (pEl->_type == Expression::E_CONST) {
+			// Знак и приведение константы - при компиляции
+			ConstValue v = ConstValue::Of(static_cast<ExprConst *>(pEl)->_val);
+			if (pEl->isNeg)
+				v.Negate();
+			ConstValue cast = v;
+			if (cast.Cast(frame.to))
+				LoadConst(reg, cast);
+			else {
+				LoadConst(reg, v);
+				EmitCast(reg, reg, type, frame.to);
+			}
+		}
+		else {
+			int v = GenNode(frame, _operands.data() + frame.base, reg);
+			if (pEl->isNeg) {
+				EmitNegate(reg, v, type);
+				v = reg;
+			}
+			EmitCast(reg, v, type, frame.to);
+		}
+
+		_operands.resize(frame.base);
+		_stack.pop_back();
+		if (_stack.size() > bottom)
+			_operands.push_back(reg);
+		else
+			res = reg;
+	}
+
+	return res;
+}
+
+int BytecodeGenerator::GenNode(Pending &frame, const int *pOps, int dst)
+{
+	Expression *pEl = frame.pEl;
+	switch (pEl->_type) {
+	case Expression::E_ID:
+	{
+		const Var *pVar = static_cast<ExprID *>(pEl)->_pNode;
+		if (pVar->isConst) {
+			LoadConst(dst, ConstValue::Of(static_cast<const Const *>(pVar)));
+			return dst;
+		}
+		const Location &loc = Find(pVar);
+		if (loc.kind == Location::GLOBAL)
+			Emit(OP_GETG, dst, loc.index);
+		else if (loc.isRef)
+			Emit(OP_LOADR, dst, loc.index);
+		else
+			return loc.index;
+		return dst;
+	}
+	case Expression::E_BINARY:
+	{
+		BinaryOp::OP op = static_cast<BinaryOp *>(pEl)->_op;
+		if (frame.opType == Var::REAL) {
+			static const OpCode realOps[] = { OP_MUL_R, OP_DIV_R, OP_COUNT, OP_COUNT, OP_COUNT, OP_ADD_R, OP_SUB_R, OP_COUNT };
+			if (realOps[op] == OP_COUNT)
+				throw std::exception("invalid type");
+			Emit(realOps[op], dst, pOps[0], pOps[1]);
+			return dst;
+		}
+
+		static const OpCode intOps[] = { OP_MUL_I, OP_COUNT, OP_DIV_I, OP_MOD_I, OP_AND_I, OP_ADD_I, OP_SUB_I, OP_OR_I };
+		if (intOps[op] == OP_COUNT)
+			throw std::exception("invalid type");
+		Emit(intOps[op], dst, pOps[0], pOps[1]);
+		// AND и OR не выводят значение за разрядность типа
+		if (op != BinaryOp::AND && op != BinaryOp::OR) {
+			if (frame.opType == Var::CHAR)
+				Emit(OP_NORM_C, dst, dst);
+			else if (frame.opType == Var::BOOLEAN)
+				Emit(OP_NORM_B, dst, dst);
+		}
+		return dst;
+	}
+	case Expression::E_COND:
+	{
+		Condition::OP op = static_cast<Condition *>(pEl)->_op;
+		if (op == Condition::IN)
+			throw std::exception("not supported yet");
+		static const OpCode intOps[] = { OP_EQ_I, OP_NE_I, OP_LT_I, OP_LE_I, OP_GT_I, OP_GE_I };
+		static const OpCode realOps[] = { OP_EQ_R, OP_NE_R, OP_LT_R, OP_LE_R, OP_GT_R, OP_GE_R };
+		Emit(frame.opType == Var::REAL ? realOps[op] : intOps[op], dst, pOps[0], pOps[1]);
+		return dst;
+	}
+	case Expression::E_FUNCCALL:
+	{
+		auto it = _funcs.find(frame.pFunc);
+		if (it == _funcs.end())
+			throw std::exception("Unknown function referenced");
+		Emit(OP_CALL, dst, it->second, frame.args);
+		return dst;
+	}
+	case Expression::E_INDEX:
+		Emit(OP_TAB, dst, pOps[0], TableIndex(static_cast<ExprIndex *>(pEl)->_pNode));
+		return dst;
+	default:
+		throw std::exception("undefined expression type");
+	}
+}
+
+size_t BytecodeGenerator::GenJumpUnless(Expression *pCond)
+{
+	int top = _top;
+	size_t jump;
+
+	// Сравнение целых сливается с переходом: обратное сравнение переходит, когда условие ложно.
+	// У вещественных обратное сравнение не то же, что отрицание (NaN), их проверяет JF
+	Condition *pCmp = pCond->_type == Expression::E_COND && !pCond->isNeg ? static_cast<Condition *>(pCond) : nullptr;
+	Var::TYPE best = Var::VOID;
+	if (pCmp != nullptr && pCmp->_op != Condition::IN) {
+		pCmp->GetVar();
+		best = Expression::GetBestType(pCmp->_left->GetVar(), pCmp->_right->GetVar())->_type;
+	}
+
+	if (best != Var::VOID && best != Var::REAL) {
+		static const OpCode inverse[] = { OP_JNE_I, OP_JEQ_I, OP_JGE_I, OP_JGT_I, OP_JLE_I, OP_JLT_I };
+		int left = IsLeaf(pCmp->_right) ? InPlace(pCmp->_left, best) : -1;
+		if (left < 0)
+			left = GenExpression(pCmp->_left, best);
+		int right = GenValue(pCmp->_right, best);
+		jump = Emit(inverse[pCmp->_op], -1, left, right);
+	}
+	else
+		jump = Emit(OP_JF, GenValue(pCond, Var::BOOLEAN), -1);
+
+	_top = top;
+	return jump;
+}
+
+void BytecodeGenerator::Store(const Var *pVar, Expression *pExpr)
+{
+	int top = _top;
+	const Location &loc = Find(pVar);
+	if (loc.kind == Location::GLOBAL)
+		Emit(OP_SETG, loc.index, GenValue(pExpr, pVar->_type));
+	else if (loc.isRef)
+		Emit(OP_STORER, loc.index, GenValue(pExpr, pVar->_type));
+	else
+		GenExpression(pExpr, pVar->_type, loc.index);
+	_top = top;
+}
+
+void BytecodeGenerator::VisitSeq(StatementSeq *pEl)
+{
+	for (auto &i : pEl->statements)
+		DispatchStatement(i);
+}
+
+void BytecodeGenerator::VisitIf(IfStatement *pEl)
+{
+	size_t jumpElse = GenJumpUnless(pEl->_cond);
+	DispatchStatement(pEl->_then);
+	if (pEl->_else == nullptr) {
+		Patch(jumpElse, Here());
+		return;
+	}
+
+	size_t jumpEnd = Emit(OP_JMP, -1);
+	Patch(jumpElse, Here());
+	DispatchStatement(pEl->_else);
+	Patch(jumpEnd, Here());
+}
+
+void BytecodeGenerator::VisitFor(ForStatement *pEl)
+{
+	const Var *pVar = pEl->_pNode;
+	if (!pVar->Is(Var::INTEGER))
+		throw std::exception("incorrect variable type");
+	Store(pVar, pEl->_from);
+
+	// Как в CodeGenerator::GenForStatement: граница вычисляется на каждом шаге,
+	// а следующее значение считается от прочитанного до тела
+	int top = _top;
+	int cur = NewReg();
+	size_t cond = Here();
+	int to = GenValue(pEl->_to, Var::INTEGER);
+	const Location loc = Find(pVar);
+	if (loc.kind == Location::GLOBAL)
+		Emit(OP_GETG, cur, loc.index);
+	else
+		Emit(loc.isRef ? OP_LOADR : OP_MOV, cur, loc.index);
+	size_t exit = Emit(pEl->_type == ForStatement::TO ? OP_JGT_I : OP_JLT_I, -1, cur, to);
+	_top = cur + 1;
+
+	DispatchStatement(pEl->_do);
+
+	int step = pEl->_type == ForStatement::TO ? 1 : -1;
+	if (loc.kind == Location::REG && !loc.isRef)
+		Emit(OP_ADDK_I, loc.index, cur, step);
+	else {
+		Emit(OP_ADDK_I, cur, cur, step);
+		if (loc.kind == Location::GLOBAL)
+			Emit(OP_SETG, loc.index, cur);
+		else
+			Emit(OP_STORER, loc.index, cur);
+	}
+	Emit(OP_LOOP, (int)cond);
+	Patch(exit, Here());
+	_top = top;
+}
+
+void BytecodeGenerator::VisitWhile(WhileStatement *pEl)
+{
+	size_t cond = Here();
+	size_t exit = GenJumpUnless(pEl->_condition);
+	DispatchStatement(pEl->_st);
+	Emit(OP_LOOP, (int)cond);
+	Patch(exit, Here());
+}
+
+void BytecodeGenerator::VisitRepeat(RepeatStatement *pEl)
+{
+	// Обратный переход - через LOOP, чтобы итерации считались, как у других циклов
+	size_t body = Here();
+	DispatchStatement(pEl->_st);
+	size_t again = GenJumpUnless(pEl->_condition);
+	size_t exit = Emit(OP_JMP, -1);
+	Patch(again, Here());
+	Emit(OP_LOOP, (int)body);
+	Patch(exit, Here());
+}
+
+void BytecodeGenerator::VisitAssign(AssignStatement *pEl)
+{
+	Store(pEl->_pNode, pEl->_expr);
+}
+
+void BytecodeGenerator::VisitProcCall(ProcCallStatement *pEl)
+{
+	int top = _top;
+	FuncCallExpr expr(pEl->_id, pEl->_params, pEl->_pFunc);
+	GenExpression(&expr, pEl->_pFunc->_prtype->_type);
+	_top = top;
+}
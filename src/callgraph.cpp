@@ -0,0 +1,73 @@
+#include "callgraph.h"
+
+void CallGraph::Reach(Function *pFunc)
+{
+	// Подпрограммы из интерфейсов других модулей (без тела) программе не принадлежат
+	if (pFunc->seq == nullptr)
+		return;
+	if (!_counting && _live.insert(pFunc).second)
+		_pending.push_back(pFunc);
+}
+
+void CallGraph::Prune(Root *pRoot)
+{
+	_live.clear();
+	_pending.clear();
+	_dead.clear();
+	_nodes = 0;
+	_total = CountRoutines(pRoot) - 1;
+
+	// Каждое тело просматривается один раз, поэтому рекурсия обход не зацикливает
+	_live.insert(pRoot);
+	_pending.push_back(pRoot);
+	// У модуля тела нет: достижимо все, что вызывается из подпрограмм его интерфейса
+	for (auto &i : pRoot->Interface) {
+		if (Function *pFunc = NodeCast<Function>(i.second))
+			Reach(pFunc);
+	}
+	while (!_pending.empty()) {
+		Function *pFunc = _pending.back();
+		_pending.pop_back();
+		if (pFunc->seq != nullptr)
+			WalkStatement(pFunc->seq);
+	}
+
+	Remove(pRoot);
+}
+
+void CallGraph::Remove(Function *pFunc)
+{
+	auto &funcs = pFunc->Funcs;
+	size_t n = 0;
+	for (auto &i : funcs) {
+		if (_live.count(i.second) == 0) {
+			_dead.push_back(i.second);
+			continue;
+		}
+		Remove(i.second);
+		funcs[n++] = i;
+	}
+	funcs.resize(n);
+}
+
+size_t CallGraph::CountRoutines(const Function *pFunc) const
+{
+	size_t n = 1;
+	for (auto &i : pFunc->Funcs)
+		n += CountRoutines(i.second);
+	return n;
+}
+
+size_t CallGraph::CountRemovedNodes()
+{
+	// Вызовы в удаленных телах ничего не делают достижимым
+	size_t live = _nodes;
+	_nodes = 0;
+	_counting = true;
+	for (auto pFunc : _dead)
+		Walk(pFunc);
+	_counting = false;
+	size_t removed = _nodes;
+	_nodes = live;
+	return removed;
+}
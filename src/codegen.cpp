@@ -1,21 +1,99 @@
 #include "codegen.h"
 
 CodeGenerator *CodeGenerator::m_pInst = nullptr;
+const char *const CodeGenerator::AOT_ENTRY = "pascal_program";
+unsigned CodeGenerator::m_OptLevel = 2;
+unsigned CodeGenerator::m_SizeLevel = 0;
 
-CodeGenerator::CodeGenerator() : m_Context(llvm::getGlobalContext()), 
-								 m_pCurScope(nullptr), m_pOurFPM(nullptr), m_pExe(nullptr) 
+CodeGenerator::CodeGenerator(llvm::LLVMContext &context) : m_Context(context), 
+								 m_pCurScope(nullptr), m_pOurFPM(nullptr), m_pExe(nullptr), m_pCache(nullptr), m_GenTime(0.0), m_OptTime(0.0), m_pFlat(nullptr) 
 {
 	m_pBuilder = new llvm::IRBuilder<>(m_Context);
 }
 
 CodeGenerator::~CodeGenerator() {
+	delete m_pOurFPM;
 	delete m_pExe;
+	delete m_pBuilder;
 }
 
 llvm::Value * CodeGenerator::GenRoot(Root *pRoot) {
 	return GenFunction(pRoot);
 }
 
+//       LLVM:    
+//          
+static std::string UnitSymbolName(SymbolID unit, SymbolID name) {
+	return SymName(unit) + "." + SymName(name);
+}
+
+const std::string & CodeGenerator::LinkName(Function *pFunc) {
+	auto it = m_LinkNames.find(pFunc);
+	return it != m_LinkNames.end() ? it->second : pFunc->GetName();
+}
+
+void CodeGenerator::DeclareImports(Root *pRoot) {
+	for (auto &i : pRoot->Imports) {
+		std::string name = UnitSymbolName(i.unit, i.name);
+		if (Function *pFunc = NodeCast<Function>(i.pNode)) {
+			m_LinkNames[pFunc] = name;
+			m_ValueMap[pFunc] = GenFunctionHeader(pFunc);
+		}
+		else if (ConstArray *pArr = NodeCast<ConstArray>(i.pNode)) {
+			//    :    LLVM  
+			llvm::Constant *pInit = GetConstValue(pArr);
+			m_ValueMap[pArr] = new llvm::GlobalVariable(*m_pMainModule, pInit->getType(), true,
+				llvm::GlobalVariable::LinkageTypes::PrivateLinkage, pInit, name);
+		}
+		else if (!static_cast<Var *>(i.pNode)->isConst) {
+			//   -  ,   
+			Var *pVar = static_cast<Var *>(i.pNode);
+			m_ValueMap[pVar] = new llvm::GlobalVariable(*m_pMainModule, GetType(pVar), false,
+				llvm::GlobalVariable::LinkageTypes::ExternalLinkage, nullptr, name);
+		}
+		//      (ConstFolder)
+	}
+}
+
+void CodeGenerator::GenUnit(Root *pUnit) {
+	DeclareImports(pUnit);
+
+	//       ".",  - 
+	std::unordered_set<std::string> exported;
+	for (auto &i : pUnit->Interface) {
+		m_LinkNames[i.second] = UnitSymbolName(pUnit->_ID, i.first);
+		exported.insert(m_LinkNames[i.second]);
+	}
+
+	for (auto &i : pUnit->Vars) {
+		//      (ConstFolder),    
+		if (i.second->isConst && NodeCast<ConstArray>(i.second) == nullptr)
+			continue;
+		auto it = m_LinkNames.find(i.second);
+		m_ValueMap[i.second] = CreateEntryBlockAlloca(nullptr, it != m_LinkNames.end() ? it->second : SymName(i.first),
+			i.second, true);
+	}
+
+	//  ,     ,    
+	for (auto &i : pUnit->Funcs)
+		m_ValueMap[i.second] = GenFunctionHeader(i.second);
+	for (auto &i : pUnit->Funcs)
+		GenFunction(i.second);
+
+	for (auto &F : *m_pMainModule) {
+		if (!F.isDeclaration() && exported.count(F.getName()) == 0)
+			F.setLinkage(llvm::GlobalValue::InternalLinkage);
+	}
+	for (auto it = m_pMainModule->global_begin(); it != m_pMainModule->global_end(); ++it) {
+		if (it->isDeclaration() || it->hasPrivateLinkage())
+			continue;
+		if (exported.count(it->getName()) != 0 && !it->isConstant())
+			it->setLinkage(llvm::GlobalValue::ExternalLinkage);
+		else
+			it->setLinkage(llvm::GlobalValue::InternalLinkage);
+	}
+}
+
 
 llvm::Value * CodeGenerator::GenStmntSeq(StatementSeq *pSeq) {
 	llvm::Function *TheFunction = m_pBuilder->GetInsertBlock()->getParent();
@@ -27,73 +105,242 @@ llvm::Value * CodeGenerator::GenStmntSeq(StatementSeq *pSeq) {
 	return nullptr;
 }
 
-llvm::Value * CodeGenerator::GenExpression(Expression *pEl) {
+// ,  :   ,     
+// (nullptr - ,  )
+struct ExprFrame {
+	Expression *pEl;
+	const Var *pTo;
+	const Var *pType; //      
+	Function *pFunc; //  
+	unsigned next; //   
+	size_t base; //      
+};
+
+llvm::Value * CodeGenerator::GenExpression(Expression *pRoot) {
+	//       :    
+	//  ,       
+	std::vector<ExprFrame> stack;
+	std::vector<llvm::Value *> values;
+
+	ExprFrame root = { pRoot, nullptr, nullptr, nullptr, 0, 0 };
+	stack.push_back(root);
+	bool entered = false;
+
+	while (!stack.empty()) {
+		ExprFrame &frame = stack.back();
+		Expression *pEl = frame.pEl;
+
+		if (!entered) {
+			//   :     
+			entered = true;
+			frame.base = values.size();
+			switch (pEl->_type) {
+			case Expression::E_BINARY:
+				frame.pType = pEl->GetVar();
+				break;
+			case Expression::E_COND:
+			{
+				Condition *pCond = static_cast<Condition *>(pEl);
+				frame.pType = Expression::GetBestType(pCond->_left->GetVar(), pCond->_right->GetVar());
+				break;
+			}
+			case Expression::E_FUNCCALL:
+			{
+				FuncCallExpr *pCall = static_cast<FuncCallExpr *>(pEl);
+				frame.pFunc = pCall->_pFunc;
+
+				if (frame.pFunc->_params->_params.size() != pCall->_params.size())
+					throw std::exception("Incorrect # arguments passed");
+				break;
+			}
+			}
+		}
 
-	llvm::Value *pRes;
-	switch (pEl->_type) {
-	case Expression::E_BINARY:
-		pRes = GenBinaryOp(dynamic_cast<BinaryOp *>(pEl));
-		break;
-	case Expression::E_COND:
-		pRes = GenCondition(dynamic_cast<Condition *>(pEl));
-		break;
-	case Expression::E_CONST:
-		pRes = GenExprConst(dynamic_cast<ExprConst *>(pEl));
-		break;
-	case Expression::E_ID:
-		pRes = GenExprID(dynamic_cast<ExprID *>(pEl));
-		break;
-	case Expression::E_FUNCCALL:
-		pRes = GenFuncCallExpr(dynamic_cast<FuncCallExpr *>(pEl));
-		break;
-	default:
-		throw std::exception("undefined expression type");
-	}
+		//    ,     
+		Expression *pNext = nullptr;
+		const Var *pNextTo = nullptr;
+		switch (pEl->_type) {
+		case Expression::E_BINARY:
+			if (frame.next < 2) {
+				BinaryOp *pOp = static_cast<BinaryOp *>(pEl);
+				pNext = frame.next == 0 ? pOp->_left : pOp->_right;
+				pNextTo = frame.pType;
+			}
+			break;
+		case Expression::E_COND:
+			if (frame.next < 2) {
+				Condition *pCond = static_cast<Condition *>(pEl);
+				pNext = frame.next == 0 ? pCond->_left : pCond->_right;
+				pNextTo = frame.pType;
+			}
+			break;
+		case Expression::E_FUNCCALL:
+			if (frame.next < frame.pFunc->GetNumOfParams()) {
+				pNext = static_cast<FuncCallExpr *>(pEl)->_params[frame.next];
+				pNextTo = frame.pFunc->_params->_params[frame.next].second;
+			}
+			break;
+		case Expression::E_INDEX:
+			if (frame.next < 1) {
+				pNext = static_cast<ExprIndex *>(pEl)->_index;
+				pNextTo = TypeTable::Get(Var::INTEGER);
+			}
+			break;
+		}
 
-	//      :)
-	if (pEl->isNeg == true) {
-		auto Type = pEl->GetVar(m_pCurScope)->_type;
-		if (Type == Var::REAL)
-			pRes = m_pBuilder->CreateFSub(llvm::Constant::getNullValue(pRes->getType()), pRes, "negate");
-		else
-			pRes = m_pBuilder->CreateSub(llvm::Constant::getNullValue(pRes->getType()), pRes, "negate");
+		if (pNext != nullptr) {
+			frame.next++;
+			if (pNextTo->isRef) {
+				//     ,  
+				if (pNext->_type != Expression::E_ID)
+					throw std::exception("cannot pass by reference");
+				values.push_back(GenExprID(static_cast<ExprID *>(pNext), true));
+			}
+			else {
+				ExprFrame child = { pNext, pNextTo, nullptr, nullptr, 0, 0 };
+				stack.push_back(child);
+				entered = false;
+			}
+			continue;
+		}
+
+		//   
+		llvm::Value *pRes;
+		llvm::Value **pOps = values.data() + frame.base;
+		switch (pEl->_type) {
+		case Expression::E_BINARY:
+			pRes = GenBinaryOp(static_cast<BinaryOp *>(pEl), frame.pType, pOps[0], pOps[1]);
+			break;
+		case Expression::E_COND:
+			pRes = GenCondition(static_cast<Condition *>(pEl), frame.pType, pOps[0], pOps[1]);
+			break;
+		case Expression::E_CONST:
+			pRes = GenExprConst(static_cast<ExprConst *>(pEl));
+			break;
+		case Expression::E_ID:
+			pRes = GenExprID(static_cast<ExprID *>(pEl));
+			break;
+		case Expression::E_FUNCCALL:
+		{
+			std::vector<llvm::Value *> ArgsV(pOps, pOps + frame.next);
+			pRes = GenFuncCallExpr(frame.pFunc, ArgsV);
+			break;
+		}
+		case Expression::E_INDEX:
+			pRes = GenExprIndex(static_cast<ExprIndex *>(pEl), pOps[0]);
+			break;
+		default:
+			throw std::exception("undefined expression type");
+		}
+		values.resize(frame.base);
+
+		//      :)
+		if (pEl->isNeg == true) {
+			auto Type = pEl->GetVar()->_type;
+			if (Type == Var::REAL)
+				pRes = m_pBuilder->CreateFSub(llvm::Constant::getNullValue(pRes->getType()), pRes, "negate");
+			else
+				pRes = m_pBuilder->CreateSub(llvm::Constant::getNullValue(pRes->getType()), pRes, "negate");
+		}
+
+		//      ,   ExpressionCaster
+		if (frame.pTo != nullptr)
+			pRes = CastValue(pRes, pEl->GetVar()->_type, frame.pTo->_type);
+
+		values.push_back(pRes);
+		stack.pop_back();
 	}
 
-	return pRes;
+	return values.back();
 }
 
 llvm::Value * CodeGenerator::GenExprID(ExprID *pEl, bool getRef) {
 
-	Var *pNode = m_pCurScope->Get<Var>(pEl->id);
+	Var *pNode = pEl->_pNode;
 	llvm::Value *pV = m_ValueMap[pNode];
 
 	if (pV == nullptr)
 		throw std::exception("Unknown variable name");
 
 	if (pNode->isRef)
-		pV = m_pBuilder->CreateLoad(pV, pEl->id.c_str());
+		pV = m_pBuilder->CreateLoad(pV, SymName(pEl->id).c_str());
 
 	if (getRef == false)
-		pV = m_pBuilder->CreateLoad(pV, pEl->id.c_str());
+		pV = m_pBuilder->CreateLoad(pV, SymName(pEl->id).c_str());
 
 	return pV;
 }
 
+llvm::Value * CodeGenerator::GenExprIndex(ExprIndex *pEl, llvm::Value *pIndex) {
+	ConstArray *pArr = pEl->_pNode;
+	llvm::Value *pTable = m_ValueMap[pArr];
+
+	if (pTable == nullptr)
+		throw std::exception("Unknown table name");
+
+	return CreateTableLoad(pTable, pArr->_type, pArr->_low, pIndex, SymName(pEl->_id));
+}
+
+llvm::Value * CodeGenerator::CreateTableLoad(llvm::Value *pTable, Var::TYPE type, long long low,
+	llvm::Value *pIndex, const std::string &name) {
+	//       ,         
+	if (low != 0)
+		pIndex = m_pBuilder->CreateSub(pIndex, llvm::ConstantInt::get(m_Context, llvm::APInt(sizeof(int) * 8, low)), "index");
+
+	llvm::Value *Idx[] = { llvm::ConstantInt::get(m_Context, llvm::APInt(sizeof(int) * 8, 0)), pIndex };
+	llvm::Value *pElem = m_pBuilder->CreateInBoundsGEP(pTable, Idx, "elem");
+	llvm::Value *pV = m_pBuilder->CreateLoad(pElem, name.c_str());
+
+	//    
+	if (type == Var::BOOLEAN)
+		pV = m_pBuilder->CreateTrunc(pV, GetType(Var::BOOLEAN));
+	return pV;
+}
+
+llvm::Constant * CodeGenerator::GetConstTable(Var::TYPE type, const unsigned long long *pVals, size_t size) {
+	//   -     ,     
+	switch (type) {
+	case Var::REAL:
+	{
+		std::vector<double> vals(size);
+		if (size != 0)
+			memcpy(vals.data(), pVals, size * sizeof(double));
+		return llvm::ConstantDataArray::get(m_Context, vals);
+	}
+	case Var::INTEGER:
+	{
+		std::vector<uint32_t> vals(pVals, pVals + size);
+		return llvm::ConstantDataArray::get(m_Context, vals);
+	}
+	case Var::CHAR:
+	case Var::BOOLEAN:
+	{
+		std::vector<uint8_t> vals(pVals, pVals + size);
+		return llvm::ConstantDataArray::get(m_Context, vals);
+	}
+	default:
+		throw std::exception("undefined table type");
+	}
+}
+
 llvm::Constant * CodeGenerator::GetConstValue(const Const *pC) {
+	if (auto pArr = NodeCast<ConstArray>(pC))
+		return GetConstTable(pArr->_type, pArr->_vals.data(), pArr->_vals.size());
+
 	switch (pC->_type) {
 	case Const::INTEGER:
 	{
-		auto inc = dynamic_cast<const ConstInteger *>(pC);
+		auto inc = static_cast<const ConstInteger *>(pC);
 		return llvm::ConstantInt::get(m_Context, llvm::APInt(sizeof(int) * 8, inc->_val));
 	}
 	case Const::REAL:
 	{
-		auto inc = dynamic_cast<const ConstReal *>(pC);
+		auto inc = static_cast<const ConstReal *>(pC);
 		return llvm::ConstantFP::get(m_Context, llvm::APFloat(inc->_val));
 	}
 	case Const::BOOLEAN:
 	{
-		auto inc = dynamic_cast<const ConstBoolean *>(pC);
+		auto inc = static_cast<const ConstBoolean *>(pC);
 		return llvm::ConstantInt::get(m_Context, llvm::APInt(1, inc->_val));
 	}
 	default:
@@ -105,25 +352,22 @@ llvm::Value * CodeGenerator::GenExprConst(ExprConst *pEl) {
 	return GetConstValue(pEl->_val);
 }
 
-llvm::Value * CodeGenerator::GenBinaryOp(BinaryOp *pEl) {
-
-	auto *pType = pEl->GetVar(m_pCurScope);
-
-	llvm::Value *pLeft = ExpressionCaster(pEl->_left, pType);
-	llvm::Value *pRight = ExpressionCaster(pEl->_right, pType);
-
+llvm::Value * CodeGenerator::GenBinaryOp(BinaryOp *pEl, const Var *pType, llvm::Value *pLeft, llvm::Value *pRight) {
+	return CreateBinaryOp(pEl->_op, pType->_type, pLeft, pRight);
+}
 
-	switch (pEl->_op) {
+llvm::Value * CodeGenerator::CreateBinaryOp(BinaryOp::OP op, Var::TYPE type, llvm::Value *pLeft, llvm::Value *pRight) {
+	switch (op) {
 	case BinaryOp::MUL:
-		return pType->_type == Var::REAL ? 
+		return type == Var::REAL ? 
 			m_pBuilder->CreateFMul(pLeft, pRight, "mulreal") :
 			m_pBuilder->CreateMul(pLeft, pRight, "mulint");
 	case BinaryOp::ADD:
-		return pType->_type == Var::REAL ?
+		return type == Var::REAL ?
 			m_pBuilder->CreateFAdd(pLeft, pRight, "addreal") :
 			m_pBuilder->CreateAdd(pLeft, pRight, "addint");
 	case BinaryOp::SUB:
-		return pType->_type == Var::REAL ?
+		return type == Var::REAL ?
 			m_pBuilder->CreateFSub(pLeft, pRight, "subreal") :
 			m_pBuilder->CreateSub(pLeft, pRight, "subint");
 	case BinaryOp::DIV:
@@ -145,44 +389,26 @@ llvm::Value * CodeGenerator::GenBinaryOp(BinaryOp *pEl) {
 
 llvm::Value * CodeGenerator::GenProcCallStatement(ProcCallStatement *pEl) {
 	
-	FuncCallExpr expr(pEl->_id, pEl->_params);
+	FuncCallExpr expr(pEl->_id, pEl->_params, pEl->_pFunc);
 
-	return GenFuncCallExpr(&expr);
+	return GenExpression(&expr);
 }
 
-llvm::Value * CodeGenerator::GenFuncCallExpr(FuncCallExpr *pEl) {
-	auto pFunc = m_pCurScope->Get<Function>(pEl->_name);
-
-	if (pFunc == nullptr)
-		throw std::exception("Unknown function referenced");
-
-	if (pFunc->_params->_params.size() != pEl->_params.size())
-		throw std::exception("Incorrect # arguments passed");
-
-	std::vector<llvm::Value *> ArgsV;
-
-	for (unsigned i = 0, e = pEl->_params.size(); i != e; ++i) {
-		ArgsV.push_back(ExpressionCaster(pEl->_params[i], pFunc->_params->_params[i].second));
-		if (ArgsV.back() == 0) return 0;
-	}
-
+llvm::Value * CodeGenerator::GenFuncCallExpr(Function *pFunc, std::vector<llvm::Value *> &ArgsV) {
 	llvm::Function *pFunction = llvm::dyn_cast<llvm::Function>(m_ValueMap[pFunc]);
 	return m_pBuilder->CreateCall(pFunction, ArgsV);
 }
 
-llvm::Value * CodeGenerator::GenCondition(Condition *pEl) {
-	const Var *pLeftT = pEl->_left->GetVar(m_pCurScope);
-	const Var *pRightT = pEl->_right->GetVar(m_pCurScope);
-	const Var *pBestT = Expression::GetBestType(pLeftT, pRightT);
-
-	llvm::Value *pLeftV = ExpressionCaster(pEl->_left, pBestT);
-	llvm::Value *pRightV = ExpressionCaster(pEl->_right, pBestT);
+llvm::Value * CodeGenerator::GenCondition(Condition *pEl, const Var *pBestT, llvm::Value *pLeftV, llvm::Value *pRightV) {
+	return CreateCompare(pEl->_op, pBestT->_type, pLeftV, pRightV);
+}
 
+llvm::Value * CodeGenerator::CreateCompare(Condition::OP op, Var::TYPE type, llvm::Value *pLeftV, llvm::Value *pRightV) {
 	llvm::CmpInst::Predicate Op;
 
-	switch (pEl->_op) {
+	switch (op) {
 	case Condition::EQ:
-		switch (pBestT->_type) {
+		switch (type) {
 		case Var::REAL:
 			Op = llvm::CmpInst::Predicate::FCMP_OEQ; break;
 		default:
@@ -191,7 +417,7 @@ llvm::Value * CodeGenerator::GenCondition(Condition *pEl) {
 
 		break;
 	case Condition::NEQ:
-		switch (pBestT->_type) {
+		switch (type) {
 		case Var::REAL:
 			Op = llvm::CmpInst::Predicate::FCMP_ONE; break;
 		default:
@@ -200,7 +426,7 @@ llvm::Value * CodeGenerator::GenCondition(Condition *pEl) {
 
 		break;
 	case Condition::LT:
-		switch (pBestT->_type) {
+		switch (type) {
 		case Var::REAL:
 			Op = llvm::CmpInst::Predicate::FCMP_OLT; break;
 		case Var::BOOLEAN:
@@ -211,7 +437,7 @@ llvm::Value * CodeGenerator::GenCondition(Condition *pEl) {
 
 		break;
 	case Condition::LE:
-		switch (pBestT->_type) {
+		switch (type) {
 		case Var::REAL:
 			Op = llvm::CmpInst::Predicate::FCMP_OLE; break;
 		case Var::BOOLEAN:
@@ -222,7 +448,7 @@ llvm::Value * CodeGenerator::GenCondition(Condition *pEl) {
 
 		break;
 	case Condition::GT:
-		switch (pBestT->_type) {
+		switch (type) {
 		case Var::REAL:
 			Op = llvm::CmpInst::Predicate::FCMP_OGT; break;
 		case Var::BOOLEAN:
@@ -233,7 +459,7 @@ llvm::Value * CodeGenerator::GenCondition(Condition *pEl) {
 
 		break;
 	case Condition::GE:
-		switch (pBestT->_type) {
+		switch (type) {
 		case Var::REAL:
 			Op = llvm::CmpInst::Predicate::FCMP_OGE; break;
 		case Var::BOOLEAN:
@@ -255,8 +481,7 @@ llvm::Value * CodeGenerator::GenCondition(Condition *pEl) {
 }
 
 llvm::Value * CodeGenerator::GenIfStatement(IfStatement *pEl) {
-	Var VarBool(Var::BOOLEAN);
-	llvm::Value *pCondV = ExpressionCaster(pEl->_cond, &VarBool);
+	llvm::Value *pCondV = ExpressionCaster(pEl->_cond, TypeTable::Get(Var::BOOLEAN));
 
 	llvm::Function *TheFunction = m_pBuilder->GetInsertBlock()->getParent();
 
@@ -288,7 +513,7 @@ llvm::Value * CodeGenerator::GenIfStatement(IfStatement *pEl) {
 llvm::Value * CodeGenerator::GenForStatement(ForStatement *pEl) {
 	llvm::Function *TheFunction = m_pBuilder->GetInsertBlock()->getParent();
 
-	Var *pForT = m_pCurScope->Get<Var>(pEl->_var);
+	Var *pForT = pEl->_pNode;
 	if (!pForT->Is(Var::INTEGER))
 		throw exception("incorrect variable type");
 	llvm::Value *pForV = m_ValueMap[pForT];
@@ -310,7 +535,7 @@ llvm::Value * CodeGenerator::GenForStatement(ForStatement *pEl) {
 	llvm::Value *pTo = ExpressionCaster(pEl->_to, pForT);
 	llvm::Value *pEndCond;
 
-	llvm::Value *pCurVar = m_pBuilder->CreateLoad(pForV, pEl->_var.c_str());
+	llvm::Value *pCurVar = m_pBuilder->CreateLoad(pForV, SymName(pEl->_var).c_str());
 	if (pEl->_type == ForStatement::TO)
 		pEndCond = m_pBuilder->CreateICmpSLE(pCurVar, pTo, "endloop");
 	else
@@ -342,8 +567,7 @@ llvm::Value * CodeGenerator::GenWhileStatement(WhileStatement *pEl) {
 	//   
 	m_pBuilder->CreateBr(pCondBB);
 	m_pBuilder->SetInsertPoint(pCondBB);
-	Var VarBool(Var::BOOLEAN);
-	llvm::Value *pCond = ExpressionCaster(pEl->_condition, &VarBool);
+	llvm::Value *pCond = ExpressionCaster(pEl->_condition, TypeTable::Get(Var::BOOLEAN));
 
 	m_pBuilder->CreateCondBr(pCond, pBodyBB, pAfterBB);
 
@@ -373,8 +597,7 @@ llvm::Value * CodeGenerator::GenRepeatStatement(RepeatStatement *pEl) {
 
 	//   
 	m_pBuilder->SetInsertPoint(pCondBB);
-	Var VarBool(Var::BOOLEAN);
-	llvm::Value *pCond = ExpressionCaster(pEl->_condition, &VarBool);
+	llvm::Value *pCond = ExpressionCaster(pEl->_condition, TypeTable::Get(Var::BOOLEAN));
 
 	m_pBuilder->CreateCondBr(pCond, pAfterBB, pBodyBB);
 
@@ -385,10 +608,7 @@ llvm::Value * CodeGenerator::GenRepeatStatement(RepeatStatement *pEl) {
 }
 
 llvm::Value * CodeGenerator::GenAssignStatement(AssignStatement *pEl) {
-	Var *pVar = m_pCurScope->Get<Var>(pEl->_var);
-
-	if (pVar == nullptr)
-		throw std::exception((std::string("unknown variable '") + pEl->_var + "'").c_str());
+	Var *pVar = pEl->_pNode;
 	
 	bool ref = pVar->isRef;
 	pVar->isRef = false;
@@ -418,12 +638,13 @@ llvm::Function * CodeGenerator::GenFunctionHeader(Function *pFunc) {
 		pParamTypes[i] = GetType(pFunc->_params->_params[i].second);
 	llvm::FunctionType *FuncType = llvm::FunctionType::get(pReturnType, pParamTypes, false);
 
-	llvm::Function *pFunction = llvm::Function::Create(FuncType, llvm::Function::ExternalLinkage, pFunc->GetID(), m_pMainModule);
+	const std::string &name = LinkName(pFunc);
+	llvm::Function *pFunction = llvm::Function::Create(FuncType, llvm::Function::ExternalLinkage, name, m_pMainModule);
 
-	if (pFunction->getName() != pFunc->GetID()) {
+	if (pFunction->getName() != name) {
 		//       
 		pFunction->eraseFromParent();
-		pFunction = m_pMainModule->getFunction(pFunc->GetID());
+		pFunction = m_pMainModule->getFunction(name);
 
 		if (!pFunction->empty() || pFunction->arg_size() != NumOfParams) {
 			// .  
@@ -434,7 +655,7 @@ llvm::Function * CodeGenerator::GenFunctionHeader(Function *pFunc) {
 	//     
 	unsigned i = 0;
 	for (llvm::Function::arg_iterator it = pFunction->arg_begin(); i < NumOfParams; ++it, ++i) {
-		string &name = pFunc->_params->_params[i].first;
+		const string &name = SymName(pFunc->_params->_params[i].first);
 		it->setName(name);
 	}
 
@@ -444,7 +665,7 @@ llvm::Function * CodeGenerator::GenFunctionHeader(Function *pFunc) {
 llvm::Value * CodeGenerator::GenFunctionBody(Function *pFunc) {
 	m_pCurScope = &pFunc->scp; //    
 
-	llvm::Function *pFunction = m_pMainModule->getFunction(pFunc->_ID);
+	llvm::Function *pFunction = m_pMainModule->getFunction(LinkName(pFunc));
 
 	llvm::BasicBlock *pBB = llvm::BasicBlock::Create(m_Context, "entry", pFunction);
 	m_pBuilder->SetInsertPoint(pBB);
@@ -453,14 +674,22 @@ llvm::Value * CodeGenerator::GenFunctionBody(Function *pFunc) {
 	unsigned i = 0;
 	for (llvm::Function::arg_iterator it = pFunction->arg_begin(); i < pFunc->GetNumOfParams(); ++it, ++i) {
 		auto &inc = pFunc->_params->_params[i];
-		llvm::Value *pAlloca = CreateEntryBlockAlloca(pFunction, inc.first, inc.second);
+		llvm::Value *pAlloca = CreateEntryBlockAlloca(pFunction, SymName(inc.first), inc.second);
 		m_pBuilder->CreateStore(it, pAlloca);
 		m_ValueMap[inc.second] = pAlloca;
 	}
 
 	//     :)
 	for (const auto &i : pFunc->Vars) {
-		llvm::Value *pAlloca = CreateEntryBlockAlloca(pFunction, i.first, i.second, m_pCurScope->IsRoot());
+		//    ,     (Regenerate)
+		auto it = m_ValueMap.find(i.second);
+		if (it != m_ValueMap.end() && llvm::isa<llvm::GlobalVariable>(it->second))
+			continue;
+		//      (ConstFolder),    
+		if (i.second->isConst && NodeCast<ConstArray>(i.second) == nullptr)
+			continue;
+
+		llvm::Value *pAlloca = CreateEntryBlockAlloca(pFunction, SymName(i.first), i.second, m_pCurScope->IsRoot());
 		//m_pBuilder->CreateStore(new llvm::Integer, pAlloca);
 		m_ValueMap[i.second] = pAlloca;
 	}
@@ -468,7 +697,7 @@ llvm::Value * CodeGenerator::GenFunctionBody(Function *pFunc) {
 	//   
 	llvm::Value *pRetVal = nullptr;
 	if (pFunc->_prtype->_type != Var::VOID) {
-		pRetVal = CreateEntryBlockAlloca(pFunction, pFunc->_ID, pFunc->_prtype);
+		pRetVal = CreateEntryBlockAlloca(pFunction, pFunc->GetName(), pFunc->_prtype);
 		m_ValueMap[pFunc->_prtype] = pRetVal;
 	}
 
@@ -506,77 +735,36 @@ llvm::Value * CodeGenerator::GenFunction(Function *pFunc) {
 
 
 llvm::Value * CodeGenerator::GenStatement(Statement *pStmt) {
-	switch (pStmt->_type) {
-	case Statement::S_SEQ:
-	{
-		StatementSeq *pSeq = dynamic_cast<StatementSeq *>(pStmt);
-		return GenStmntSeq(pSeq);
-	}
-	case Statement::S_ASSIGN:
-	{
-		AssignStatement *pAssign = dynamic_cast<AssignStatement *>(pStmt);
-		return GenAssignStatement(pAssign);
-	}
-	case Statement::S_PROCCALL:
-	{
-		ProcCallStatement *pCall = dynamic_cast<ProcCallStatement *>(pStmt);
-		return GenProcCallStatement(pCall);
-	}
-	case Statement::S_IF:
-	{
-		IfStatement *pIf = dynamic_cast<IfStatement *>(pStmt);
-		return GenIfStatement(pIf);
-	}
-	case Statement::S_FOR:
-	{
-		ForStatement *pFor = dynamic_cast<ForStatement *>(pStmt);
-		return GenForStatement(pFor);
-	}
-	case Statement::S_WHILE:
-	{
-		WhileStatement *pWhile = dynamic_cast<WhileStatement *>(pStmt);
-		return GenWhileStatement(pWhile);
-	}
-	case Statement::S_REPEAT:
-	{
-		RepeatStatement *pWhile = dynamic_cast<RepeatStatement *>(pStmt);
-		return GenRepeatStatement(pWhile);
-	}
-	case Statement::S_EMPTY:
-		return nullptr;
-	
-	
-	default:
-		throw std::exception();
-	};
+	//    VisitStatement  ,   nullptr
+	return DispatchStatement(pStmt);
 }
 
 llvm::Value * CodeGenerator::ExpressionCaster(Expression *pExp, const Var *pTo) {
 	llvm::Value *pExpValue;
 	if (pTo->isRef) {
-		ExprID *pE = dynamic_cast<ExprID *>(pExp);
-		if (pE == nullptr)
+		if (pExp->_type != Expression::E_ID)
 			throw std::exception("cannot pass by reference");
-		pExpValue = GenExprID(pE, true);
+		pExpValue = GenExprID(static_cast<ExprID *>(pExp), true);
 		return pExpValue;
 	}
 
 	pExpValue = GenExpression(pExp);
-	const Var *pType = pExp->GetVar(m_pCurScope);
+	const Var *pType = pExp->GetVar();
+
+	return CastValue(pExpValue, pType->_type, pTo->_type);
+}
 
+llvm::Value * CodeGenerator::CastValue(llvm::Value *pExpValue, Var::TYPE from, Var::TYPE to) {
 	llvm::Instruction::CastOps CastOp;
 	std::string CastName = "cast";
 
-	if (pType->_type != pTo->_type) {
-		if (pTo->isRef)
-			throw std::exception("reference casting attempt");
+	if (from != to) {
+		llvm::Type *pDestT = GetType(to);
 
-		llvm::Type *pDestT = GetType(pTo);
-
-		switch (pType->_type) {
+		switch (from) {
 		case Var::REAL:
 			CastName += "real";
-			if (pTo->_type == Var::BOOLEAN)
+			if (to == Var::BOOLEAN)
 				return m_pBuilder->CreateFCmpONE(pExpValue, llvm::ConstantFP::getNullValue(pExpValue->getType()));
 			else
 				CastOp = llvm::Instruction::CastOps::FPToSI;
@@ -584,16 +772,16 @@ llvm::Value * CodeGenerator::ExpressionCaster(Expression *pExp, const Var *pTo)
 		case Var::INTEGER:
 		case Var::CHAR:
 			CastName += "int";
-			if (pTo->_type == Var::REAL)
+			if (to == Var::REAL)
 				CastOp = llvm::Instruction::CastOps::SIToFP;
-			else if (pTo->_type == Var::BOOLEAN)
+			else if (to == Var::BOOLEAN)
 				return m_pBuilder->CreateICmpNE(pExpValue, llvm::ConstantInt::getNullValue(pExpValue->getType()));
 			else
 				return m_pBuilder->CreateIntCast(pExpValue, pDestT, true, CastName);
 			break;
 		case Var::BOOLEAN:
 			CastName += "bool";
-			if (pTo->_type == Var::REAL)
+			if (to == Var::REAL)
 				CastOp = llvm::Instruction::CastOps::UIToFP;
 			else
 				return m_pBuilder->CreateIntCast(pExpValue, pDestT, false, CastName);
@@ -609,8 +797,12 @@ llvm::Value * CodeGenerator::ExpressionCaster(Expression *pExp, const Var *pTo)
 }
 
 llvm::Type * CodeGenerator::GetType(const Var *pV) {
+	return GetType(pV->_type, pV->isRef);
+}
+
+llvm::Type * CodeGenerator::GetType(Var::TYPE type, bool isRef) {
 	llvm::Type *pT;
-	switch (pV->_type) {
+	switch (type) {
 	case Var::BOOLEAN:
 		pT =  llvm::IntegerType::get(m_Context, 1);
 		break;
@@ -628,7 +820,7 @@ llvm::Type * CodeGenerator::GetType(const Var *pV) {
 		break;
 	}
 
-	if (pV->isRef)
+	if (isRef)
 		pT = llvm::PointerType::get(pT, 0);
 
 	return pT;
@@ -636,20 +828,412 @@ llvm::Type * CodeGenerator::GetType(const Var *pV) {
 
 
 
+// =====================================================================
+//    :      
+// ,  -   ,      FlatAST
+
+llvm::Constant * CodeGenerator::GetFlatConst(FlatIdx c, Var::TYPE type) {
+	switch (type) {
+	case Var::INTEGER:
+		return llvm::ConstantInt::get(m_Context, llvm::APInt(sizeof(int) * 8, m_pFlat->GetInteger(c)));
+	case Var::REAL:
+		return llvm::ConstantFP::get(m_Context, llvm::APFloat(m_pFlat->GetReal(c)));
+	case Var::BOOLEAN:
+		return llvm::ConstantInt::get(m_Context, llvm::APInt(1, m_pFlat->GetInteger(c)));
+	default:
+		throw std::exception("undefined const expression");
+	}
+}
+
+llvm::Value * CodeGenerator::FlatGenExpression(FlatIdx ref, Var::TYPE to) {
+	const FlatAST &F = *m_pFlat;
+	FlatIdx root = F.ExprRoot(ref);
+
+	for (FlatIdx i = F.ExprBegin(ref); i <= root; ++i) {
+		Var::TYPE type = (Var::TYPE)F._type[i];
+		llvm::Value *pRes;
+
+		switch (F._kind[i]) {
+		case FlatAST::F_CONST:
+			pRes = GetFlatConst(F._a[i], type);
+			break;
+		case FlatAST::F_ID:
+		{
+			const FlatAST::VarInfo &var = F._vars[F._a[i]];
+			const char *name = SymName(var._name).c_str();
+			pRes = m_FlatVars[F._a[i]];
+			if (var._isRef)
+				pRes = m_pBuilder->CreateLoad(pRes, name);
+			if ((F._flags[i] & FlatAST::ADDR) == 0)
+				pRes = m_pBuilder->CreateLoad(pRes, name);
+			break;
+		}
+		case FlatAST::F_BINARY:
+		{
+			FlatIdx l = F._a[i], r = F._b[i];
+			llvm::Value *pLeft = CastValue(m_FlatValues[l], (Var::TYPE)F._type[l], type);
+			llvm::Value *pRight = CastValue(m_FlatValues[r], (Var::TYPE)F._type[r], type);
+			pRes = CreateBinaryOp((BinaryOp::OP)F._op[i], type, pLeft, pRight);
+			break;
+		}
+		case FlatAST::F_COND:
+		{
+			FlatIdx l = F._a[i], r = F._b[i];
+			Var::TYPE best = (Var::TYPE)std::min(F._type[l], F._type[r]);
+			llvm::Value *pLeft = CastValue(m_FlatValues[l], (Var::TYPE)F._type[l], best);
+			llvm::Value *pRight = CastValue(m_FlatValues[r], (Var::TYPE)F._type[r], best);
+			pRes = CreateCompare((Condition::OP)F._op[i], best, pLeft, pRight);
+			break;
+		}
+		case FlatAST::F_CALL:
+		{
+			const FlatAST::FuncInfo &func = F._funcs[F._a[i]];
+			std::vector<llvm::Value *> ArgsV;
+			for (FlatIdx k = 0; k < F._c[i]; ++k) {
+				FlatIdx arg = F._extra[F._b[i] + k];
+				const FlatAST::VarInfo &param = F._vars[func._firstParam + k];
+				//        ( ADDR)
+				if (param._isRef)
+					ArgsV.push_back(m_FlatValues[arg]);
+				else
+					ArgsV.push_back(CastValue(m_FlatValues[arg], (Var::TYPE)F._type[arg], (Var::TYPE)param._type));
+			}
+			pRes = m_pBuilder->CreateCall(m_FlatFuncs[F._a[i]], ArgsV);
+			break;
+		}
+		case FlatAST::F_INDEX:
+		{
+			const FlatAST::VarInfo &var = F._vars[F._a[i]];
+			FlatIdx index = F._b[i];
+			pRes = CreateTableLoad(m_FlatVars[F._a[i]], type, var._low,
+				CastValue(m_FlatValues[index], (Var::TYPE)F._type[index], Var::INTEGER), SymName(var._name));
+			break;
+		}
+		default:
+			throw std::exception("undefined expression type");
+		}
+
+		if (F._flags[i] & FlatAST::NEG) {
+			if (type == Var::REAL)
+				pRes = m_pBuilder->CreateFSub(llvm::Constant::getNullValue(pRes->getType()), pRes, "negate");
+			else
+				pRes = m_pBuilder->CreateSub(llvm::Constant::getNullValue(pRes->getType()), pRes, "negate");
+		}
+
+		m_FlatValues[i] = pRes;
+	}
+
+	return CastValue(m_FlatValues[root], (Var::TYPE)F._type[root], to);
+}
+
+void CodeGenerator::FlatGenStatement(FlatIdx i) {
+	const FlatAST &F = *m_pFlat;
+
+	switch (F._kind[i]) {
+	case FlatAST::F_SEQ:
+		for (FlatIdx k = 0; k < F._c[i]; ++k)
+			FlatGenStatement(F._extra[F._b[i] + k]);
+		break;
+	case FlatAST::F_ASSIGN:
+	{
+		const FlatAST::VarInfo &var = F._vars[F._a[i]];
+		llvm::Value *pAssignValue = FlatGenExpression(F._b[i], (Var::TYPE)var._type);
+		llvm::Value *pVarValue = m_FlatVars[F._a[i]];
+
+		if (var._isRef)
+			pVarValue = m_pBuilder->CreateLoad(pVarValue);
+
+		m_pBuilder->CreateStore(pAssignValue, pVarValue);
+		break;
+	}
+	case FlatAST::F_PROCCALL:
+		FlatGenExpression(F._a[i], (Var::TYPE)F._type[F.ExprRoot(F._a[i])]);
+		break;
+	case FlatAST::F_IF:
+	{
+		llvm::Value *pCondV = FlatGenExpression(F._a[i], Var::BOOLEAN);
+
+		llvm::Function *TheFunction = m_pBuilder->GetInsertBlock()->getParent();
+
+		llvm::BasicBlock *pThenBB = llvm::BasicBlock::Create(m_Context, "then", TheFunction);
+		llvm::BasicBlock *pElseBB = llvm::BasicBlock::Create(m_Context, "else");
+		llvm::BasicBlock *pMergeBB = llvm::BasicBlock::Create(m_Context, "ifcont");
+
+		m_pBuilder->CreateCondBr(pCondV, pThenBB, pElseBB);
+
+		m_pBuilder->SetInsertPoint(pThenBB);
+		FlatGenStatement(F._b[i]);
+		m_pBuilder->CreateBr(pMergeBB);
+
+		TheFunction->getBasicBlockList().push_back(pElseBB);
+		m_pBuilder->SetInsertPoint(pElseBB);
+		if (F._c[i] != FLAT_NONE)
+			FlatGenStatement(F._c[i]);
+		m_pBuilder->CreateBr(pMergeBB);
+
+		TheFunction->getBasicBlockList().push_back(pMergeBB);
+		m_pBuilder->SetInsertPoint(pMergeBB);
+		break;
+	}
+	case FlatAST::F_FOR:
+	{
+		llvm::Function *TheFunction = m_pBuilder->GetInsertBlock()->getParent();
+		FlatIdx var = F._a[i], ext = F._b[i];
+		bool isTo = F._op[i] == ForStatement::TO;
+
+		llvm::Value *pForV = m_FlatVars[var];
+		llvm::Value *pFrom = FlatGenExpression(F._extra[ext], Var::INTEGER);
+		m_pBuilder->CreateStore(pFrom, pForV); //   
+
+		//   
+		ConstInteger Step((isTo ? 1 : -1));
+		llvm::Value *pStepV = GetConstValue(&Step);
+
+		llvm::BasicBlock *pCondBB = llvm::BasicBlock::Create(m_Context, "loopcond", TheFunction);
+		llvm::BasicBlock *pBodyBB = llvm::BasicBlock::Create(m_Context, "loop", TheFunction);
+		llvm::BasicBlock *pAfterBB = llvm::BasicBlock::Create(m_Context, "afterloop", TheFunction);
+
+		//   
+		m_pBuilder->CreateBr(pCondBB);
+		m_pBuilder->SetInsertPoint(pCondBB);
+		llvm::Value *pTo = FlatGenExpression(F._extra[ext + 1], Var::INTEGER);
+
+		llvm::Value *pCurVar = m_pBuilder->CreateLoad(pForV, SymName(F._vars[var]._name).c_str());
+		llvm::Value *pEndCond = isTo ?
+			m_pBuilder->CreateICmpSLE(pCurVar, pTo, "endloop") :
+			m_pBuilder->CreateICmpSGE(pCurVar, pTo, "endloop");
+
+		m_pBuilder->CreateCondBr(pEndCond, pBodyBB, pAfterBB);
+
+		//   
+		m_pBuilder->SetInsertPoint(pBodyBB);
+		FlatGenStatement(F._extra[ext + 2]);
+
+		llvm::Value *pNextVar = m_pBuilder->CreateAdd(pCurVar, pStepV, "nextvar");
+		m_pBuilder->CreateStore(pNextVar, pForV);
+		m_pBuilder->CreateBr(pCondBB);
+
+		//   
+		m_pBuilder->SetInsertPoint(pAfterBB);
+		break;
+	}
+	case FlatAST::F_WHILE:
+	{
+		llvm::Function *TheFunction = m_pBuilder->GetInsertBlock()->getParent();
+
+		llvm::BasicBlock *pCondBB = llvm::BasicBlock::Create(m_Context, "loopcond", TheFunction);
+		llvm::BasicBlock *pBodyBB = llvm::BasicBlock::Create(m_Context, "loopbody", TheFunction);
+		llvm::BasicBlock *pAfterBB = llvm::BasicBlock::Create(m_Context, "afterloop", TheFunction);
+
+		m_pBuilder->CreateBr(pCondBB);
+		m_pBuilder->SetInsertPoint(pCondBB);
+		llvm::Value *pCond = FlatGenExpression(F._a[i], Var::BOOLEAN);
+		m_pBuilder->CreateCondBr(pCond, pBodyBB, pAfterBB);
+
+		m_pBuilder->SetInsertPoint(pBodyBB);
+		FlatGenStatement(F._b[i]);
+		m_pBuilder->CreateBr(pCondBB);
+
+		m_pBuilder->SetInsertPoint(pAfterBB);
+		break;
+	}
+	case FlatAST::F_REPEAT:
+	{
+		llvm::Function *TheFunction = m_pBuilder->GetInsertBlock()->getParent();
+
+		llvm::BasicBlock *pBodyBB = llvm::BasicBlock::Create(m_Context, "loopbody", TheFunction);
+		llvm::BasicBlock *pCondBB = llvm::BasicBlock::Create(m_Context, "loopcond", TheFunction);
+		llvm::BasicBlock *pAfterBB = llvm::BasicBlock::Create(m_Context, "afterloop", TheFunction);
+
+		m_pBuilder->CreateBr(pBodyBB);
+		m_pBuilder->SetInsertPoint(pBodyBB);
+		FlatGenStatement(F._b[i]);
+		m_pBuilder->CreateBr(pCondBB);
+
+		m_pBuilder->SetInsertPoint(pCondBB);
+		llvm::Value *pCond = FlatGenExpression(F._a[i], Var::BOOLEAN);
+		m_pBuilder->CreateCondBr(pCond, pAfterBB, pBodyBB);
+
+		m_pBuilder->SetInsertPoint(pAfterBB);
+		break;
+	}
+	case FlatAST::F_EMPTY:
+		break;
+	default:
+		throw std::exception();
+	}
+}
+
+llvm::Value * CodeGenerator::FlatAlloca(llvm::Function *pFunction, FlatIdx v) {
+	const FlatAST::VarInfo &var = m_pFlat->_vars[v];
+	llvm::Type *pType = GetType((Var::TYPE)var._type, var._isRef);
+	const std::string &name = SymName(var._name);
+
+	if (var._isGlobal || var._isConst) {
+		llvm::Constant *pDefValue;
+		if (var._size != 0)
+			pDefValue = GetConstTable((Var::TYPE)var._type, &m_pFlat->_consts[var._const], var._size);
+		else if (var._isConst)
+			pDefValue = GetFlatConst(var._const, (Var::TYPE)var._type);
+		else
+			pDefValue = llvm::Constant::getNullValue(pType);
+
+		return new llvm::GlobalVariable(*m_pMainModule, pDefValue->getType(), var._isConst,
+			llvm::GlobalVariable::LinkageTypes::CommonLinkage, pDefValue, name);
+	}
+
+	llvm::IRBuilder<> TmpB(&pFunction->getEntryBlock(), pFunction->getEntryBlock().begin());
+	return TmpB.CreateAlloca(pType, 0, name.c_str());
+}
+
+llvm::Function * CodeGenerator::FlatGenFunctionHeader(FlatIdx f) {
+	const FlatAST::FuncInfo &func = m_pFlat->_funcs[f];
+	const std::string &name = SymName(func._name);
+
+	llvm::Type *pReturnType = func._result != FLAT_NONE ?
+		GetType((Var::TYPE)m_pFlat->_vars[func._result]._type) : GetType(Var::VOID);
+
+	vector<llvm::Type *> pParamTypes(func._nParams);
+	for (FlatIdx i = 0; i < func._nParams; ++i) {
+		const FlatAST::VarInfo &param = m_pFlat->_vars[func._firstParam + i];
+		pParamTypes[i] = GetType((Var::TYPE)param._type, param._isRef);
+	}
+	llvm::FunctionType *FuncType = llvm::FunctionType::get(pReturnType, pParamTypes, false);
+
+	llvm::Function *pFunction = llvm::Function::Create(FuncType, llvm::Function::ExternalLinkage, name, m_pMainModule);
+
+	if (pFunction->getName() != name) {
+		//          
+		pFunction->eraseFromParent();
+		throw std::exception("Function redefenition");
+	}
+
+	FlatIdx i = 0;
+	for (llvm::Function::arg_iterator it = pFunction->arg_begin(); i < func._nParams; ++it, ++i)
+		it->setName(SymName(m_pFlat->_vars[func._firstParam + i]._name));
+
+	return pFunction;
+}
+
+void CodeGenerator::FlatGenFunctionBody(FlatIdx f) {
+	const FlatAST::FuncInfo &func = m_pFlat->_funcs[f];
+	llvm::Function *pFunction = m_FlatFuncs[f];
+
+	llvm::BasicBlock *pBB = llvm::BasicBlock::Create(m_Context, "entry", pFunction);
+	m_pBuilder->SetInsertPoint(pBB);
+
+	// ,    
+	FlatIdx i = 0;
+	for (llvm::Function::arg_iterator it = pFunction->arg_begin(); i < func._nParams; ++it, ++i) {
+		FlatIdx v = func._firstParam + i;
+		m_FlatVars[v] = FlatAlloca(pFunction, v);
+		m_pBuilder->CreateStore(it, m_FlatVars[v]);
+	}
+
+	for (FlatIdx v = func._firstVar; v < func._firstVar + func._nVars; ++v) {
+		const FlatAST::VarInfo &var = m_pFlat->_vars[v];
+		if (!var._isConst || var._size != 0)
+			m_FlatVars[v] = FlatAlloca(pFunction, v);
+	}
+
+	if (func._result != FLAT_NONE)
+		m_FlatVars[func._result] = FlatAlloca(pFunction, func._result);
+
+	FlatGenStatement(func._body);
+
+	if (func._result != FLAT_NONE)
+		m_pBuilder->CreateRet(m_pBuilder->CreateLoad(m_FlatVars[func._result]));
+	else
+		m_pBuilder->CreateRetVoid();
+
+	llvm::verifyFunction(*pFunction);
+	m_pOurFPM->run(*pFunction);
+}
+
+void CodeGenerator::GenFlat(const FlatAST &flat) {
+	m_pFlat = &flat;
+	m_FlatValues.assign(flat.Size(), nullptr);
+	m_FlatVars.assign(flat._vars.size(), nullptr);
+	m_FlatFuncs.assign(flat._funcs.size(), nullptr);
+
+	//    ,     ,  
+	for (FlatIdx f = 0; f < flat._funcs.size(); ++f)
+		m_FlatFuncs[f] = FlatGenFunctionHeader(f);
+	for (FlatIdx f = 0; f < flat._funcs.size(); ++f)
+		FlatGenFunctionBody(f);
+
+	m_pFlat = nullptr;
+}
+
+void CodeGenerator::SetOptLevel(unsigned optLevel, unsigned sizeLevel) {
+	m_OptLevel = optLevel;
+	m_SizeLevel = sizeLevel;
+}
+
 CodeGenerator * CodeGenerator::getInstance() {
 	if (m_pInst == nullptr) {
 		llvm::InitializeNativeTarget();
-		m_pInst = new CodeGenerator();
+		// MCJIT (--jit-cache)  EmitObject     AsmPrinter
+		llvm::InitializeNativeTargetAsmPrinter();
+		llvm::InitializeNativeTargetAsmParser();
+		m_pInst = new CodeGenerator(llvm::getGlobalContext());
 	}
 	return m_pInst;
 }
 
-bool CodeGenerator::Generate(Parser *pP) {
-	m_pMainModule = new llvm::Module(pP->_ast->_ID, m_Context);
+bool CodeGenerator::Generate(Parser *pP, const FlatAST *pFlat, bool eager, llvm::ObjectCache *pCache) {
+	//         
+	ArenaScope arenaScope(&pP->_arena);
+
+	//   ( )    
+	delete m_pOurFPM;
+	delete m_pExe; //  
+	m_ValueMap.clear();
+	m_LinkNames.clear();
+
+	CreateModule(pP->_ast->GetName());
+
+	//   
+	m_pCache = pCache;
+	if (!CreateEngine()) {
+		cout << "Generation failed: " << m_ErrorString << endl;
+		return false;
+	}
+	//  eager           JIT,
+	//       
+	m_pExe->DisableLazyCompilation(eager);
+
+	auto start = std::chrono::steady_clock::now();
+	bool Success = true;
+	try {
+		if (pFlat != nullptr)
+			GenFlat(*pFlat);
+		else {
+			DeclareImports(pP->_ast);
+			GenRoot(pP->_ast);
+		}
+	}
+	catch (std::exception &ex) {
+		cout << "Generation failed: " << ex.what() << endl;
+		Success = false;
+	}
+	m_GenTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	//     :   Regenerate
+
+	return Success;
+}
+
+void CodeGenerator::CreateModule(const std::string &name) {
+	m_pMainModule = new llvm::Module(name, m_Context);
 
 	//  
 	m_pOurFPM = new llvm::FunctionPassManager(m_pMainModule);
 	m_pOurFPM->add(new llvm::DataLayoutPass(m_pMainModule));
+	// -O0:    ,   
+	if (m_OptLevel == 0) {
+		m_pOurFPM->doInitialization();
+		return;
+	}
 	m_pOurFPM->add(llvm::createBasicAliasAnalysisPass());
 	m_pOurFPM->add(llvm::createPromoteMemoryToRegisterPass());
 	m_pOurFPM->add(llvm::createInstructionCombiningPass());
@@ -658,19 +1242,401 @@ bool CodeGenerator::Generate(Parser *pP) {
 	m_pOurFPM->add(llvm::createCFGSimplificationPass());
 
 	m_pOurFPM->doInitialization();
+}
 
-	//   
-	m_pExe = llvm::EngineBuilder(m_pMainModule).setErrorStr(&m_ErrorString).create();
+llvm::CodeGenOpt::Level CodeGenerator::CodeGenLevel() {
+	return m_OptLevel == 0 ? llvm::CodeGenOpt::None
+		: m_OptLevel == 1 ? llvm::CodeGenOpt::Less
+		: m_OptLevel == 2 ? llvm::CodeGenOpt::Default : llvm::CodeGenOpt::Aggressive;
+}
+
+//      ; ,  LLVM  
+//   ,   
+static std::vector<std::string> HostCPUFeatures() {
+	std::vector<std::string> attrs;
+	llvm::StringMap<bool> features;
+	if (llvm::sys::getHostCPUFeatures(features)) {
+		for (auto &i : features)
+			attrs.push_back((i.getValue() ? "+" : "-") + i.getKey().str());
+	}
+	return attrs;
+}
+
+bool CodeGenerator::CreateEngine() {
+	m_pExe = llvm::EngineBuilder(m_pMainModule)
+		.setErrorStr(&m_ErrorString)
+		.setUseMCJIT(m_pCache != nullptr)
+		.setOptLevel(CodeGenLevel())
+		.setMCPU(llvm::sys::getHostCPUName())
+		.setMAttrs(HostCPUFeatures())
+		.create();
+	if (m_pExe != nullptr && m_pCache != nullptr)
+		m_pExe->setObjectCache(m_pCache);
+	return m_pExe != nullptr;
+}
+
+std::string CodeGenerator::TargetKey() {
+	std::string key = llvm::sys::getProcessTriple() + ' ' + llvm::sys::getHostCPUName().str();
+	for (auto &i : HostCPUFeatures())
+		key += ' ' + i;
+	return key + " -O" + std::to_string(m_OptLevel) + (m_SizeLevel != 0 ? "s" : "");
+}
+
+bool CodeGenerator::EmitObject(const std::string &path, std::string &error) {
+	std::string name = m_pMainModule->getModuleIdentifier();
+	llvm::Function *pEntry = m_pMainModule->getFunction(name);
+	if (pEntry == nullptr) {
+		error = "no program entry " + name;
+		return false;
+	}
+
+	//   -   (  ),   
+	//   :   Pascal (abs, write...)  
+	//   C,       
+	pEntry->setName(AOT_ENTRY);
+	for (auto it = m_pMainModule->begin(); it != m_pMainModule->end(); ++it) {
+		if (!it->isDeclaration() && &*it != pEntry)
+			it->setLinkage(llvm::GlobalValue::InternalLinkage);
+	}
+	for (auto it = m_pMainModule->global_begin(); it != m_pMainModule->global_end(); ++it) {
+		if (!it->isDeclaration())
+			it->setLinkage(llvm::GlobalValue::InternalLinkage);
+	}
+
+	std::string triple = llvm::sys::getProcessTriple();
+	std::string err;
+	const llvm::Target *pTarget = llvm::TargetRegistry::lookupTarget(triple, err);
+	if (pTarget == nullptr) {
+		error = err;
+		return false;
+	}
+	std::string features;
+	for (auto &i : HostCPUFeatures())
+		features += (features.empty() ? "" : ",") + i;
+	// - :     PIE
+	std::unique_ptr<llvm::TargetMachine> pTM(pTarget->createTargetMachine(triple, llvm::sys::getHostCPUName(),
+		features, llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::CodeModel::Default, CodeGenLevel()));
+	m_pMainModule->setTargetTriple(triple);
+	m_pMainModule->setDataLayout(pTM->getDataLayout());
+
+	llvm::raw_fd_ostream out(path.c_str(), err, llvm::sys::fs::F_None);
+	if (!err.empty()) {
+		error = "cannot write " + path + ": " + err;
+		return false;
+	}
+	{
+		llvm::PassManager PM;
+		PM.add(new llvm::DataLayoutPass(m_pMainModule));
+		// ,  ,     
+		if (m_OptLevel != 0)
+			PM.add(llvm::createGlobalDCEPass());
+		llvm::formatted_raw_ostream fout(out);
+		if (pTM->addPassesToEmitFile(PM, fout, llvm::TargetMachine::CGFT_ObjectFile)) {
+			error = "the target cannot emit object files";
+			return false;
+		}
+		PM.run(*m_pMainModule);
+	}
+	out.close();
+	if (out.has_error()) {
+		out.clear_error();
+		error = "cannot write " + path;
+		return false;
+	}
+	return true;
+}
+
+void CodeGenerator::Optimize() {
+	m_OptTime = 0.0;
+	if (m_OptLevel == 0)
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+	llvm::PassManager MPM;
+	MPM.add(new llvm::DataLayoutPass(m_pMainModule));
+	//       -  ,    JIT
+	m_pExe->getTargetMachine()->addAnalysisPasses(MPM);
+
+	llvm::PassManagerBuilder builder;
+	builder.OptLevel = m_OptLevel;
+	builder.SizeLevel = m_SizeLevel;
+	builder.Inliner = llvm::createFunctionInliningPass(m_OptLevel, m_SizeLevel);
+	builder.LoopVectorize = m_OptLevel > 1 && m_SizeLevel == 0;
+	builder.SLPVectorize = m_OptLevel > 1 && m_SizeLevel == 0;
+	builder.populateModulePassManager(MPM);
+	MPM.run(*m_pMainModule);
+
+	m_OptTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool CodeGenerator::GenerateUnit(Parser *pP, const std::string &path, std::string &error) {
+	ArenaScope arenaScope(&pP->_arena);
+
+	//  LLVM    :    
+	llvm::LLVMContext context;
+	CodeGenerator gen(context);
+	gen.CreateModule(pP->_ast->GetName());
 
 	bool Success = true;
 	try {
-		GenRoot(pP->_ast);
+		gen.GenUnit(pP->_ast);
+
+		std::string err;
+		llvm::raw_fd_ostream out(path.c_str(), err, llvm::sys::fs::F_None);
+		if (!err.empty())
+			throw std::exception(("cannot write " + path + ": " + err).c_str());
+		llvm::WriteBitcodeToFile(gen.m_pMainModule, out);
+		out.close();
+		if (out.has_error()) {
+			out.clear_error();
+			throw std::exception(("cannot write " + path).c_str());
+		}
 	}
 	catch (std::exception &ex) {
-		cout << "Generation failed: " << ex.what() << endl;
+		error = ex.what();
 		Success = false;
 	}
+
+	//     ,     ( )
+	delete gen.m_pOurFPM;
+	gen.m_pOurFPM = nullptr;
+	delete gen.m_pMainModule;
+	return Success;
+}
+
+bool CodeGenerator::LinkUnit(const std::string &path) {
+	llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFile(path);
+	if (!buffer) {
+		cout << "Cannot read unit " << path << endl;
+		return false;
+	}
+	llvm::ErrorOr<llvm::Module *> unit = llvm::parseBitcodeFile(buffer.get().get(), m_Context);
+	if (!unit) {
+		cout << "Cannot load unit " << path << ": " << unit.getError().message() << endl;
+		return false;
+	}
+
+	//     :     
+	unit.get()->setDataLayout(m_pMainModule->getDataLayout());
+	unit.get()->setTargetTriple(m_pMainModule->getTargetTriple());
+
+	//      ,      
+	std::string err;
+	bool failed = llvm::Linker::LinkModules(m_pMainModule, unit.get(), llvm::Linker::DestroySource, &err);
+	delete unit.get();
+	if (failed)
+		cout << "Linking " << path << " failed: " << err << endl;
+	return !failed;
+}
+
+// ,      pFunc  :    ,
+//     ,    (built )
+class TieredBodies : public AstWalker<TieredBodies> {
+	friend class AstVisitor<TieredBodies>;
+	friend class AstWalker<TieredBodies>;
+
+	std::unordered_set<const Function *> &_built;
+	std::vector<Function *> _pending;
+
+	void Reach(Function *pFunc) {
+		if (pFunc->seq != nullptr && _built.insert(pFunc).second)
+			_pending.push_back(pFunc);
+	}
+
+	void VisitProcCall(ProcCallStatement *pEl) { Reach(pEl->_pFunc); }
+	void VisitCall(FuncCallExpr *pEl) { Reach(pEl->_pFunc); }
+
+public:
+	std::vector<Function *> bodies;
+
+	TieredBodies(std::unordered_set<const Function *> &built, Function *pFunc) : _built(built) {
+		Reach(pFunc);
+		while (!_pending.empty()) {
+			Function *pNext = _pending.back();
+			_pending.pop_back();
+			bodies.push_back(pNext);
+			WalkStatement(pNext->seq);
+		}
+	}
+};
+
+bool CodeGenerator::BeginTiered(Parser *pP, const std::unordered_map<const Var *, void *> &globals, std::string &error) {
+	ArenaScope arenaScope(&pP->_arena);
+
 	delete m_pOurFPM;
+	delete m_pExe;
+	m_ValueMap.clear();
+	m_LinkNames.clear();
+	m_TieredBodies.clear();
+	m_pCache = nullptr;
+
+	Root *pRoot = pP->_ast;
+	CreateModule(pRoot->GetName());
+	if (!CreateEngine()) {
+		error = m_ErrorString;
+		return false;
+	}
+
+	try {
+		//     ,    
+		for (auto &i : pRoot->Vars) {
+			auto it = globals.find(i.second);
+			if (it == globals.end())
+				continue;
+			llvm::GlobalVariable *pGV = new llvm::GlobalVariable(*m_pMainModule, GetType(i.second), false,
+				llvm::GlobalVariable::LinkageTypes::ExternalLinkage, nullptr, SymName(i.first));
+			m_pExe->addGlobalMapping(pGV, it->second);
+			m_ValueMap[i.second] = pGV;
+		}
+
+		//     ,     
+		std::vector<Function *> pending(1, pRoot);
+		while (!pending.empty()) {
+			Function *pFunc = pending.back();
+			pending.pop_back();
+			for (auto &i : pFunc->Vars) {
+				if (NodeCast<ConstArray>(i.second) != nullptr)
+					m_ValueMap[i.second] = CreateEntryBlockAlloca(nullptr, SymName(i.first), i.second, true);
+			}
+			for (auto &i : pFunc->Funcs) {
+				m_ValueMap[i.second] = GenFunctionHeader(i.second);
+				pending.push_back(i.second);
+			}
+		}
+	}
+	catch (std::exception &ex) {
+		error = ex.what();
+		return false;
+	}
+	return true;
+}
+
+void * CodeGenerator::CompileTiered(Parser *pP, Function *pFunc, std::string &error) {
+	ArenaScope arenaScope(&pP->_arena);
+
+	try {
+		TieredBodies walker(m_TieredBodies, pFunc);
+		for (auto pBody : walker.bodies)
+			GenFunctionBody(pBody);
+		//      
+		return m_pExe->getPointerToFunction(GenTieredThunk(pFunc));
+	}
+	catch (std::exception &ex) {
+		error = ex.what();
+		return nullptr;
+	}
+}
+
+llvm::Function * CodeGenerator::GenTieredThunk(Function *pFunc) {
+	llvm::Type *pSlotPtr = llvm::Type::getInt64PtrTy(m_Context);
+	std::vector<llvm::Type *> params(3, pSlotPtr);
+	llvm::FunctionType *pType = llvm::FunctionType::get(llvm::Type::getVoidTy(m_Context), params, false);
+	llvm::Function *pThunk = llvm::Function::Create(pType, llvm::Function::ExternalLinkage,
+		LinkName(pFunc) + ".tiered", m_pMainModule);
+
+	llvm::Function::arg_iterator it = pThunk->arg_begin();
+	llvm::Value *pMem = it++;
+	llvm::Value *pArgs = it++;
+	llvm::Value *pRes = it;
+	m_pBuilder->SetInsertPoint(llvm::BasicBlock::Create(m_Context, "entry", pThunk));
+
+	//  var-     
+	unsigned n = pFunc->GetNumOfParams();
+	std::vector<llvm::Value *> args(n), refs(n, nullptr);
+	for (unsigned i = 0; i < n; ++i) {
+		const Var *pParam = pFunc->_params->_params[i].second;
+		llvm::Value *pSlot = m_pBuilder->CreateConstInBoundsGEP1_32(pArgs, i);
+		if (pParam->isRef) {
+			llvm::Value *pIndex = m_pBuilder->CreateLoad(pSlot);
+			refs[i] = m_pBuilder->CreateInBoundsGEP(pMem, pIndex);
+			args[i] = m_pBuilder->CreateBitCast(refs[i], GetType(pParam));
+		}
+		else
+			args[i] = LoadSlot(pSlot, pParam->_type);
+	}
+
+	llvm::Function *pTarget = m_pMainModule->getFunction(LinkName(pFunc));
+	llvm::Value *pRet = m_pBuilder->CreateCall(pTarget, args);
+	if (pFunc->_prtype->_type != Var::VOID)
+		StoreSlot(pRes, pRet, pFunc->_prtype->_type);
+
+	//        var-
+	for (unsigned i = 0; i < n; ++i) {
+		Var::TYPE type = pFunc->_params->_params[i].second->_type;
+		if (refs[i] != nullptr && type != Var::REAL)
+			StoreSlot(refs[i], LoadSlot(refs[i], type), type);
+	}
+	m_pBuilder->CreateRetVoid();
+
+	llvm::verifyFunction(*pThunk);
+	return pThunk;
+}
+
+llvm::Value * CodeGenerator::LoadSlot(llvm::Value *pSlot, Var::TYPE type) {
+	if (type == Var::REAL) {
+		llvm::Value *pPtr = m_pBuilder->CreateBitCast(pSlot, GetType(Var::REAL, true));
+		return m_pBuilder->CreateLoad(pPtr);
+	}
+	llvm::Value *pV = m_pBuilder->CreateLoad(pSlot);
+	return m_pBuilder->CreateTrunc(pV, GetType(type));
+}
+
+void CodeGenerator::StoreSlot(llvm::Value *pSlot, llvm::Value *pV, Var::TYPE type) {
+	llvm::Type *pI64 = llvm::Type::getInt64Ty(m_Context);
+	if (type == Var::REAL)
+		m_pBuilder->CreateStore(pV, m_pBuilder->CreateBitCast(pSlot, GetType(Var::REAL, true)));
+	else if (type == Var::BOOLEAN)
+		m_pBuilder->CreateStore(m_pBuilder->CreateZExt(pV, pI64), pSlot);
+	else
+		m_pBuilder->CreateStore(m_pBuilder->CreateSExt(pV, pI64), pSlot);
+}
+
+bool CodeGenerator::Regenerate(Parser *pP, const std::vector<std::pair<ScopableNode *, ScopableNode *>> &rebind,
+	const std::vector<Function *> &funcs) {
+	ArenaScope arenaScope(&pP->_arena);
+
+	//    :    
+	//         
+	std::unordered_map<ScopableNode *, llvm::Value *> valueMap;
+	for (auto &i : rebind) {
+		auto it = m_ValueMap.find(i.first);
+		if (it != m_ValueMap.end() && llvm::isa<llvm::GlobalValue>(it->second))
+			valueMap[i.second] = it->second;
+	}
+	m_ValueMap.swap(valueMap);
+
+	for (auto pFunc : funcs)
+		m_pMainModule->getFunction(LinkName(pFunc))->deleteBody();
+
+	//    ,     , ,
+	//     
+	std::unordered_set<llvm::Value *> kept;
+	for (auto &i : m_ValueMap)
+		kept.insert(i.second);
+	for (auto it = m_pMainModule->global_begin(); it != m_pMainModule->global_end();) {
+		llvm::GlobalVariable *pGV = &*it++;
+		if (pGV->use_empty() && kept.find(pGV) == kept.end()) {
+			m_pExe->updateGlobalMapping(pGV, nullptr);
+			pGV->eraseFromParent();
+		}
+	}
+
+	bool Success = true;
+	try {
+		for (auto pFunc : funcs)
+			GenFunctionBody(pFunc);
+		//    :       .
+		// ,     ,  :    
+		for (auto pFunc : funcs) {
+			llvm::Function *pF = m_pMainModule->getFunction(LinkName(pFunc));
+			if (m_pExe->getPointerToGlobalIfAvailable(pF) != nullptr)
+				m_pExe->recompileAndRelinkFunction(pF);
+		}
+	}
+	catch (std::exception &ex) {
+		cout << "Generation failed: " << ex.what() << endl;
+		Success = false;
+	}
 
 	return Success;
 }
@@ -686,10 +1652,30 @@ void CodeGenerator::Dump() {
 	m_pMainModule->dump();
 }
 
+void CodeGenerator::Dump(Function *pFunc) {
+	m_pMainModule->getFunction(LinkName(pFunc))->dump();
+}
+
+size_t CodeGenerator::CompiledRoutines(size_t &total) const {
+	size_t compiled = 0;
+	total = 0;
+	for (auto it = m_pMainModule->begin(); it != m_pMainModule->end(); ++it) {
+		if (it->isDeclaration())
+			continue;
+		++total;
+		// MCJIT  (   )     
+		if (m_pCache != nullptr || m_pExe->getPointerToGlobalIfAvailable(&*it) != nullptr)
+			++compiled;
+	}
+	return compiled;
+}
+
 int CodeGenerator::Execute() {
 	std::string name = m_pMainModule->getModuleIdentifier();
 	llvm::Function *pFunction = m_pExe->FindFunctionNamed(name.c_str());
 	std::vector<std::string> v;
+	// MCJIT       ;  JIT   
+	m_pExe->finalizeObject();
 	int res = m_pExe->runFunctionAsMain(pFunction, v, nullptr);
 
 	return res;
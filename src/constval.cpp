@@ -0,0 +1,161 @@
+#include "constval.h"
+
+#include <climits>
+
+long long ConstValue::Normalize(Var::TYPE type, unsigned long long v)
+{
+	switch (type) {
+	case Var::INTEGER:
+		return (int)(unsigned)v;
+	case Var::CHAR:
+		return (signed char)(unsigned char)v;
+	default:
+		return (long long)(v & 1);
+	}
+}
+
+ConstValue ConstValue::Of(const Const *pC)
+{
+	ConstValue v = { pC->_type, 0, 0.0 };
+	switch (pC->_type) {
+	case Var::INTEGER:
+		v._int = Normalize(Var::INTEGER, static_cast<const ConstInteger *>(pC)->_val);
+		break;
+	case Var::REAL:
+		v._real = static_cast<const ConstReal *>(pC)->_val;
+		break;
+	case Var::BOOLEAN:
+		v._int = static_cast<const ConstBoolean *>(pC)->_val ? 1 : 0;
+		break;
+	default:
+		break;
+	}
+	return v;
+}
+
+bool ConstValue::OfTable(const ConstArray *pArr, long long index, ConstValue &v)
+{
+	long long k = index - pArr->_low;
+	if (k < 0 || k >= (long long)pArr->_vals.size())
+		return false;
+
+	v._type = pArr->_type;
+	if (v._type == Var::REAL)
+		v._real = pArr->GetReal((size_t)k);
+	else
+		v._int = Normalize(v._type, pArr->_vals[(size_t)k]);
+	return true;
+}
+
+Const * ConstValue::MakeConst() const
+{
+	switch (_type) {
+	case Var::INTEGER:
+		return ArenaNew<ConstInteger>((unsigned long long)_int);
+	case Var::REAL:
+		return ArenaNew<ConstReal>(_real);
+	case Var::BOOLEAN:
+		return ArenaNew<ConstBoolean>(_int != 0);
+	default:
+		throw std::exception("undefined const expression");
+	}
+}
+
+bool ConstValue::Cast(Var::TYPE to)
+{
+	if (_type == to)
+		return true;
+
+	if (_type == Var::REAL) {
+		if (to == Var::BOOLEAN)
+			_int = (_real < 0.0 || _real > 0.0) ? 1 : 0; // fcmp one: NaN - ложь
+		else {
+			// fptosi вне диапазона целевого типа не определен
+			double lim = to == Var::INTEGER ? 2147483648.0 : 128.0;
+			if (!(_real > -lim - 1.0 && _real < lim))
+				return false;
+			_int = (long long)_real;
+		}
+	}
+	else if (to == Var::REAL)
+		_real = (double)_int;
+	else if (to == Var::BOOLEAN && _type != Var::BOOLEAN)
+		_int = _int != 0 ? 1 : 0;
+	else
+		_int = Normalize(to, (unsigned long long)_int);
+
+	_type = to;
+	return true;
+}
+
+void ConstValue::Negate()
+{
+	if (_type == Var::REAL)
+		_real = 0.0 - _real;
+	else
+		_int = Normalize(_type, 0 - (unsigned long long)_int);
+}
+
+bool ConstValue::Apply(BinaryOp::OP op, Var::TYPE type, const ConstValue &l, const ConstValue &r, ConstValue &res)
+{
+	res._type = type;
+	if (type == Var::REAL) {
+		switch (op) {
+		case BinaryOp::MUL: res._real = l._real * r._real; return true;
+		case BinaryOp::ADD: res._real = l._real + r._real; return true;
+		case BinaryOp::SUB: res._real = l._real - r._real; return true;
+		case BinaryOp::DIV: res._real = l._real / r._real; return true;
+		default: return false;
+		}
+	}
+
+	unsigned long long a = (unsigned long long)l._int, b = (unsigned long long)r._int;
+	switch (op) {
+	case BinaryOp::MUL:
+		res._int = Normalize(type, a * b);
+		return true;
+	case BinaryOp::ADD:
+		res._int = Normalize(type, a + b);
+		return true;
+	case BinaryOp::SUB:
+		res._int = Normalize(type, a - b);
+		return true;
+	case BinaryOp::INT_DIV:
+	case BinaryOp::MOD:
+	{
+		// sdiv и srem не определены при делении на ноль и при переполнении (MIN div -1)
+		long long min = type == Var::INTEGER ? INT_MIN : SCHAR_MIN;
+		if (type == Var::BOOLEAN || r._int == 0 || (r._int == -1 && l._int == min))
+			return false;
+		res._int = op == BinaryOp::INT_DIV ? l._int / r._int : l._int % r._int;
+		return true;
+	}
+	case BinaryOp::AND:
+		res._int = l._int & r._int;
+		return true;
+	case BinaryOp::OR:
+		res._int = l._int | r._int;
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool ConstValue::Compare(Condition::OP op, const ConstValue &l, const ConstValue &r, ConstValue &res)
+{
+	// Вещественные сравнения упорядоченные, логические беззнаковые (0 и 1), остальные знаковые
+	bool real = l._type == Var::REAL;
+	bool b;
+	switch (op) {
+	case Condition::EQ: b = real ? l._real == r._real : l._int == r._int; break;
+	case Condition::NEQ: b = real ? (l._real < r._real || l._real > r._real) : l._int != r._int; break;
+	case Condition::LT: b = real ? l._real < r._real : l._int < r._int; break;
+	case Condition::LE: b = real ? l._real <= r._real : l._int <= r._int; break;
+	case Condition::GT: b = real ? l._real > r._real : l._int > r._int; break;
+	case Condition::GE: b = real ? l._real >= r._real : l._int >= r._int; break;
+	default: return false;
+	}
+	res._type = Var::BOOLEAN;
+	res._int = b ? 1 : 0;
+	return true;
+}
@@ -0,0 +1,330 @@
+#include "evaluator.h"
+
+#include <cstring>
+
+namespace {
+
+// Обращения функций к переменным и вызовы для поиска чистых функций
+struct PurityWalker : public AstWalker<PurityWalker> {
+	struct Info {
+		bool local; // Тело обращается только к своим переменным и константам
+		std::vector<const Function *> callees;
+	};
+
+	std::unordered_map<const Function *, Info> _info;
+	Info *_pInfo;
+	std::unordered_set<const Var *> _locals; // Переменные текущей функции
+
+	void EnterFunction(Function *pFunc) {
+		_pInfo = &_info[pFunc];
+		// Тело, не разобранное при перезагрузке, неизвестно
+		_pInfo->local = pFunc->seq != nullptr;
+
+		_locals.clear();
+		_locals.insert(pFunc->_prtype);
+		for (auto &i : pFunc->Vars)
+			_locals.insert(i.second);
+		if (pFunc->_params != nullptr) {
+			for (auto &i : pFunc->_params->_params) {
+				if (i.second->isRef)
+					_pInfo->local = false;
+				_locals.insert(i.second);
+			}
+		}
+	}
+
+	void Use(const Var *pVar) {
+		if (!pVar->isConst && _locals.count(pVar) == 0)
+			_pInfo->local = false;
+	}
+
+	void VisitID(ExprID *pEl) { Use(pEl->_pNode); }
+	void VisitAssign(AssignStatement *pEl) { Use(pEl->_pNode); }
+	void VisitFor(ForStatement *pEl) { Use(pEl->_pNode); }
+	void VisitCall(FuncCallExpr *pEl) { _pInfo->callees.push_back(pEl->_pFunc); }
+	void VisitProcCall(ProcCallStatement *pEl) { _pInfo->callees.push_back(pEl->_pFunc); }
+};
+
+unsigned long long Bits(const ConstValue &v)
+{
+	if (v._type != Var::REAL)
+		return (unsigned long long)v._int;
+	unsigned long long bits;
+	memcpy(&bits, &v._real, sizeof(bits));
+	return bits;
+}
+
+}
+
+void PureEvaluator::Analyze(Root *pRoot)
+{
+	PurityWalker walker;
+	walker.Walk(pRoot);
+
+	// Сначала чистыми считаются все функции без обращений к чужим переменным,
+	// затем исключаются вызывающие нечистые, пока список не перестанет меняться
+	_pure.clear();
+	_results.clear();
+	for (auto &i : walker._info) {
+		if (i.second.local && i.first != pRoot)
+			_pure.insert(i.first);
+	}
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (auto &i : walker._info) {
+			if (!IsPure(i.first))
+				continue;
+			for (auto pCallee : i.second.callees) {
+				if (!IsPure(pCallee)) {
+					_pure.erase(i.first);
+					changed = true;
+					break;
+				}
+			}
+		}
+	}
+}
+
+bool PureEvaluator::Call(Function *pFunc, const std::vector<ConstValue> &args, ConstValue &res)
+{
+	if (!IsPure(pFunc))
+		return false;
+
+	// Одинаковые вызовы в программе вычисляются один раз
+	CallKey key(pFunc, std::vector<unsigned long long>());
+	for (auto &i : args)
+		key.second.push_back(Bits(i));
+	auto it = _results.find(key);
+	if (it != _results.end()) {
+		res = it->second.second;
+		return it->second.first;
+	}
+
+	_steps = 0;
+	bool ok = Invoke(pFunc, args, res);
+	_results[key] = std::make_pair(ok, res);
+	return ok;
+}
+
+bool PureEvaluator::Invoke(Function *pFunc, const std::vector<ConstValue> &args, ConstValue &res)
+{
+	if (_depth >= MAX_DEPTH)
+		return false;
+
+	Frame frame;
+	for (size_t i = 0; i < args.size(); ++i)
+		frame[pFunc->_params->_params[i].second] = args[i];
+
+	Frame *pOld = _pFrame;
+	_pFrame = &frame;
+	++_depth;
+	bool ok = DispatchStatement(pFunc->seq);
+	--_depth;
+	_pFrame = pOld;
+
+	if (!ok)
+		return false;
+	if (pFunc->_prtype->_type == Var::VOID) {
+		res._type = Var::VOID;
+		return true;
+	}
+
+	// Функция, не присвоившая результат, возвращает неопределенное значение
+	auto it = frame.find(pFunc->_prtype);
+	if (it == frame.end())
+		return false;
+	res = it->second;
+	return true;
+}
+
+bool PureEvaluator::EvalArgs(Function *pFunc, const std::vector<Expression *> &params, std::vector<ConstValue> &args)
+{
+	args.resize(params.size());
+	for (size_t i = 0; i < params.size(); ++i) {
+		if (!Eval(params[i], pFunc->_params->_params[i].second->_type, args[i]))
+			return false;
+	}
+	return true;
+}
+
+bool PureEvaluator::VisitSeq(StatementSeq *pEl)
+{
+	if (!Step())
+		return false;
+	for (auto &i : pEl->statements) {
+		if (!DispatchStatement(i))
+			return false;
+	}
+	return true;
+}
+
+bool PureEvaluator::VisitIf(IfStatement *pEl)
+{
+	ConstValue cond;
+	if (!Step() || !Eval(pEl->_cond, Var::BOOLEAN, cond))
+		return false;
+	if (cond._int != 0)
+		return DispatchStatement(pEl->_then);
+	return pEl->_else == nullptr || DispatchStatement(pEl->_else);
+}
+
+bool PureEvaluator::VisitFor(ForStatement *pEl)
+{
+	const Var *pVar = pEl->_pNode;
+	ConstValue cur, to;
+	if (!pVar->Is(Var::INTEGER) || !Eval(pEl->_from, Var::INTEGER, cur))
+		return false;
+	(*_pFrame)[pVar] = cur;
+
+	while (true) {
+		// Как в коде: граница вычисляется на каждом шаге, а следующее значение
+		// считается от прочитанного до тела, а не от изменений переменной в теле
+		if (!Step() || !Eval(pEl->_to, Var::INTEGER, to))
+			return false;
+		cur = (*_pFrame)[pVar];
+		if (pEl->_type == ForStatement::TO ? cur._int > to._int : cur._int < to._int)
+			return true;
+		if (!DispatchStatement(pEl->_do))
+			return false;
+		cur._int = ConstValue::Normalize(Var::INTEGER, cur._int + (pEl->_type == ForStatement::TO ? 1 : -1));
+		(*_pFrame)[pVar] = cur;
+	}
+}
+
+bool PureEvaluator::VisitWhile(WhileStatement *pEl)
+{
+	while (true) {
+		ConstValue cond;
+		if (!Step() || !Eval(pEl->_condition, Var::BOOLEAN, cond))
+			return false;
+		if (cond._int == 0)
+			return true;
+		if (!DispatchStatement(pEl->_st))
+			return false;
+	}
+}
+
+bool PureEvaluator::VisitRepeat(RepeatStatement *pEl)
+{
+	while (true) {
+		ConstValue cond;
+		if (!DispatchStatement(pEl->_st) || !Eval(pEl->_condition, Var::BOOLEAN, cond))
+			return false;
+		if (cond._int != 0)
+			return true;
+	}
+}
+
+bool PureEvaluator::VisitAssign(AssignStatement *pEl)
+{
+	ConstValue v;
+	if (!Step() || !Eval(pEl->_expr, pEl->_pNode->_type, v))
+		return false;
+	(*_pFrame)[pEl->_pNode] = v;
+	return true;
+}
+
+bool PureEvaluator::VisitProcCall(ProcCallStatement *pEl)
+{
+	std::vector<ConstValue> args;
+	ConstValue res;
+	return Step() && EvalArgs(pEl->_pFunc, pEl->_params, args) && Invoke(pEl->_pFunc, args, res);
+}
+
+bool PureEvaluator::Eval(Expression *pRoot, Var::TYPE to, ConstValue &res)
+{
+	// Обратный обход по явному стеку. Вложенные вызовы снова входят в Eval,
+	// поэтому кадры и значения каждого вычисления лежат выше своих base
+	size_t base = _stack.size(), valBase = _values.size();
+	EvalFrame root = { pRoot, 0, valBase };
+	_stack.push_back(root);
+
+	bool ok = true;
+	while (ok && _stack.size() > base) {
+		EvalFrame &frame = _stack.back();
+		Expression *pEl = frame.pEl;
+		Expression *pNext = Operand(pEl, frame.next);
+		if (pNext != nullptr) {
+			frame.next++;
+			EvalFrame child = { pNext, 0, _values.size() };
+			_stack.push_back(child);
+			continue;
+		}
+
+		size_t first = frame.base;
+		_stack.pop_back();
+
+		ConstValue v = { pEl->GetVar()->_type, 0, 0.0 };
+		if (!Step())
+			ok = false;
+		else if (pEl->_type == Expression::E_FUNCCALL) {
+			// Вызов снова использует _values, поэтому аргументы копируются
+			Function *pFunc = static_cast<FuncCallExpr *>(pEl)->_pFunc;
+			std::vector<ConstValue> args(_values.begin() + first, _values.end());
+			for (size_t i = 0; ok && i < args.size(); ++i)
+				ok = args[i].Cast(pFunc->_params->_params[i].second->_type);
+			ok = ok && Invoke(pFunc, args, v);
+		}
+		else
+			ok = Compute(pEl, _values.data() + first, v);
+
+		if (ok && pEl->isNeg)
+			v.Negate();
+		_values.resize(first);
+		_values.push_back(v);
+	}
+
+	if (!ok) {
+		_stack.resize(base);
+		_values.resize(valBase);
+		return false;
+	}
+
+	res = _values.back();
+	_values.pop_back();
+	return res.Cast(to);
+}
+
+bool PureEvaluator::Compute(Expression *pEl, const ConstValue *pOps, ConstValue &res)
+{
+	switch (pEl->_type) {
+	case Expression::E_CONST:
+		res = ConstValue::Of(static_cast<ExprConst *>(pEl)->_val);
+		return true;
+	case Expression::E_ID:
+	{
+		const Var *pNode = static_cast<ExprID *>(pEl)->_pNode;
+		if (pNode->isConst) {
+			res = ConstValue::Of(static_cast<const Const *>(pNode));
+			return true;
+		}
+		auto it = _pFrame->find(pNode);
+		if (it == _pFrame->end())
+			return false;
+		res = it->second;
+		return true;
+	}
+	case Expression::E_BINARY:
+	{
+		ConstValue l = pOps[0], r = pOps[1];
+		Var::TYPE type = res._type;
+		return l.Cast(type) && r.Cast(type) && ConstValue::Apply(static_cast<BinaryOp *>(pEl)->_op, type, l, r, res);
+	}
+	case Expression::E_COND:
+	{
+		Condition *pCond = static_cast<Condition *>(pEl);
+		Var::TYPE best = Expression::GetBestType(pCond->_left->GetVar(), pCond->_right->GetVar())->_type;
+		ConstValue l = pOps[0], r = pOps[1];
+		return l.Cast(best) && r.Cast(best) && ConstValue::Compare(pCond->_op, l, r, res);
+	}
+	case Expression::E_INDEX:
+	{
+		ConstValue idx = pOps[0];
+		return idx.Cast(Var::INTEGER) && ConstValue::OfTable(static_cast<ExprIndex *>(pEl)->_pNode, idx._int, res);
+	}
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,397 @@
+#include "flatast.h"
+#include "visitor.h"
+
+#include <cstring>
+#include <unordered_map>
+
+// Обход дерева разбора с записью узлов в плоские массивы
+struct FlatAST::Builder {
+	FlatAST &_flat;
+	std::unordered_map<const Var *, FlatIdx> _varIdx;
+	std::unordered_map<const Function *, FlatIdx> _funcIdx;
+	std::vector<Function *> _funcs; // Функции по номерам
+
+	Builder(FlatAST &flat) : _flat(flat) {}
+
+	FlatIdx AddVar(SymbolID name, const Var *pVar, bool isGlobal)
+	{
+		VarInfo info;
+		info._name = name;
+		info._type = (unsigned char)pVar->_type;
+		info._isConst = pVar->isConst;
+		info._isRef = pVar->isRef;
+		info._isGlobal = isGlobal;
+		info._const = pVar->isConst ? _flat.AddConst(static_cast<const Const *>(pVar)) : FLAT_NONE;
+
+		const ConstArray *pArr = NodeCast<ConstArray>(pVar);
+		info._size = pArr != nullptr ? (FlatIdx)pArr->_vals.size() : 0;
+		info._low = pArr != nullptr ? (int)pArr->_low : 0;
+
+		FlatIdx idx = (FlatIdx)_flat._vars.size();
+		_flat._vars.push_back(info);
+		_varIdx[pVar] = idx;
+		return idx;
+	}
+
+	// Функции нумеруются в прямом порядке: родитель раньше вложенных
+	void AddFunction(Function *pFunc, FlatIdx parent)
+	{
+		FlatIdx idx = (FlatIdx)_flat._funcs.size();
+		_funcIdx[pFunc] = idx;
+		_funcs.push_back(pFunc);
+
+		FuncInfo info;
+		info._name = pFunc->GetID();
+		info._parent = parent;
+		info._body = FLAT_NONE;
+
+		info._firstParam = (FlatIdx)_flat._vars.size();
+		info._nParams = pFunc->GetNumOfParams();
+		for (unsigned i = 0; i < info._nParams; ++i)
+			AddVar(pFunc->_params->_params[i].first, pFunc->_params->_params[i].second, false);
+
+		info._firstVar = (FlatIdx)_flat._vars.size();
+		info._nVars = (FlatIdx)pFunc->Vars.size();
+		for (auto &i : pFunc->Vars)
+			AddVar(i.first, i.second, parent == FLAT_NONE);
+
+		info._result = FLAT_NONE;
+		if (pFunc->_prtype->_type != Var::VOID)
+			info._result = AddVar(pFunc->GetID(), pFunc->_prtype, false);
+
+		_flat._funcs.push_back(info);
+
+		for (auto &i : pFunc->Funcs)
+			AddFunction(i.second, idx);
+	}
+
+	// Имена уже связаны с объявлениями (NameResolver), остается перейти к номерам
+	FlatIdx VarIdx(const Var *pVar)
+	{
+		auto it = _varIdx.find(pVar);
+		if (it == _varIdx.end())
+			throw std::exception("Variable is not declared in flat AST");
+		return it->second;
+	}
+
+	FlatIdx FuncIdx(const Function *pFunc)
+	{
+		auto it = _funcIdx.find(pFunc);
+		if (it == _funcIdx.end())
+			throw std::exception("Function is not declared in flat AST");
+		return it->second;
+	}
+
+	// Выражение записывается в обратном порядке по явному стеку,
+	// глубина вложенности не ограничена стеком вызовов
+	FlatIdx Expr(Expression *pRoot)
+	{
+		struct Item {
+			Expression *pEl;
+			unsigned next; // Номер следующего операнда
+			FlatIdx func; // Вызываемая функция
+			size_t base; // Начало номеров операндов в done
+		};
+		std::vector<Item> stack;
+		std::vector<FlatIdx> done; // Номера записанных операндов
+
+		Item root = { pRoot, 0, FLAT_NONE, 0 };
+		stack.push_back(root);
+
+		while (!stack.empty()) {
+			Item &item = stack.back();
+			Expression *pExpr = item.pEl;
+
+			if (pExpr->_type == Expression::E_FUNCCALL && item.func == FLAT_NONE) {
+				FuncCallExpr *pCall = static_cast<FuncCallExpr *>(pExpr);
+				item.func = FuncIdx(pCall->_pFunc);
+				if (_flat._funcs[item.func]._nParams != pCall->_params.size())
+					throw std::exception("Incorrect # arguments passed");
+			}
+
+			Expression *pNext = Operand(pExpr, item.next);
+			if (pNext != nullptr) {
+				item.next++;
+				Item child = { pNext, 0, FLAT_NONE, done.size() };
+				stack.push_back(child);
+				continue;
+			}
+
+			// Все операнды записаны
+			const FlatIdx *pOps = done.data() + item.base;
+			FlatIdx res;
+			switch (pExpr->_type) {
+			case Expression::E_CONST:
+			{
+				const Const *pC = static_cast<ExprConst *>(pExpr)->_val;
+				res = _flat.AddNode(F_CONST, _flat.AddConst(pC));
+				_flat._type[res] = (unsigned char)pC->_type;
+				break;
+			}
+			case Expression::E_ID:
+			{
+				ExprID *pID = static_cast<ExprID *>(pExpr);
+				res = _flat.AddNode(F_ID, VarIdx(pID->_pNode), pID->id);
+				break;
+			}
+			case Expression::E_BINARY:
+				res = _flat.AddNode(F_BINARY, pOps[0], pOps[1]);
+				_flat._op[res] = (unsigned char)static_cast<BinaryOp *>(pExpr)->_op;
+				break;
+			case Expression::E_COND:
+				res = _flat.AddNode(F_COND, pOps[0], pOps[1]);
+				_flat._op[res] = (unsigned char)static_cast<Condition *>(pExpr)->_op;
+				break;
+			case Expression::E_FUNCCALL:
+			{
+				const FuncInfo &info = _flat._funcs[item.func];
+				for (unsigned i = 0; i < item.next; ++i) {
+					if (_flat._vars[info._firstParam + i]._isRef) {
+						if (_flat._kind[pOps[i]] != F_ID)
+							throw std::exception("cannot pass by reference");
+						_flat._flags[pOps[i]] |= ADDR;
+					}
+				}
+
+				FlatIdx first = (FlatIdx)_flat._extra.size();
+				_flat._extra.insert(_flat._extra.end(), pOps, pOps + item.next);
+				res = _flat.AddNode(F_CALL, item.func, first, item.next);
+				break;
+			}
+			case Expression::E_INDEX:
+				res = _flat.AddNode(F_INDEX, VarIdx(static_cast<ExprIndex *>(pExpr)->_pNode), pOps[0]);
+				break;
+			default:
+				throw std::exception("undefined expression type");
+			}
+
+			if (pExpr->isNeg)
+				_flat._flags[res] |= NEG;
+
+			done.resize(item.base);
+			done.push_back(res);
+			stack.pop_back();
+		}
+
+		return done.back();
+	}
+
+	// Выражение оператора: отрезок [начало, корень] в _extra
+	FlatIdx ExprRef(Expression *pExpr)
+	{
+		FlatIdx begin = (FlatIdx)_flat.Size();
+		FlatIdx root = Expr(pExpr);
+		FlatIdx ref = (FlatIdx)_flat._extra.size();
+		_flat._extra.push_back(begin);
+		_flat._extra.push_back(root);
+		return ref;
+	}
+
+	FlatIdx Stmt(Statement *pStmt)
+	{
+		switch (pStmt->_type) {
+		case Statement::S_SEQ:
+		{
+			StatementSeq *pSeq = static_cast<StatementSeq *>(pStmt);
+			std::vector<FlatIdx> items;
+			items.reserve(pSeq->statements.size());
+			for (auto &i : pSeq->statements)
+				items.push_back(Stmt(i));
+
+			FlatIdx first = (FlatIdx)_flat._extra.size();
+			_flat._extra.insert(_flat._extra.end(), items.begin(), items.end());
+			return _flat.AddNode(F_SEQ, FLAT_NONE, first, (FlatIdx)items.size());
+		}
+		case Statement::S_IF:
+		{
+			IfStatement *pIf = static_cast<IfStatement *>(pStmt);
+			FlatIdx cond = ExprRef(pIf->_cond);
+			FlatIdx th = Stmt(pIf->_then);
+			FlatIdx el = pIf->_else != nullptr ? Stmt(pIf->_else) : FLAT_NONE;
+			return _flat.AddNode(F_IF, cond, th, el);
+		}
+		case Statement::S_WHILE:
+		{
+			WhileStatement *pWhile = static_cast<WhileStatement *>(pStmt);
+			FlatIdx cond = ExprRef(pWhile->_condition);
+			return _flat.AddNode(F_WHILE, cond, Stmt(pWhile->_st));
+		}
+		case Statement::S_REPEAT:
+		{
+			RepeatStatement *pRepeat = static_cast<RepeatStatement *>(pStmt);
+			FlatIdx body = Stmt(pRepeat->_st);
+			return _flat.AddNode(F_REPEAT, ExprRef(pRepeat->_condition), body);
+		}
+		case Statement::S_FOR:
+		{
+			ForStatement *pFor = static_cast<ForStatement *>(pStmt);
+			FlatIdx var = VarIdx(pFor->_pNode);
+			FlatIdx from = ExprRef(pFor->_from);
+			FlatIdx to = ExprRef(pFor->_to);
+			FlatIdx body = Stmt(pFor->_do);
+
+			FlatIdx first = (FlatIdx)_flat._extra.size();
+			_flat._extra.push_back(from);
+			_flat._extra.push_back(to);
+			_flat._extra.push_back(body);
+			FlatIdx res = _flat.AddNode(F_FOR, var, first);
+			_flat._op[res] = (unsigned char)pFor->_type;
+			return res;
+		}
+		case Statement::S_ASSIGN:
+		{
+			AssignStatement *pAssign = static_cast<AssignStatement *>(pStmt);
+			FlatIdx var = VarIdx(pAssign->_pNode);
+			return _flat.AddNode(F_ASSIGN, var, ExprRef(pAssign->_expr));
+		}
+		case Statement::S_PROCCALL:
+		{
+			ProcCallStatement *pCall = static_cast<ProcCallStatement *>(pStmt);
+			FuncCallExpr expr(pCall->_id, pCall->_params, pCall->_pFunc);
+			return _flat.AddNode(F_PROCCALL, ExprRef(&expr));
+		}
+		case Statement::S_EMPTY:
+			return _flat.AddNode(F_EMPTY);
+		default:
+			throw std::exception();
+		}
+	}
+};
+
+FlatIdx FlatAST::AddNode(KIND kind, FlatIdx a, FlatIdx b, FlatIdx c)
+{
+	FlatIdx idx = (FlatIdx)_kind.size();
+	_kind.push_back((unsigned char)kind);
+	_op.push_back(0);
+	_flags.push_back(0);
+	_type.push_back((unsigned char)Var::VOID);
+	_a.push_back(a);
+	_b.push_back(b);
+	_c.push_back(c);
+	return idx;
+}
+
+FlatIdx FlatAST::AddConst(const Const *pC)
+{
+	// Элементы таблицы уже в том же представлении, что и _consts
+	if (const ConstArray *pArr = NodeCast<ConstArray>(pC)) {
+		FlatIdx first = (FlatIdx)_consts.size();
+		_consts.insert(_consts.end(), pArr->_vals.begin(), pArr->_vals.end());
+		return first;
+	}
+
+	unsigned long long bits = 0;
+	switch (pC->_type) {
+	case Var::INTEGER:
+		bits = static_cast<const ConstInteger *>(pC)->_val;
+		break;
+	case Var::REAL:
+	{
+		double val = static_cast<const ConstReal *>(pC)->_val;
+		memcpy(&bits, &val, sizeof(bits));
+		break;
+	}
+	case Var::BOOLEAN:
+		bits = static_cast<const ConstBoolean *>(pC)->_val;
+		break;
+	default:
+		throw std::exception("undefined const expression");
+	}
+
+	_consts.push_back(bits);
+	return (FlatIdx)_consts.size() - 1;
+}
+
+double FlatAST::GetReal(FlatIdx c) const
+{
+	double res;
+	memcpy(&res, &_consts[c], sizeof(res));
+	return res;
+}
+
+void FlatAST::Build(Root *pRoot)
+{
+	Builder b(*this);
+	b.AddFunction(pRoot, FLAT_NONE);
+
+	for (FlatIdx i = 0; i < _funcs.size(); ++i)
+		_funcs[i]._body = b.Stmt(b._funcs[i]->seq);
+}
+
+void FlatAST::Check()
+{
+	// Дети записаны раньше родителей, поэтому к моменту обработки узла
+	// типы его операндов уже известны
+	for (FlatIdx i = 0; i < _kind.size(); ++i) {
+		switch (_kind[i]) {
+		case F_ID:
+			if (_vars[_a[i]]._size != 0)
+				throw std::exception("table used without index");
+			_type[i] = _vars[_a[i]]._type;
+			break;
+		case F_INDEX:
+			if (_vars[_a[i]]._size == 0)
+				throw std::exception("not an array");
+			if (_type[_b[i]] != Var::INTEGER && _type[_b[i]] != Var::CHAR)
+				throw std::exception("invalid index type");
+			_type[i] = _vars[_a[i]]._type;
+			break;
+		case F_BINARY:
+		{
+			unsigned char l = _type[_a[i]], r = _type[_b[i]];
+			if (l >= Var::VOID || r >= Var::VOID)
+				throw std::exception("invalid type");
+
+			unsigned char res = l > r ? r : l;
+			unsigned char op = _op[i];
+			if (op == BinaryOp::INT_DIV || op == BinaryOp::MOD || op == BinaryOp::AND || op == BinaryOp::OR) {
+				if (l == Var::REAL || r == Var::REAL)
+					throw std::exception("invalid type");
+			}
+			else if (op == BinaryOp::DIV)
+				res = Var::REAL;
+
+			_type[i] = res;
+			break;
+		}
+		case F_COND:
+			if (_op[i] == Condition::IN)
+				throw std::exception("not supported yet");
+			if (_type[_a[i]] >= Var::VOID)
+				throw std::exception("invalid type");
+			_type[i] = Var::BOOLEAN;
+			break;
+		case F_CALL:
+		{
+			FlatIdx res = _funcs[_a[i]]._result;
+			_type[i] = res != FLAT_NONE ? _vars[res]._type : (unsigned char)Var::VOID;
+			break;
+		}
+		case F_FOR:
+			if (_vars[_a[i]]._type != Var::INTEGER || _vars[_a[i]]._size != 0)
+				throw std::exception("incorrect variable type");
+			break;
+		case F_ASSIGN:
+			if (_vars[_a[i]]._size != 0)
+				throw std::exception("cannot assign to a table");
+			break;
+		}
+	}
+}
+
+size_t FlatAST::BytesUsed() const
+{
+	return _kind.size() * (4 * sizeof(unsigned char) + 3 * sizeof(FlatIdx))
+		+ _extra.size() * sizeof(FlatIdx)
+		+ _consts.size() * sizeof(unsigned long long)
+		+ _vars.size() * sizeof(VarInfo)
+		+ _funcs.size() * sizeof(FuncInfo);
+}
+
+void FlatAST::PrintStats(std::ostream &os) const
+{
+	size_t bytes = BytesUsed();
+	os << "Flat AST: " << Size() << " nodes, " << _extra.size() << " child refs, "
+		<< _vars.size() << " vars, " << _funcs.size() << " functions, " << bytes << " bytes ("
+		<< (Size() != 0 ? (double)bytes / Size() : 0.0) << " bytes/node)\n";
+}
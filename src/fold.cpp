@@ -0,0 +1,219 @@
+#include "fold.h"
+
+namespace {
+
+// Свернутый операнд; с унарным минусом операнд свернуть не удалось
+bool IsConstant(Expression *pEl, ConstValue &v)
+{
+	if (pEl->_type != Expression::E_CONST || pEl->isNeg)
+		return false;
+	v = ConstValue::Of(static_cast<ExprConst *>(pEl)->_val);
+	return true;
+}
+
+// По ссылке передается адрес переменной, а у подставляемых констант памяти нет
+void CheckRefArg(Expression *pArg)
+{
+	if (pArg->_type == Expression::E_ID && static_cast<ExprID *>(pArg)->_pNode->isConst)
+		throw std::exception("cannot pass constant by reference");
+}
+
+}
+
+void ConstFolder::Fold(Root *pRoot, bool evalCalls)
+{
+	if (evalCalls)
+		_eval.Analyze(pRoot);
+	FoldFunction(pRoot);
+}
+
+void ConstFolder::FoldFunction(Function *pFunc)
+{
+	if (pFunc->seq != nullptr)
+		DispatchStatement(pFunc->seq);
+
+	for (auto &i : pFunc->Funcs)
+		FoldFunction(i.second);
+}
+
+void ConstFolder::VisitSeq(StatementSeq *pEl)
+{
+	for (auto &i : pEl->statements)
+		DispatchStatement(i);
+}
+
+void ConstFolder::VisitIf(IfStatement *pEl)
+{
+	pEl->_cond = FoldExpression(pEl->_cond);
+	DispatchStatement(pEl->_then);
+	if (pEl->_else != nullptr)
+		DispatchStatement(pEl->_else);
+}
+
+void ConstFolder::VisitFor(ForStatement *pEl)
+{
+	pEl->_from = FoldExpression(pEl->_from);
+	pEl->_to = FoldExpression(pEl->_to);
+	DispatchStatement(pEl->_do);
+}
+
+void ConstFolder::VisitWhile(WhileStatement *pEl)
+{
+	pEl->_condition = FoldExpression(pEl->_condition);
+	DispatchStatement(pEl->_st);
+}
+
+void ConstFolder::VisitAssign(AssignStatement *pEl)
+{
+	pEl->_expr = FoldExpression(pEl->_expr);
+}
+
+void ConstFolder::VisitProcCall(ProcCallStatement *pEl)
+{
+	auto &params = pEl->_pFunc->_params->_params;
+	for (size_t i = 0; i < pEl->_params.size(); ++i) {
+		if (params[i].second->isRef)
+			CheckRefArg(pEl->_params[i]);
+		else
+			pEl->_params[i] = FoldExpression(pEl->_params[i]);
+	}
+}
+
+void ConstFolder::VisitRepeat(RepeatStatement *pEl)
+{
+	DispatchStatement(pEl->_st);
+	pEl->_condition = FoldExpression(pEl->_condition);
+}
+
+Expression ** ConstFolder::NextOperand(Expression *pEl, unsigned &next)
+{
+	Expression **ppOp;
+	while ((ppOp = OperandSlot(pEl, next++)) != nullptr) {
+		if (pEl->_type != Expression::E_FUNCCALL
+			|| !static_cast<FuncCallExpr *>(pEl)->_pFunc->_params->_params[next - 1].second->isRef)
+			return ppOp;
+		CheckRefArg(*ppOp);
+	}
+	return nullptr;
+}
+
+Expression * ConstFolder::FoldExpression(Expression *pRoot)
+{
+	// Типы считаются по исходному дереву: свертка их не меняет
+	pRoot->GetVar();
+
+	// Обратный обход по явному стеку, как в CodeGenerator::GenExpression
+	Expression *pRes = pRoot;
+	size_t base = _stack.size();
+	Frame root = { &pRes, 0 };
+	_stack.push_back(root);
+
+	while (_stack.size() > base) {
+		Frame &frame = _stack.back();
+		Expression **ppNext = NextOperand(*frame.ppSlot, frame.next);
+		if (ppNext != nullptr) {
+			Frame child = { ppNext, 0 };
+			_stack.push_back(child);
+			continue;
+		}
+
+		Expression **ppSlot = frame.ppSlot;
+		_stack.pop_back();
+		*ppSlot = FoldNode(*ppSlot);
+	}
+
+	return pRes;
+}
+
+Expression * ConstFolder::FoldNode(Expression *pEl)
+{
+	Var::TYPE type = pEl->GetVar()->_type;
+	// Константных узлов типа CHAR нет, такие значения остаются вычислениями
+	if (type == Var::CHAR)
+		return pEl;
+
+	ConstValue res = { type, 0, 0.0 };
+	switch (pEl->_type) {
+	case Expression::E_CONST:
+		if (!pEl->isNeg)
+			return pEl;
+		res = ConstValue::Of(static_cast<ExprConst *>(pEl)->_val);
+		break;
+	case Expression::E_ID:
+	{
+		Var *pNode = static_cast<ExprID *>(pEl)->_pNode;
+		if (!pNode->isConst)
+			return pEl;
+		++_refs;
+		// Без знака узел константы используется как есть
+		if (!pEl->isNeg)
+			return ArenaNew<ExprConst>(static_cast<Const *>(pNode));
+		res = ConstValue::Of(static_cast<Const *>(pNode));
+		break;
+	}
+	case Expression::E_BINARY:
+	{
+		BinaryOp *pOp = static_cast<BinaryOp *>(pEl);
+		ConstValue l, r;
+		if (!IsConstant(pOp->_left, l) || !IsConstant(pOp->_right, r) ||
+			!l.Cast(type) || !r.Cast(type) || !ConstValue::Apply(pOp->_op, type, l, r, res))
+			return pEl;
+		++_folded;
+		break;
+	}
+	case Expression::E_COND:
+	{
+		Condition *pCond = static_cast<Condition *>(pEl);
+		Var::TYPE best = Expression::GetBestType(pCond->_left->GetVar(), pCond->_right->GetVar())->_type;
+		ConstValue l, r;
+		if (!IsConstant(pCond->_left, l) || !IsConstant(pCond->_right, r) ||
+			!l.Cast(best) || !r.Cast(best) || !ConstValue::Compare(pCond->_op, l, r, res))
+			return pEl;
+		++_folded;
+		break;
+	}
+	case Expression::E_INDEX:
+	{
+		// Элемент таблицы с постоянным индексом; за границами индекс остается до выполнения
+		ExprIndex *pIndex = static_cast<ExprIndex *>(pEl);
+		ConstValue idx;
+		if (!IsConstant(pIndex->_index, idx) || !idx.Cast(Var::INTEGER) ||
+			!ConstValue::OfTable(pIndex->_pNode, idx._int, res))
+			return pEl;
+		++_folded;
+		break;
+	}
+	case Expression::E_FUNCCALL:
+	{
+		// Вызов чистой функции с постоянными аргументами вычисляется при компиляции
+		FuncCallExpr *pCall = static_cast<FuncCallExpr *>(pEl);
+		if (!_eval.IsPure(pCall->_pFunc))
+			return pEl;
+		std::vector<ConstValue> args(pCall->_params.size());
+		for (size_t i = 0; i < args.size(); ++i) {
+			if (!IsConstant(pCall->_params[i], args[i]) ||
+				!args[i].Cast(pCall->_pFunc->_params->_params[i].second->_type))
+				return pEl;
+		}
+		if (!_eval.Call(pCall->_pFunc, args, res))
+			return pEl;
+		++_calls;
+		break;
+	}
+	default:
+		return pEl;
+	}
+
+	if (pEl->isNeg)
+		res.Negate();
+
+	return ArenaNew<ExprConst>(res.MakeConst());
+}
+
+Const * ConstFolder::Evaluate(Expression *pExpr)
+{
+	ConstValue v;
+	if (!IsConstant(FoldExpression(pExpr), v))
+		return nullptr;
+	return v.MakeConst();
+}
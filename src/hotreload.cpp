@@ -0,0 +1,270 @@
+#include "hotreload.h"
+#include "fold.h"
+#include "resolver.h"
+
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+bool GetSourceStamp(const std::string &path, unsigned long long &time, unsigned long long &size)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+		return false;
+	time = ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+	size = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	return true;
+}
+
+#else
+
+bool GetSourceStamp(const std::string &path, unsigned long long &time, unsigned long long &size)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+	// Секунд мало: файл, сохраненный дважды за секунду с тем же размером, не был бы замечен
+#ifdef __APPLE__
+	time = (unsigned long long)st.st_mtimespec.tv_sec * 1000000000ULL + st.st_mtimespec.tv_nsec;
+#else
+	time = (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+#endif
+	size = (unsigned long long)st.st_size;
+	return true;
+}
+
+#endif
+
+namespace {
+
+// 64-битный FNV-1a
+struct Hasher {
+	unsigned long long _h;
+
+	Hasher() : _h(14695981039346656037ULL) {}
+
+	void Add(const void *data, size_t size)
+	{
+		const unsigned char *p = (const unsigned char *)data;
+		for (size_t i = 0; i < size; ++i)
+		{
+			_h ^= p[i];
+			_h *= 1099511628211ULL;
+		}
+	}
+
+	void Add(unsigned long long v) { Add(&v, sizeof(v)); }
+};
+
+// Лексемы [begin, end) без номеров строк: пустые строки и отступы ключей не меняют
+void HashTokens(const Parser &P, size_t begin, size_t end, Hasher &h)
+{
+	for (size_t i = begin; i < end; ++i)
+	{
+		const TokenInfo &t = P._pTokens[i];
+		h.Add((unsigned long long)t._tok);
+		h.Add((unsigned long long)(unsigned)t._subKind);
+		if (t._tok == T_ID)
+			h.Add((unsigned long long)t._symbol);
+		else
+			h.Add(P._buf + t._offset, t._length);
+	}
+}
+
+bool ReadSource(const std::string &path, std::string &source)
+{
+	ifstream input(path, ios::in | ios::binary);
+	if (!input)
+		return false;
+	ostringstream ss;
+	ss << input.rdbuf();
+	source = ss.str();
+	return true;
+}
+
+}
+
+HotReloader::HotReloader(const std::string &path, unsigned nThreads)
+	: _path(path), _nThreads(nThreads), _interface(0), _rebuilt(0), _reused(0) {}
+
+void HotReloader::ComputeKeys(const Parser &P, std::vector<unsigned long long> &keys,
+	std::vector<unsigned long long> &declKeys, unsigned long long &iface) const
+{
+	const auto &R = P._routines;
+	size_t n = R.size();
+
+	std::vector<std::vector<size_t>> children(n);
+	for (size_t i = 1; i < n; ++i)
+		children[R[i].parent].push_back(i);
+
+	// Заголовок, собственные объявления (без вложенных подпрограмм) и тело каждой подпрограммы
+	std::vector<unsigned long long> header(n), body(n);
+	declKeys.assign(n, 0);
+	Hasher all;
+	for (size_t i = 0; i < n; ++i)
+	{
+		Hasher h;
+		HashTokens(P, R[i].begin, R[i].decls, h);
+		header[i] = h._h;
+		all.Add(header[i]);
+
+		Hasher d;
+		size_t pos = R[i].decls;
+		for (auto c : children[i])
+		{
+			HashTokens(P, pos, R[c].begin, d);
+			pos = R[c].end;
+		}
+		HashTokens(P, pos, R[i].body, d);
+		declKeys[i] = d._h;
+
+		Hasher b;
+		HashTokens(P, R[i].body, R[i].end, b);
+		body[i] = b._h;
+	}
+	iface = all._h;
+
+	// Объемлющие подпрограммы всегда раньше вложенных, так что хеш цепочки объявлений
+	// родителя уже посчитан
+	std::vector<unsigned long long> scope(n);
+	keys.assign(n, 0);
+	for (size_t i = 0; i < n; ++i)
+	{
+		Hasher s;
+		if (R[i].parent != (size_t)-1)
+			s.Add(scope[R[i].parent]);
+		s.Add(declKeys[i]);
+		scope[i] = s._h;
+
+		Hasher k;
+		k.Add(iface);
+		k.Add(scope[i]);
+		k.Add(header[i]);
+		k.Add(body[i]);
+		keys[i] = k._h;
+	}
+}
+
+bool HotReloader::Load(CodeGenerator *pGen)
+{
+	std::string source;
+	if (!ReadSource(_path, source))
+	{
+		cout << "Incorrect file path\n";
+		return false;
+	}
+
+	std::unique_ptr<Parser> P(new Parser(source.data(), source.size(), _nThreads));
+	P->ParseHeaders();
+
+	// Модули не собираются и не компонуются при перезагрузке, а без них uses
+	// выглядел бы как обычная ошибка разбора
+	for (size_t i = 0; i < P->_nTokens; ++i)
+	{
+		if (P->_pTokens[i]._tok == T_USES)
+		{
+			cout << "Units (uses) are not supported in watch mode" << endl;
+			return false;
+		}
+	}
+
+	// Тела подпрограмм с прежним ключом не разбираются
+	std::vector<unsigned long long> keys, declKeys;
+	unsigned long long iface = 0;
+	bool incremental = false;
+	if (P->IsSuccess())
+	{
+		ComputeKeys(*P, keys, declKeys, iface);
+		incremental = _parser != nullptr && iface == _interface && keys.size() == _keys.size();
+		for (size_t i = 0; incremental && i < keys.size(); ++i)
+		{
+			size_t job = P->_routines[i].job;
+			if (keys[i] == _keys[i] && job != (size_t)-1)
+				P->_bodies[job].skip = true;
+		}
+	}
+	P->ParseBodies();
+	if (!P->IsSuccess())
+	{
+		cout << "Parser failed... :(" << endl;
+		return false;
+	}
+
+	// Связываются только разобранные тела; пропущенные остались в модуле прошлой сборки
+	try
+	{
+		NameResolver resolver;
+		resolver.Resolve(P->_ast);
+		// Вызовы не вычисляются: иначе результат зависел бы от тел других подпрограмм,
+		// а перестраиваются только подпрограммы с изменившимся ключом
+		ArenaScope arenaScope(&P->_arena);
+		ConstFolder folder;
+		folder.Fold(P->_ast, false);
+	}
+	catch (std::exception &ex)
+	{
+		cout << "Semantic analysis failed: " << ex.what() << endl;
+		return false;
+	}
+
+	bool Success;
+	std::vector<Function *> funcs;
+	if (incremental)
+	{
+		// Заголовки совпадают, поэтому подпрограммы старого и нового дерева идут в одном порядке
+		std::vector<std::pair<ScopableNode *, ScopableNode *>> rebind;
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			Function *pOld = _parser->_routines[i].pFunc;
+			Function *pNew = P->_routines[i].pFunc;
+			rebind.push_back(std::make_pair(pOld, pNew));
+			if (declKeys[i] == _declKeys[i])
+			{
+				for (size_t v = 0; v < pNew->Vars.size(); ++v)
+					rebind.push_back(std::make_pair(pOld->Vars[v].second, pNew->Vars[v].second));
+			}
+			if (keys[i] != _keys[i])
+				funcs.push_back(pNew);
+		}
+		Success = pGen->Regenerate(P.get(), rebind, funcs);
+	}
+	else
+		Success = pGen->Generate(P.get());
+
+	if (!Success)
+	{
+		// Модуль мог остаться наполовину перестроенным
+		_parser.reset();
+		_keys.clear();
+		return false;
+	}
+
+	if (incremental)
+	{
+		for (auto pFunc : funcs)
+			pGen->Dump(pFunc);
+		_rebuilt = funcs.size();
+	}
+	else
+	{
+		pGen->Dump();
+		_rebuilt = keys.size();
+	}
+	_reused = keys.size() - _rebuilt;
+	cout << "Reload: " << _rebuilt << " routines rebuilt, " << _reused << " reused" << endl;
+
+	_parser = std::move(P);
+	_keys.swap(keys);
+	_declKeys.swap(declKeys);
+	_interface = iface;
+	return true;
+}
@@ -0,0 +1,196 @@
+#include "jitcache.h"
+#include "astcache.h"
+
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#else
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const size_t TRAILER_SIZE = 8;
+
+const char OBJECT_SUFFIX[] = ".o";
+
+// Хеш в хвосте записи, младшими байтами вперед
+void PutTrailer(char *p, unsigned long long v)
+{
+	for (size_t i = 0; i < TRAILER_SIZE; ++i)
+		p[i] = (char)(v >> (8 * i));
+}
+
+unsigned long long GetTrailer(const char *p)
+{
+	unsigned long long v = 0;
+	for (size_t i = 0; i < TRAILER_SIZE; ++i)
+		v |= (unsigned long long)(unsigned char)p[i] << (8 * i);
+	return v;
+}
+
+bool EndsWith(const string &s, const char *suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Записи каталога: время изменения, размер, путь
+struct Entry {
+	long long time;
+	unsigned long long size;
+	string path;
+
+	bool operator<(const Entry &other) const { return time < other.time; }
+};
+
+vector<Entry> ListEntries(const string &dir)
+{
+	vector<Entry> entries;
+	error_code ec;
+	for (llvm::sys::fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		const string &path = it->path();
+		struct stat st;
+		if (EndsWith(path, OBJECT_SUFFIX) && stat(path.c_str(), &st) == 0) {
+			Entry e = { (long long)st.st_mtime, (unsigned long long)st.st_size, path };
+			entries.push_back(e);
+		}
+	}
+	return entries;
+}
+
+}
+
+JitCache::JitCache(const string &dir, unsigned long long capacity, const string &target)
+	: _dir(dir), _capacity(capacity), _target(target), _pKeyModule(nullptr), _key(0), _hits(0), _misses(0)
+{
+}
+
+unsigned long long JitCache::Key(const llvm::Module *M)
+{
+	if (M == _pKeyModule)
+		return _key;
+	string image;
+	{
+		llvm::raw_string_ostream os(image);
+		llvm::WriteBitcodeToFile(M, os);
+	}
+	ostringstream target;
+	target << VERSION << '\n' << _target << '\n';
+	image += target.str();
+	_pKeyModule = M;
+	_key = AstCache::HashSource(image.data(), image.size());
+	return _key;
+}
+
+string JitCache::PathFor(unsigned long long key) const
+{
+	ostringstream os;
+	os << _dir << '/' << hex << setw(16) << setfill('0') << key << OBJECT_SUFFIX;
+	return os.str();
+}
+
+llvm::MemoryBuffer *JitCache::getObject(const llvm::Module *M)
+{
+	string path = PathFor(Key(M));
+	llvm::ErrorOr<unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFile(path);
+	if (buffer) {
+		const char *data = buffer.get()->getBufferStart();
+		size_t size = buffer.get()->getBufferSize();
+		if (size > TRAILER_SIZE && AstCache::HashSource(data, size - TRAILER_SIZE) == GetTrailer(data + size - TRAILER_SIZE)) {
+			++_hits;
+			// Время изменения - время последнего использования для вытеснения
+#ifdef _WIN32
+			_utime(path.c_str(), nullptr);
+#else
+			utime(path.c_str(), nullptr);
+#endif
+			return llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef(data, size - TRAILER_SIZE), path);
+		}
+	}
+	// Запись отсутствует или испорчена: MCJIT скомпилирует модуль и отдаст объект
+	++_misses;
+	return nullptr;
+}
+
+void JitCache::notifyObjectCompiled(const llvm::Module *M, const llvm::MemoryBuffer *Obj)
+{
+#ifdef _WIN32
+	_mkdir(_dir.c_str());
+	int pid = _getpid();
+#else
+	mkdir(_dir.c_str(), 0777);
+	int pid = (int)getpid();
+#endif
+
+	// Как в AstCache::Store: другой процесс не увидит недописанную запись
+	string path = PathFor(Key(M));
+	ostringstream tmp;
+	tmp << path << '.' << pid << ".tmp";
+
+	char trailer[TRAILER_SIZE];
+	PutTrailer(trailer, AstCache::HashSource(Obj->getBufferStart(), Obj->getBufferSize()));
+	ofstream out(tmp.str(), ios::out | ios::binary | ios::trunc);
+	out.write(Obj->getBufferStart(), Obj->getBufferSize());
+	out.write(trailer, TRAILER_SIZE);
+	out.close();
+	if (!out) {
+		remove(tmp.str().c_str());
+		return;
+	}
+	if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+		// rename в Windows не заменяет существующий файл
+		remove(path.c_str());
+		if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+			remove(tmp.str().c_str());
+			return;
+		}
+	}
+	Evict(path);
+}
+
+void JitCache::Evict(const string &keep) const
+{
+	vector<Entry> entries = ListEntries(_dir);
+	unsigned long long total = 0;
+	for (auto &i : entries)
+		total += i.size;
+	if (total <= _capacity)
+		return;
+
+	// Запись, которую другой процесс удалил раньше или еще читает (Windows), просто пропускается
+	sort(entries.begin(), entries.end());
+	for (auto &i : entries) {
+		if (total <= _capacity)
+			break;
+		if (i.path != keep && remove(i.path.c_str()) == 0)
+			total -= i.size;
+	}
+}
+
+void JitCache::Usage(size_t &entries, unsigned long long &bytes) const
+{
+	vector<Entry> list = ListEntries(_dir);
+	entries = list.size();
+	bytes = 0;
+	for (auto &i : list)
+		bytes += i.size;
+}
@@ -0,0 +1,116 @@
+#include "keywords.h"
+
+#define NO_KW { "", 0, T_ID, -1 }
+
+// Записи лежат в ячейках, номера которых дает KeywordHash
+const Keyword KEYWORD_TABLE[KEYWORD_TABLE_SIZE] = {
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 0-7
+	{ "const", 5, T_CONST, -1 }, // 8
+	{ "label", 5, T_LABEL, -1 }, // 9
+	{ "true", 4, T_TRUE, -1 }, // 10
+	{ "implementation", 14, T_IMPLEMENTATION, -1 }, // 11
+	NO_KW, // 12
+	{ "for", 3, T_FOR, -1 }, // 13
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 14-21
+	NO_KW, NO_KW, NO_KW, // 22-24
+	{ "nil", 3, T_NIL, -1 }, // 25
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 26-30
+	{ "*", 1, T_FACTOROP, BinaryOp::MUL }, // 31
+	NO_KW, NO_KW, NO_KW, // 32-34
+	{ "div", 3, T_FACTOROP, BinaryOp::INT_DIV }, // 35
+	NO_KW, NO_KW, // 36-37
+	{ "while", 5, T_WHILE, -1 }, // 38
+	NO_KW, // 39
+	{ "array", 5, T_ARRAY, -1 }, // 40
+	NO_KW, NO_KW, NO_KW, // 41-43
+	{ "integer", 7, T_VARTYPE, Var::INTEGER }, // 44
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 45-49
+	{ "+", 1, T_TERMOP, BinaryOp::ADD }, // 50
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 51-56
+	{ "program", 7, T_PROGRAM, -1 }, // 57
+	NO_KW, NO_KW, NO_KW, NO_KW, // 58-61
+	{ "real", 4, T_VARTYPE, Var::REAL }, // 62
+	NO_KW, NO_KW, NO_KW, NO_KW, // 63-66
+	{ "with", 4, T_RESERVED, -1 }, // 67
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 68-75
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 76-83
+	{ "and", 3, T_FACTOROP, BinaryOp::AND }, // 84
+	NO_KW, NO_KW, NO_KW, // 85-87
+	{ "-", 1, T_TERMOP, BinaryOp::SUB }, // 88
+	NO_KW, // 89
+	{ "until", 5, T_UNTIL, -1 }, // 90
+	NO_KW, NO_KW, // 91-92
+	{ "or", 2, T_TERMOP, BinaryOp::OR }, // 93
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 94-99
+	{ "then", 4, T_THEN, -1 }, // 100
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 101-107
+	{ "to", 2, T_TO, -1 }, // 108
+	NO_KW, NO_KW, NO_KW, NO_KW, // 109-112
+	{ "case", 4, T_RESERVED, -1 }, // 113
+	NO_KW, NO_KW, NO_KW, // 114-116
+	{ "<", 1, T_COND, Condition::LT }, // 117
+	NO_KW, NO_KW, // 118-119
+	{ "end", 3, T_END, -1 }, // 120
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 121-125
+	{ "/", 1, T_FACTOROP, BinaryOp::DIV }, // 126
+	NO_KW, // 127
+	{ "<=", 2, T_COND, Condition::LE }, // 128
+	NO_KW, NO_KW, // 129-130
+	{ "else", 4, T_ELSE, -1 }, // 131
+	NO_KW, NO_KW, NO_KW, NO_KW, // 132-135
+	{ "=", 1, T_COND, Condition::EQ }, // 136
+	NO_KW, // 137
+	{ "<>", 2, T_COND, Condition::NEQ }, // 138
+	NO_KW, // 139
+	{ "file", 4, T_RESERVED, -1 }, // 140
+	{ "false", 5, T_FALSE, -1 }, // 141
+	NO_KW, NO_KW, // 142-143
+	{ "repeat", 6, T_REPEAT, -1 }, // 144
+	NO_KW, // 145
+	{ ">=", 2, T_COND, Condition::GE }, // 146
+	NO_KW, NO_KW, NO_KW, // 147-149
+	{ "set", 3, T_RESERVED, -1 }, // 150
+	NO_KW, NO_KW, NO_KW, NO_KW, // 151-154
+	{ ">", 1, T_COND, Condition::GT }, // 155
+	NO_KW, // 156
+	{ "var", 3, T_VAR, -1 }, // 157
+	NO_KW, // 158
+	{ "uses", 4, T_USES, -1 }, // 159
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 160-167
+	NO_KW, // 168
+	{ "unit", 4, T_UNIT, -1 }, // 169
+	NO_KW, NO_KW, // 170-171
+	{ "interface", 9, T_INTERFACE, -1 }, // 172
+	NO_KW, NO_KW, // 173-174
+	{ "if", 2, T_IF, -1 }, // 175
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 176-183
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 184-191
+	{ "mod", 3, T_FACTOROP, BinaryOp::MOD }, // 192
+	NO_KW, NO_KW, // 193-194
+	{ "begin", 5, T_BEGIN, -1 }, // 195
+	NO_KW, // 196
+	{ "boolean", 7, T_VARTYPE, Var::BOOLEAN }, // 197
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 198-205
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 206-213
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 214-219
+	{ "do", 2, T_DO, -1 }, // 220
+	NO_KW, // 221
+	{ "packed", 6, T_RESERVED, -1 }, // 222
+	NO_KW, // 223
+	{ "downto", 6, T_DOWNTO, -1 }, // 224
+	NO_KW, NO_KW, NO_KW, NO_KW, // 225-228
+	{ "of", 2, T_OF, -1 }, // 229
+	NO_KW, NO_KW, NO_KW, NO_KW, // 230-233
+	{ "function", 8, T_FUNC, -1 }, // 234
+	{ "procedure", 9, T_PROC, -1 }, // 235
+	NO_KW, NO_KW, NO_KW, NO_KW, // 236-239
+	{ "record", 6, T_RESERVED, -1 }, // 240
+	NO_KW, NO_KW, // 241-242
+	{ "char", 4, T_VARTYPE, Var::CHAR }, // 243
+	NO_KW, NO_KW, NO_KW, NO_KW, NO_KW, // 244-248
+	{ "goto", 4, T_RESERVED, -1 }, // 249
+	NO_KW, // 250
+	{ "^", 1, T_FACTOROP, BinaryOp::AND }, // 251
+	NO_KW, NO_KW, NO_KW, // 252-254
+	{ "in", 2, T_COND, Condition::IN }, // 255
+};
@@ -1,120 +1,98 @@
-#include "parser.h"
+#include "keywords.h"
+#include "scan.h"
 
 static int isNewline(int c) { return (c == '\n' || c == '\r'); }
 static int isSpace(int c) { return (c == ' ' || c == '\t'); }
+static int isOpChar(int c)
+{
+	switch (c) {
+	case '+': case '-': case '*': case '/': case '^':
+	case '=': case '<': case '>':
+		return 1;
+	default:
+		return 0;
+	}
+}
 
-Token Lexer::GetToken()
+//          -
+Token Lexer::Classify(const char *s, size_t len)
 {
+	const Keyword *pKw = FindKeyword(s, len);
+	if (pKw == nullptr)
+	{
+		_subKind = -1;
+		return T_ID;
+	}
+	if (pKw->_tok == T_RESERVED)
+		throw std::exception();
+	_subKind = pKw->_subKind;
+	return pKw->_tok;
+}
+
+Token Lexer::GetStreamToken()
+{
+	_subKind = -1;
 	//  
 	while (isNewline(_lastChar) || isSpace(_lastChar))
 	{
 		if (isNewline(_lastChar))
 			_curLine++;
-		_lastChar = _input.get();
+		_lastChar = _input->get();
 	}
 	//       
 	if (isalpha(_lastChar)) {
 		_stringValue = _lastChar;
-		while (isalnum((_lastChar = _input.get())))
+		while (isalnum((_lastChar = _input->get())))
 			_stringValue += _lastChar;
-		if (TYPE_NAMES.find(_stringValue) != TYPE_NAMES.end())
-			return T_VARTYPE;
-		else if (COND_NAMES.find(_stringValue) != COND_NAMES.end())
-			return T_COND;
-		else if (FACTOR_NAMES.find(_stringValue) != FACTOR_NAMES.end())
-			return T_FACTOROP;
-		else if (TERM_NAMES.find(_stringValue) != TERM_NAMES.end())
-			return T_TERMOP;
-		else if (NAMES.find(_stringValue) == NAMES.end())
-			return T_ID;
-		else if (_stringValue == "if")
-			return T_IF;
-		else if (_stringValue == "else")
-			return T_ELSE;
-		else if (_stringValue == "then")
-			return T_THEN;
-		else if (_stringValue == "begin")
-			return T_BEGIN;
-		else if (_stringValue == "end")
-			return T_END;
-		else if (_stringValue == "nil")
-			return T_NIL;
-		else if (_stringValue == "const")
-			return T_CONST;
-		else if (_stringValue == "function")
-			return T_FUNC;
-		else if (_stringValue == "procedure")
-			return T_PROC;
-		else if (_stringValue == "var")
-			return T_VAR;
-		else if (_stringValue == "program")
-			return T_PROGRAM;
-		else if (_stringValue == "label")
-			return T_LABEL;
-		else if (_stringValue == "for")
-			return T_FOR;
-		else if (_stringValue == "to")
-			return T_TO;
-		else if (_stringValue == "downto")
-			return T_DOWNTO;
-		else if (_stringValue == "do")
-			return T_DO;
-		else if (_stringValue == "while")
-			return T_WHILE;
-		else if (_stringValue == "while")
-			return T_WHILE;
-		else if (_stringValue == "repeat")
-			return T_REPEAT;
-		else if (_stringValue == "until")
-			return T_UNTIL;
-		else if (_stringValue == "true")
-			return T_TRUE;
-		else if (_stringValue == "false")
-			return T_FALSE;
+		Token tok = Classify(_stringValue.data(), _stringValue.size());
+		if (tok == T_ID)
+			_symbol = _pSymbols->Intern(_stringValue);
+		return tok;
 	}
 	// 
 	else if (_lastChar == '\'')
 	{
 		_stringValue = "";
-		_lastChar = _input.get();
-		while (_lastChar != '\'' && !_input.eof())
+		_lastChar = _input->get();
+		while (_lastChar != '\'' && !_input->eof())
 		{
 			if (_lastChar == '\n')
 				_curLine++;
 			_stringValue += _lastChar;
-			_lastChar = _input.get();
+			_lastChar = _input->get();
 		}
 		if (_lastChar != '\'')
 			throw std::exception();
-		_lastChar = _input.get();
+		_lastChar = _input->get();
 		return T_STRING;
 	}
 	// 
 	else if (isdigit(_lastChar)) {
 		_stringValue = _lastChar;
-		while (isdigit((_lastChar = _input.get())))
+		while (isdigit((_lastChar = _input->get())))
 			_stringValue += _lastChar;
-		if (_lastChar == '.')
+		// "1..5" -  ,    
+		if (_lastChar == '.' && _input->peek() != '.')
 		{
 			_stringValue += _lastChar;
-			while (isdigit((_lastChar = _input.get())))
+			while (isdigit((_lastChar = _input->get())))
 				_stringValue += _lastChar;
 		}
 		if (_lastChar == 'E')
 		{
 			_stringValue += _lastChar;
-			_lastChar = _input.get();
+			_lastChar = _input->get();
 			if (_lastChar == '+' || _lastChar == '-')
 			{
 				_stringValue += _lastChar;
-				_lastChar = _input.get();
+				_lastChar = _input->get();
 			}
 			if (isdigit(_lastChar))
 			{
 				do
 				{
 					_stringValue += _lastChar;
-					_lastChar = _input.get();
+					_lastChar = _input->get();
 
 				} while (isdigit(_lastChar));
 			}
@@ -127,29 +105,29 @@ Token Lexer::GetToken()
 	else if (_lastChar == '(')
 	{
 		_stringValue = _lastChar;
-		_lastChar = _input.get();
+		_lastChar = _input->get();
 		return T_LBR;
 	}
 	else if (_lastChar == ')')
 	{
 		_stringValue = _lastChar;
-		_lastChar = _input.get();
+		_lastChar = _input->get();
 		return T_RBR;
 	}
 	else if (_lastChar == ';')
 	{
 		_stringValue = _lastChar;
-		_lastChar = _input.get();
+		_lastChar = _input->get();
 		return T_SEMICOLON;
 	}
 	else if (_lastChar == ':')
 	{
 		_stringValue = _lastChar;
-		_lastChar = _input.get();
+		_lastChar = _input->get();
 		if (_lastChar == '=')
 		{
 			_stringValue += _lastChar;
-			_lastChar = _input.get();
+			_lastChar = _input->get();
 			return T_ASSIGN;
 		}
 		else
@@ -158,38 +136,168 @@ Token Lexer::GetToken()
 	else if (_lastChar == ',')
 	{
 		_stringValue = _lastChar;
-		_lastChar = _input.get();
+		_lastChar = _input->get();
 		return T_COMMA;
 	}
-	else if (_lastChar == '~')
+	else if (_lastChar == '[')
 	{
 		_stringValue = _lastChar;
-		_lastChar = _input.get();
-		return T_NEG;
+		_lastChar = _input->get();
+		return T_LSBR;
 	}
-	else if (TERM_NAMES.find((_stringValue = _lastChar)) != TERM_NAMES.end())
+	else if (_lastChar == ']')
 	{
 		_stringValue = _lastChar;
-		_lastChar = _input.get();
-		return T_TERMOP;
+		_lastChar = _input->get();
+		return T_RSBR;
 	}
-	else if (FACTOR_NAMES.find((_stringValue = _lastChar)) != FACTOR_NAMES.end())
+	else if (_lastChar == '.')
 	{
 		_stringValue = _lastChar;
-		_lastChar = _input.get();
-		return T_FACTOROP;
+		_lastChar = _input->get();
+		if (_lastChar != '.')
+			throw std::exception();
+		_stringValue += _lastChar;
+		_lastChar = _input->get();
+		return T_DOTDOT;
+	}
+	else if (_lastChar == '~')
+	{
+		_stringValue = _lastChar;
+		_lastChar = _input->get();
+		return T_NEG;
 	}
-	else if (COND_NAMES.find((_stringValue = _lastChar)) != COND_NAMES.end())
+	else if (isOpChar(_lastChar))
 	{
 		_stringValue = _lastChar;
-		if ((_lastChar == '>' || _lastChar == '<') && ((_lastChar = _input.get()) == '='))
+		int c = _lastChar;
+		_lastChar = _input->get();
+		if (((c == '>' || c == '<') && _lastChar == '=') || (c == '<' && _lastChar == '>'))
+		{
 			_stringValue += _lastChar;
-		_lastChar = _input.get();
-		return T_COND;
+			_lastChar = _input->get();
+		}
+		return Classify(_stringValue.data(), _stringValue.size());
 	}
 	// ,       .
-	if (_input.eof())
+	if (_input->eof())
 		return T_EOF;
 
 	throw std::exception();
-}
\ No newline at end of file
+}
+
+//     ("implementation");     
+static const size_t MAX_KEYWORD_LEN = 14;
+
+static inline bool isAlpha(unsigned char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+static inline bool isDigit(unsigned char c) { return c >= '0' && c <= '9'; }
+
+Token Lexer::GetBufferToken()
+{
+	const char *p = _cur;
+	const char *end = _end;
+
+	//  
+	p = g_Scan.SkipSpaces(p, end, _curLine);
+
+	_tokOffset = p - _buf;
+	// ,       .
+	if (p == end)
+	{
+		_cur = p;
+		_tokLength = 0;
+		return T_EOF;
+	}
+
+	const char *start = p;
+	Token tok;
+	_subKind = -1;
+	unsigned char c = *p;
+
+	//       
+	if (isAlpha(c))
+	{
+		p = g_Scan.SkipAlnum(p + 1, end);
+		tok = T_ID;
+		if ((size_t)(p - start) <= MAX_KEYWORD_LEN)
+			tok = Classify(start, p - start);
+		if (tok == T_ID)
+			_symbol = _pSymbols->Intern(start, p - start);
+	}
+	// 
+	else if (c == '\'')
+	{
+		++start;
+		++_tokOffset;
+		while (++p < end && *p != '\'')
+		{
+			if (*p == '\n')
+				_curLine++;
+		}
+		if (p == end)
+			throw std::exception();
+		_tokLength = p - start;
+		_cur = p + 1;
+		return T_STRING;
+	}
+	// 
+	else if (isDigit(c))
+	{
+		p = g_Scan.SkipDigits(p + 1, end);
+		// "1..5" -  ,    
+		if (p < end && *p == '.' && !(p + 1 < end && p[1] == '.'))
+			p = g_Scan.SkipDigits(p + 1, end);
+		if (p < end && *p == 'E')
+		{
+			++p;
+			if (p < end && (*p == '+' || *p == '-'))
+				++p;
+			if (p == end || !isDigit(*p))
+				throw std::exception();
+			p = g_Scan.SkipDigits(p + 1, end);
+		}
+		tok = T_UNUMBER;
+	}
+	else
+	{
+		++p;
+		switch (c)
+		{
+		case '(': tok = T_LBR; break;
+		case ')': tok = T_RBR; break;
+		case ';': tok = T_SEMICOLON; break;
+		case ',': tok = T_COMMA; break;
+		case '~': tok = T_NEG; break;
+		case '[': tok = T_LSBR; break;
+		case ']': tok = T_RSBR; break;
+		case '.':
+			if (p == end || *p != '.')
+				throw std::exception();
+			++p;
+			tok = T_DOTDOT;
+			break;
+		case ':':
+			tok = T_COLON;
+			if (p < end && *p == '=')
+			{
+				++p;
+				tok = T_ASSIGN;
+			}
+			break;
+		case '<':
+		case '>':
+			if (p < end && (*p == '=' || (c == '<' && *p == '>')))
+				++p;
+			tok = Classify(start, p - start);
+			break;
+		default:
+			if (!isOpChar(c))
+				throw std::exception();
+			tok = Classify(start, 1);
+		}
+	}
+
+	_tokLength = p - start;
+	_cur = p;
+	return tok;
+}
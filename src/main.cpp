@@ -1,42 +1,453 @@
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
 
+#include "aot.h"
+#include "astcache.h"
+#include "callgraph.h"
 #include "codegen.h"
+#include "fold.h"
+#include "hotreload.h"
+#include "jitcache.h"
+#include "mappedfile.h"
 #include "parser.h"
+#include "resolver.h"
+#include "tiering.h"
+#include "units.h"
+#include "vm.h"
+
+static void Usage() {
+  std::cout << "Usage: Pascal-compiler [-j[N]] [-O0|-O1|-O2|-O3|-Os] [--flat] [--arena-stats] [--lookup-stats]\n"
+               "                        [--routine-stats] [--keep-unused] [--ast-cache[=DIR]] [--unit-dir=DIR]\n"
+               "                        [--unit-stats] [--vm] [--tiered[=N]] [--dump-bytecode] [--eager-jit]\n"
+               "                        [--emit-obj=FILE] [--emit-exe=FILE] [--jit-cache[=DIR]]\n"
+               "                        [--jit-cache-size=MB] [--jit-cache-stats] [--watch] <file.pas | ->\n"
+               "  -j[N]          tokenize the file and parse routine bodies in N threads,\n"
+               "                 compile changed units in N threads (default: all cores)\n"
+               "  -O0 .. -O3, -Os optimization level (default: -O2): -O0 skips optimization\n"
+               "                 for the fastest start, -O1 optimizes each routine, -O2 adds\n"
+               "                 inlining and loop optimizations of the whole program, -O3\n"
+               "                 optimizes more aggressively, -Os like -O2 but prefers smaller code\n"
+               "  --flat         generate code from the flattened index-based AST\n"
+               "  --arena-stats  print AST memory usage after compilation\n"
+               "  --lookup-stats print the number of name lookups per compilation stage\n"
+               "  --routine-stats print the number of generated, removed and compiled routines\n"
+               "                 and the estimated code generation time saved\n"
+               "  --keep-unused  generate routines that are never called\n"
+               "  --ast-cache[=DIR] load the syntax tree of an unchanged file from DIR\n"
+               "                 (default: .astcache) instead of parsing it, save it otherwise\n"
+               "  --unit-dir=DIR keep compiled units in DIR (default: .units); units from\n"
+               "                 uses are read from <unit>.pas next to the program\n"
+               "  --unit-stats   print the number of units compiled and up to date\n"
+               "  --vm           run the program in the bytecode interpreter instead of the JIT:\n"
+               "                 no LLVM start-up, for short-running programs\n"
+               "  --tiered[=N]   start in the bytecode interpreter and compile routines with N\n"
+               "                 calls and loop iterations (default: 1000) by the JIT in the\n"
+               "                 background; with --routine-stats prints how many were compiled\n"
+               "  --dump-bytecode with --vm or --tiered print the bytecode listing to stderr\n"
+               "  --eager-jit    compile all routines to machine code before the run instead of\n"
+               "                 on their first call\n"
+               "  --emit-obj=FILE write the program's machine code to the object file FILE\n"
+               "                 instead of running it\n"
+               "  --emit-exe=FILE build the executable FILE that runs the program without the\n"
+               "                 compiler; linked by the C compiler from PASCAL_CC (default: cc)\n"
+               "  --jit-cache[=DIR] keep the machine code of the optimized program in DIR\n"
+               "                 (default: .jitcache) and load it instead of compiling the same\n"
+               "                 program again; the directory can be shared by several processes\n"
+               "  --jit-cache-size=MB limit of the --jit-cache directory (default: 64), the least\n"
+               "                 recently used entries are removed\n"
+               "  --jit-cache-stats print cache hits and misses and the size of the cache\n"
+               "  --watch        run the program again after every change of the file,\n"
+               "                 recompiling only the changed routines\n";
+}
+
+// Порог --tiered по умолчанию: вызовы и итерации циклов функции
+static const unsigned DEFAULT_TIER_THRESHOLD = 1000;
+
+// Режим --vm: программа переводится в байткод и выполняется интерпретатором, LLVM
+// не инициализируется. dump (--dump-bytecode) - листинг байткода печатается в stderr.
+// tierThreshold != 0 (--tiered) - горячие функции компилируются в фоне (tiering.h)
+static bool RunBytecode(Parser *P, unsigned tierThreshold, bool tierStats, bool dump, double &genTime) {
+  ArenaScope arenaScope(&P->_arena);
+  Bytecode code;
+  auto start = std::chrono::steady_clock::now();
+  try {
+  	BytecodeGenerator gen;
+  	gen.Generate(P->_ast, code);
+  }
+  catch (std::exception &ex) {
+  	std::cout << "Generation failed: " << ex.what() << std::endl;
+  	return false;
+  }
+  genTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  if (dump)
+  	code.Dump(std::cerr);
+
+  try {
+  	VirtualMachine vm;
+  	std::unique_ptr<TieredRunner> pTier;
+  	if (tierThreshold != 0)
+  		pTier.reset(new TieredRunner(P, code, vm, tierThreshold));
+  	int res = vm.Run(code);
+  	std::cout << std::endl << "Result: " << res << std::endl;
+
+  	if (pTier != nullptr) {
+  		pTier->Stop();
+  		if (tierStats) {
+  			std::cout << "Tiered: " << pTier->Compiled() << " of " << code.funcs.size() - 1
+  			          << " routines compiled in the background (" << pTier->CompileTime() << " ms)";
+  			if (!pTier->Error().empty())
+  				std::cout << ", stopped: " << pTier->Error();
+  			std::cout << std::endl;
+  		}
+  	}
+  }
+  catch (std::exception &ex) {
+  	std::cout << std::endl << "Runtime error: " << ex.what() << std::endl;
+  	return false;
+  }
+  return true;
+}
+
+// Режим --watch: файл опрашивается, и после каждого изменения программа перезагружается
+// и выполняется заново. Работает до прерывания процесса
+static int Watch(const std::string &path, unsigned nThreads) {
+  unsigned long long time, size;
+  if (!GetSourceStamp(path, time, size)) {
+  	std::cout << "Incorrect file path\n";
+  	return -1;
+  }
+
+  HotReloader reloader(path, nThreads);
+  CodeGenerator *pGen = CodeGenerator::getInstance();
+  bool changed = true;
+
+  for (;;) {
+  	if (changed && reloader.Load(pGen)) {
+  		int res = pGen->Execute();
+  		std::cout << std::endl << "Result: " << res << std::endl;
+  	}
+
+  	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  	// Пока файл перезаписывается, он может быть недоступен
+  	unsigned long long curTime, curSize;
+  	changed = GetSourceStamp(path, curTime, curSize) && (curTime != time || curSize != size);
+  	if (changed) {
+  		time = curTime;
+  		size = curSize;
+  	}
+  }
+}
 
 int main(int argc, char **argv) {
-  std::ifstream input;
-  //input.open("../tests/test13.pas");
-  if(argc == 2)
-  	input.open(argv[1]);
-  else
+  std::string path;
+  bool parallelLex = false;
+  unsigned nThreads = 0;
+  bool arenaStats = false;
+  bool lookupStats = false;
+  bool routineStats = false;
+  bool keepUnused = false;
+  bool useFlat = false;
+  bool watch = false;
+  bool useCache = false;
+  std::string cacheDir = ".astcache";
+  std::string unitDir = ".units";
+  bool unitStats = false;
+  bool useVM = false;
+  bool dumpBytecode = false;
+  unsigned tierThreshold = 0;
+  bool eagerJIT = false;
+  std::string objPath, exePath;
+  bool useJitCache = false;
+  std::string jitCacheDir = ".jitcache";
+  unsigned long long jitCacheSize = 64;
+  bool jitCacheStats = false;
+  unsigned optLevel = 2, sizeLevel = 0;
+
+  for (int i = 1; i < argc; ++i) {
+  	std::string arg = argv[i];
+  	if (arg.compare(0, 2, "-j") == 0) {
+  		parallelLex = true;
+  		nThreads = (unsigned)atoi(arg.c_str() + 2);
+  	}
+  	else if (arg == "--arena-stats")
+  		arenaStats = true;
+  	else if (arg == "--lookup-stats")
+  		lookupStats = true;
+  	else if (arg == "--routine-stats")
+  		routineStats = true;
+  	else if (arg == "--keep-unused")
+  		keepUnused = true;
+  	else if (arg == "--flat")
+  		useFlat = true;
+  	else if (arg == "--watch")
+  		watch = true;
+  	else if (arg == "--ast-cache")
+  		useCache = true;
+  	else if (arg.compare(0, 12, "--ast-cache=") == 0 && arg.size() > 12) {
+  		useCache = true;
+  		cacheDir = arg.substr(12);
+  	}
+  	else if (arg.compare(0, 11, "--unit-dir=") == 0 && arg.size() > 11)
+  		unitDir = arg.substr(11);
+  	else if (arg == "--unit-stats")
+  		unitStats = true;
+  	else if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && arg[2] >= '0' && arg[2] <= '3') {
+  		optLevel = arg[2] - '0';
+  		sizeLevel = 0;
+  	}
+  	else if (arg == "-Os") {
+  		optLevel = 2;
+  		sizeLevel = 1;
+  	}
+  	else if (arg.compare(0, 11, "--emit-obj=") == 0 && arg.size() > 11)
+  		objPath = arg.substr(11);
+  	else if (arg.compare(0, 11, "--emit-exe=") == 0 && arg.size() > 11)
+  		exePath = arg.substr(11);
+  	else if (arg == "--jit-cache")
+  		useJitCache = true;
+  	else if (arg.compare(0, 12, "--jit-cache=") == 0 && arg.size() > 12) {
+  		useJitCache = true;
+  		jitCacheDir = arg.substr(12);
+  	}
+  	else if (arg.compare(0, 17, "--jit-cache-size=") == 0 && atoi(arg.c_str() + 17) > 0)
+  		jitCacheSize = (unsigned long long)atoi(arg.c_str() + 17);
+  	else if (arg == "--jit-cache-stats")
+  		jitCacheStats = true;
+  	else if (arg == "--eager-jit")
+  		eagerJIT = true;
+  	else if (arg == "--vm")
+  		useVM = true;
+  	else if (arg == "--dump-bytecode")
+  		dumpBytecode = true;
+  	else if (arg == "--tiered") {
+  		useVM = true;
+  		tierThreshold = DEFAULT_TIER_THRESHOLD;
+  	}
+  	else if (arg.compare(0, 9, "--tiered=") == 0 && atoi(arg.c_str() + 9) > 0) {
+  		useVM = true;
+  		tierThreshold = (unsigned)atoi(arg.c_str() + 9);
+  	}
+  	else if (path.empty())
+  		path = arg;
+  	else {
+  		Usage();
+  		return -1;
+  	}
+  }
+
+  if (path.empty())
   {
   	std::cout << "No file path specified\n";
+  	Usage();
   	return -1;
   }
-  if(!ifs)
-  {
-  	std::cout << "Incorrect file path\n";
+  CodeGenerator::SetOptLevel(optLevel, sizeLevel);
+
+  // Интерпретатор работает с деревом разбора и машинного кода не строит
+  if (useVM && (useFlat || !objPath.empty() || !exePath.empty() || useJitCache)) {
+  	Usage();
   	return -1;
   }
-  Parser *P = new Parser(input);
-  P->Parse();
-  if (!P->IsSuccess()) {
-	  std::cout << "Parser failed... :(\n";
+
+  // Перезагрузка работает с деревом разбора и требует файла на диске
+  if (watch) {
+  	if (path == "-" || useFlat || useVM || !objPath.empty() || !exePath.empty() || useJitCache) {
+  		Usage();
+  		return -1;
+  	}
+  	return Watch(path, nThreads);
+  }
+
+  MappedFile file;
+  std::ifstream input;
+  Parser *P = nullptr;
+  AstCache cache(cacheDir);
+  bool cached = false;
+
+  // "-" - читаем программу со стандартного ввода
+  if (path == "-")
+  	P = new Parser(std::cin);
+  // Обычный файл отображаем в память, иначе (канал, устройство) читаем как поток
+  else if (file.Open(path)) {
+  	// Дерево уже разобранного раньше исходника берется из кэша
+  	if (useCache)
+  		P = cache.Load(file.Data(), file.Size());
+  	cached = P != nullptr;
+  	if (!cached)
+  		P = parallelLex ? new Parser(file.Data(), file.Size(), nThreads)
+  		                : new Parser(file.Data(), file.Size());
+  }
+  else
+  {
+  	input.open(path);
+  	if (!input)
+  	{
+  		std::cout << "Incorrect file path\n";
+  		return -1;
+  	}
+  	P = new Parser(input);
+  }
+
+  // Модули из uses ищутся рядом с программой
+  UnitBuilder units(path == "-" ? "" : path.substr(0, path.find_last_of("/\\") + 1), unitDir, nThreads);
+  P->_pUnits = &units;
+
+  if (!cached) {
+	  P->Parse();
+	  if (!P->IsSuccess()) {
+		  if (!units.Error().empty())
+			  std::cout << std::endl << units.Error() << std::endl;
+		  std::cout << "Parser failed... :(\n";
+		  return 1;
+	  }
+	  // Дерево сохраняется до свертки констант, которая его меняет. Дерево программы
+	  // с модулями зависит и от их исходников, поэтому в кэш не попадает
+	  if (useCache && file.IsOpen() && P->_ast->Uses.empty() && !P->_ast->isUnit)
+		  cache.Store(file.Data(), file.Size(), *P);
+  }
+
+  if (P->_ast->isUnit) {
+	  std::cout << "A unit cannot be run, compile a program that uses it\n";
+	  return 1;
+  }
+  if ((useFlat || useVM) && !P->_ast->Uses.empty()) {
+	  std::cout << "Units are not supported with "
+	            << (useFlat ? "--flat" : tierThreshold != 0 ? "--tiered" : "--vm") << std::endl;
+	  return -1;
+  }
+  // Модули, изменившиеся с прошлой сборки, компилируются до программы
+  if (!units.Build()) {
+	  std::cout << "Unit compilation failed: " << units.Error() << std::endl;
 	  return 1;
   }
 
-  CodeGenerator *pGen = CodeGenerator::getInstance();
+  // Имена связываются с объявлениями один раз, дальше их никто не ищет
+  NameResolver resolver;
+  CallGraph graph;
+  FlatAST flat;
+  try {
+	  resolver.Resolve(P->_ast);
+	  // Константные подвыражения заменяются значениями; новые узлы живут в арене дерева
+	  ArenaScope arenaScope(&P->_arena);
+	  ConstFolder folder;
+	  folder.Fold(P->_ast);
+	  // Генерируются только подпрограммы, достижимые из тела программы; после свертки
+	  // вызовов, вычисленных при компиляции, их может стать меньше
+	  if (!keepUnused)
+		  graph.Prune(P->_ast);
+	  // Плоское дерево строится по готовому дереву разбора
+	  if (useFlat) {
+		  flat.Build(P->_ast);
+		  flat.Check();
+	  }
+  }
+  catch (std::exception &ex) {
+	  std::cout << "Semantic analysis failed: " << ex.what() << std::endl;
+	  return 1;
+  }
+
+  // Кэш нужен только выполнению: объектный файл строится заново
+  std::unique_ptr<JitCache> pJitCache;
+  if (useJitCache && objPath.empty() && exePath.empty())
+	  pJitCache.reset(new JitCache(jitCacheDir, jitCacheSize << 20, CodeGenerator::TargetKey()));
+
+  CodeGenerator *pGen = nullptr;
+  int exitCode = 0;
+  double genTime = 0.0;
+  // Подпрограммы, получившие машинный код к концу выполнения (без --eager-jit - вызванные)
+  size_t jitCompiled = 0, jitTotal = 0;
+  // Счетчики Scope свои у каждого потока: учитываются поиски генерации в этом потоке
+  size_t lookups = Scope::s_lookups;
+  if (useVM) {
+	  if (!RunBytecode(P, tierThreshold, routineStats, dumpBytecode, genTime))
+		  exitCode = 1;
+  }
+  else {
+	  pGen = CodeGenerator::getInstance();
+	  bool generated = pGen->Generate(P, useFlat ? &flat : nullptr, eagerJIT, pJitCache.get());
+	  genTime = pGen->GenTime();
+	  if (generated) {
+		  for (auto &i : units.Objects())
+			  generated = generated && pGen->LinkUnit(i);
+	  }
+	  if (generated)
+		  pGen->Optimize();
+	  else
+		  exitCode = 1;
+
+	  // Сборка заранее: машинный код записывается, программа не выполняется
+	  if (generated && (!objPath.empty() || !exePath.empty())) {
+		  pGen->Dump();
+		  std::string obj = !objPath.empty() ? objPath : exePath + OBJECT_EXT;
+		  std::string error;
+		  bool written = pGen->EmitObject(obj, error) && (exePath.empty() || LinkExecutable(obj, exePath, error));
+		  // Промежуточный объектный файл исполняемого не нужен
+		  if (objPath.empty())
+			  remove(obj.c_str());
+		  if (!written) {
+			  std::cout << "Emission failed: " << error << std::endl;
+			  exitCode = 1;
+		  }
+		  else
+			  std::cout << "Written: " << (!exePath.empty() ? exePath : objPath) << std::endl;
+	  }
+	  else if (generated) {
+		  pGen->Dump();
+		  int res = pGen->Execute();
+		  std::cout << std::endl << "Result: " << res << std::endl;
+		  jitCompiled = pGen->CompiledRoutines(jitTotal);
+	  }
+  }
+  lookups = Scope::s_lookups - lookups;
+
+  if (lookupStats)
+	  std::cout << "Name lookups: " << resolver.Lookups() << " in resolution, " << lookups
+	            << " in code generation (" << Scope::s_probes << " scopes probed in total)" << std::endl;
+
+  // Время генерации удаленных подпрограмм оценивается по размеру их тел
+  // и времени генерации сгенерированных
+  if (routineStats) {
+	  std::cout << "Code generation: " << genTime << " ms";
+	  if (pGen != nullptr)
+		  std::cout << ", module optimization: " << pGen->OptTime() << " ms";
+	  if (!keepUnused) {
+		  size_t removedNodes = graph.CountRemovedNodes();
+		  double saved = graph.LiveNodes() != 0 ? genTime * removedNodes / graph.LiveNodes() : 0.0;
+		  std::cout << ", " << graph.Live() << " of " << graph.Total() << " routines generated, "
+		            << graph.Removed() << " unreachable removed (" << removedNodes << " of "
+		            << removedNodes + graph.LiveNodes() << " AST nodes), about " << saved << " ms saved";
+	  }
+	  if (jitTotal != 0)
+		  std::cout << ", " << jitCompiled << " of " << jitTotal << " compiled to machine code";
+	  std::cout << std::endl;
+  }
+
+  if (jitCacheStats && pJitCache != nullptr) {
+	  size_t entries;
+	  unsigned long long bytes;
+	  pJitCache->Usage(entries, bytes);
+	  std::cout << "JIT cache: " << pJitCache->Hits() << " hits, " << pJitCache->Misses() << " misses, "
+	            << entries << " entries, " << bytes << " of " << (jitCacheSize << 20) << " bytes" << std::endl;
+  }
 
-  
+  if (unitStats)
+	  std::cout << "Units: " << units.Count() << ", " << units.Compiled() << " compiled, "
+	            << units.Count() - units.Compiled() << " up to date (" << units.BuildTime() << " ms)" << std::endl;
 
-  if (pGen->Generate(P)) {
-	  pGen->Dump();
-	  int res = pGen->Execute();
-	  std::cout << std::endl << "Result: " << res << std::endl;
+  if (arenaStats) {
+	  P->PrintArenaStats(std::cout);
+	  if (useFlat)
+		  flat.PrintStats(std::cout);
   }
 
-  pGen->Release();
+  if (pGen != nullptr)
+	  pGen->Release();
 
-  return 0;
+  return exitCode;
 }
@@ -0,0 +1,130 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : _data(nullptr), _size(0), _isOpen(false),
+						   _hFile(INVALID_HANDLE_VALUE), _hMapping(nullptr) {}
+
+bool MappedFile::Open(const std::string &path)
+{
+	Close();
+
+	HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Отображать можно только обычные файлы на диске
+	LARGE_INTEGER size;
+	if (GetFileType(hFile) != FILE_TYPE_DISK || !GetFileSizeEx(hFile, &size)) {
+		CloseHandle(hFile);
+		return false;
+	}
+	_hFile = hFile;
+	_size = (size_t)size.QuadPart;
+
+	// Пустой файл отобразить нельзя, но это корректный исходник
+	if (_size == 0) {
+		_isOpen = true;
+		return true;
+	}
+
+	_hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_hMapping == nullptr) {
+		Close();
+		return false;
+	}
+
+	_data = (const char *)MapViewOfFile(_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (_data == nullptr) {
+		Close();
+		return false;
+	}
+
+	_isOpen = true;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (_data != nullptr)
+		UnmapViewOfFile(_data);
+	if (_hMapping != nullptr)
+		CloseHandle(_hMapping);
+	if (_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(_hFile);
+
+	_data = nullptr;
+	_size = 0;
+	_isOpen = false;
+	_hMapping = nullptr;
+	_hFile = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : _data(nullptr), _size(0), _isOpen(false), _fd(-1) {}
+
+bool MappedFile::Open(const std::string &path)
+{
+	Close();
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	// Отображать можно только обычные файлы на диске
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+	_fd = fd;
+	_size = (size_t)st.st_size;
+
+	// Пустой файл отобразить нельзя, но это корректный исходник
+	if (_size == 0) {
+		_isOpen = true;
+		return true;
+	}
+
+	void *pData = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (pData == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	madvise(pData, _size, MADV_SEQUENTIAL);
+	_data = (const char *)pData;
+
+	_isOpen = true;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (_data != nullptr)
+		munmap((void *)_data, _size);
+	if (_fd >= 0)
+		close(_fd);
+
+	_data = nullptr;
+	_size = 0;
+	_isOpen = false;
+	_fd = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
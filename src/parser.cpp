@@ -1,90 +1,209 @@
+#include <climits>
+#include <cstring>
+
+#include "fold.h"
+#include "numlit.h"
 #include "parser.h"
+#include "resolver.h"
+#include "threadpool.h"
+#include "tokenizer.h"
 
 using namespace std;
 
-Var::TYPE Str2Type(const std::string& type)
+void Parser::Parse()
 {
-	if (type == "real")
-		return Var::REAL;
-	else if (type == "integer")
-		return Var::INTEGER;
-	else if (type == "char")
-		return Var::CHAR;
-	else if (type == "boolean")
-		return Var::BOOLEAN;
-	else
-		throw exception();
+	ParseHeaders();
+	ParseBodies();
 }
-Condition::OP Str2Cond(const std::string& cond)
-{
-	if (cond == "=")
-		return Condition::EQ;
-	else if (cond == "<>")
-		return Condition::NEQ;
-	else if (cond == ">")
-		return Condition::GT;
-	else if (cond == "<")
-		return Condition::LT;
-	else if (cond == "<=")
-		return Condition::LE;
-	else if (cond == ">=")
-		return Condition::GE;
-	else if (cond == "IN")
-		return Condition::IN; 
-	else
-		throw exception();
 
-}
-BinaryOp::OP Str2Arithm(const std::string& op)
+void Parser::ParseHeaders()
 {
-	if (op == "*")
-		return BinaryOp::MUL;
-	else if (op == "/")
-		return BinaryOp::DIV;
-	else if (op == "+")
-		return BinaryOp::ADD;
-	else if (op == "-")
-		return BinaryOp::SUB;
-	else if (op == "^" || op == "and")
-		return BinaryOp::AND;
-	else if (op == "div")
-		return BinaryOp::INT_DIV;
-	else if (op == "mod")
-		return BinaryOp::MOD;
-	else if (op == "or")
-		return BinaryOp::OR;
-	else
-		throw exception();
-}
+	// Все узлы дерева создаются в арене анализатора
+	ArenaScope arenaScope(&_arena);
+	_ast = ArenaNew<Root>();
 
-void Parser::Parse()
-{
-	_ast = new Root;
 	try
 	{
+		if (_lex == nullptr)
+		{
+			if (!PreTokenize(_buf, _bufSize, _nThreads, _tokens, _errLine))
+			{
+				_isValid = false;
+				return;
+			}
+			_pTokens = _tokens.data();
+			_nTokens = _tokens.size();
+			_pos = 0;
+			_currentToken = _pTokens[0]._tok;
+
+			RoutineRange root = { _ast, (size_t)-1, 0, 0, 0, _nTokens, (size_t)-1 };
+			_routines.push_back(root);
+			_curRoutine = 0;
+		}
+
+		if (Is(T_UNIT))
+		{
+			ParseUnit();
+			_isValid = true;
+			return;
+		}
+
 		if (Is(T_PROGRAM))
 		{
 			ShouldBe(T_ID);
-			_ast->_ID = GetCurrentValue();
-			_ast->scp.name = _ast->_ID;
+			_ast->_ID = GetCurrentSymbol();
+			_ast->scp.name = SymName(_ast->_ID);
 			_ast->scp.Add(_ast->_ID, _ast->_prtype);
 			MustBe(T_SEMICOLON);
 		}
+		ParseUses();
 
+		if (!_routines.empty())
+			_routines[0].decls = _pos;
 		ParseDeclarations(_ast);
-		_ast->seq = ParseStmntSeq();
+		ParseBody(_ast);
 		_isValid = true;
 	}
 	catch (exception)
 	{
 		_isValid = false;
-		cout << "Error found on line: " << _lex->GetLine();
+		_errLine = GetLine();
+		_errPos = _pos;
+	}
+}
+
+void Parser::ParseBodies()
+{
+	// Отложенные тела, начинающиеся до места ошибки; сообщается самая ранняя ошибка,
+	// как при последовательном разборе
+	if (!_bodies.empty())
+	{
+		ParseDeferredBodies(_errPos);
+		for (auto &i : _bodies)
+		{
+			if (i.failed && i.errPos < _errPos)
+			{
+				_isValid = false;
+				_errLine = i.errLine;
+				_errPos = i.errPos;
+			}
+		}
 	}
+
+	if (!_isValid)
+		cout << "Error found on line: " << _errLine;
+}
+
+void Parser::ParseBody(Function *pFunc)
+{
+	// В режиме массива тело только пропускается до парного end и разбирается позже
+	if (_lex == nullptr)
+		_routines[_curRoutine].body = _pos;
+	if (_lex == nullptr && Is(T_BEGIN))
+	{
+		size_t end = FindBodyEnd(_pos);
+		if (end != (size_t)-1)
+		{
+			BodyJob job = { pFunc, _pos, end, false, false, 0, 0 };
+			_routines[_curRoutine].job = _bodies.size();
+			_bodies.push_back(job);
+			_pos = end;
+			NextToken();
+			return;
+		}
+	}
+	pFunc->seq = ParseStmntSeq();
+}
+
+size_t Parser::FindBodyEnd(size_t pos) const
+{
+	// Тело не содержит объявлений подпрограмм, поэтому каждая лексема просматривается один раз
+	int depth = 0;
+	for (size_t i = pos; i < _nTokens; ++i)
+	{
+		Token tok = _pTokens[i]._tok;
+		if (tok == T_BEGIN)
+			depth++;
+		else if (tok == T_END && --depth == 0)
+			return i;
+	}
+	return (size_t)-1;
+}
+
+void Parser::ParseDeferredBodies(size_t errPos)
+{
+	std::vector<BodyJob *> jobs;
+	for (auto &i : _bodies)
+	{
+		if (i.begin < errPos && !i.skip)
+			jobs.push_back(&i);
+	}
+	size_t nJobs = jobs.size();
+	if (nJobs == 0)
+		return;
+
+	unsigned nThreads = _nThreads != 0 ? _nThreads : ThreadPool::HardwareThreads();
+	size_t nGroups = nThreads * 4;
+	if (nGroups > nJobs)
+		nGroups = nJobs;
+
+	// Каждая группа соседних тел разбирается одной задачей в собственную арену
+	auto parseGroup = [&](size_t g) {
+		ArenaScope arenaScope(_bodyArenas[g].get());
+		for (size_t i = nJobs * g / nGroups; i < nJobs * (g + 1) / nGroups; ++i)
+		{
+			BodyJob &job = *jobs[i];
+			Parser body(*this, job.begin);
+			try
+			{
+				job.pFunc->seq = body.ParseStmntSeq();
+				if (body._pos != job.end + 1)
+					throw exception();
+			}
+			catch (exception)
+			{
+				job.failed = true;
+				job.errLine = body.GetLine();
+				job.errPos = body._pos;
+			}
+		}
+	};
+
+	for (size_t g = 0; g < nGroups; ++g)
+		_bodyArenas.push_back(std::unique_ptr<Arena>(new Arena()));
+
+	if (nThreads == 1 || nGroups == 1)
+	{
+		for (size_t g = 0; g < nGroups; ++g)
+			parseGroup(g);
+	}
+	else
+	{
+		ThreadPool pool(nThreads);
+		pool.ParallelFor(nGroups, parseGroup);
+	}
+}
+
+void Parser::PrintArenaStats(std::ostream &os) const
+{
+	_arena.PrintStats(os);
+
+	if (_bodyArenas.empty())
+		return;
+
+	size_t objects = 0, bytes = 0;
+	for (auto &i : _bodyArenas)
+	{
+		objects += i->Objects();
+		bytes += i->BytesUsed();
+	}
+	os << "Body arenas: " << _bodyArenas.size() << " arenas, " << _bodies.size() << " routine bodies, "
+	   << objects << " objects, " << bytes << " bytes used" << std::endl;
 }
 
 StatementSeq * Parser::ParseStmntSeq()
 {
-	StatementSeq *seq = new StatementSeq;
+	StatementSeq *seq = ArenaNew<StatementSeq>();
 	if(!Is(T_BEGIN))
 		throw exception();
 	do
@@ -105,8 +224,8 @@ void Parser::ParseDeclarations(Function *func)
 		ShouldBe(T_ID);
 		do
 		{
-			string str = GetCurrentValue();
-			cnst = ParseConst();
+			SymbolID str = GetCurrentSymbol();
+			cnst = ParseConst(func);
 			if (!func->add(str, cnst))
 				throw exception();
 			MustBe(T_SEMICOLON);
@@ -117,39 +236,41 @@ void Parser::ParseDeclarations(Function *func)
 		NextToken();
 		do
 		{
-			vector<string> vars;
+			vector<SymbolID> vars;
 			if (!Is(T_ID))
 				throw exception();
-			vars.push_back(GetCurrentValue());
+			vars.push_back(GetCurrentSymbol());
 			while (Is(T_COMMA))
 			{
 				ShouldBe(T_ID);
-				vars.push_back(GetCurrentValue());
+				vars.push_back(GetCurrentSymbol());
 			}
 			MustBe(T_COLON);
 			if (!Is(T_VARTYPE))
 				throw exception();
-			Var::TYPE type = Str2Type(GetCurrentValue());
+			Var::TYPE type = (Var::TYPE)GetCurrentSubKind();
 			for (auto& i : vars)
 			{
 				switch (type)
 				{
 				case Var::BOOLEAN:
-					if (!func->add(i, new Var(Var::BOOLEAN)))
+					if (!func->add(i, ArenaNew<Var>(Var::BOOLEAN)))
 						throw exception();
 					break;
 				case Var::INTEGER:
-					if (!func->add(i, new Var(Var::INTEGER)))
+					if (!func->add(i, ArenaNew<Var>(Var::INTEGER)))
 						throw exception();
 					break;
 				case Var::CHAR:
-					if (!func->add(i, new Var(Var::CHAR)))
+					if (!func->add(i, ArenaNew<Var>(Var::CHAR)))
 						throw exception();
 					break;
 				case Var::REAL:
-					if (!func->add(i, new Var(Var::REAL)))
+					if (!func->add(i, ArenaNew<Var>(Var::REAL)))
 						throw exception();
 					break;
+				default:
+					throw exception();
 				}
 			}
 			MustBe(T_SEMICOLON);
@@ -158,108 +279,297 @@ void Parser::ParseDeclarations(Function *func)
 	while (Is(T_PROC) || Is(T_FUNC))
 	{
 		Function *f = ParseFunction(func, Is(T_FUNC));
-		if (!func->add(f->GetID(), f))
+		if (!func->add(f->GetID(), f) && (func != _ast || !ImplementHeader(f)))
 			throw exception();
 	}
 }
 
-Const *ParseConstNumber(const string& val, bool neg = false)
+void Parser::ParseUnit()
 {
-	bool sign = neg;
-	double res;
-	int fst;
-	int snd;
-	unsigned cnt = 0;
-	bool isPt = false;
-	while (cnt < val.size() && isdigit(val[cnt])) ++cnt;
-	fst = stoi(val.substr(0, cnt));
-	const unsigned offs1 = cnt + 1;
-	if (cnt == val.size())
-		return  (!sign) ? (new ConstInteger(fst)) : (new ConstInteger(-fst));
-	if (val[cnt] == '.')
-	{
-		cnt++;
-		isPt = true;
-		while (cnt < val.size() && isdigit(val[cnt])) ++cnt;
-		string ptPart = val.substr(offs1, cnt);
-		res = stoi(ptPart);
-		for (unsigned i = 0; i < ptPart.size(); ++i)
-			res /= 10;
-		res += fst;
-		if (cnt == val.size())
-			return (!sign) ? (new ConstReal(res)) : (new ConstReal(-res));
-	}
-	if (val[cnt] == 'E')
-	{
-		cnt++;
-		if (!isdigit(val[cnt]))
-		{
-			sign ^= (val[cnt] == '-');
-			cnt++;
-		}
-		snd = stoi(val.substr(cnt, val.size()));
-		if (isPt)
-		{
-			for (int i = 0; i < snd; ++i)
-				res *= 10;
-			return (!sign) ? (new ConstReal(res)) : (new ConstReal(-res));
-		}
-		else
-		{
-			for (int i = 0; i < snd; ++i)
-				fst *= 10;
-			return  (!sign) ? (new ConstInteger(fst)) : (new ConstInteger(-fst));
-		}
+	// Модуль разбирается только последовательно: границы подпрограмм без тел
+	// (заголовков интерфейса) в массив лексем не записываются
+	if (_lex == nullptr)
+		throw exception();
+
+	ShouldBe(T_ID);
+	_ast->_ID = GetCurrentSymbol();
+	_ast->scp.name = SymName(_ast->_ID);
+	_ast->isUnit = true;
+	MustBe(T_SEMICOLON);
+
+	// Интерфейс: uses, константы, переменные и заголовки подпрограмм
+	if (!Is(T_INTERFACE))
+		throw exception();
+	_interfaceBegin = GetOffset();
+	NextToken();
+	ParseUses();
+	_headersOnly = true;
+	ParseDeclarations(_ast);
+	_headersOnly = false;
+
+	if (!Is(T_IMPLEMENTATION))
+		throw exception();
+	_interfaceEnd = GetOffset();
+	for (auto &i : _ast->Vars)
+		_ast->Interface.push_back(std::make_pair(i.first, static_cast<ScopableNode *>(i.second)));
+	for (auto &i : _ast->Funcs)
+		_ast->Interface.push_back(std::make_pair(i.first, static_cast<ScopableNode *>(i.second)));
+	if (_interfaceOnly)
+		return;
+
+	// Реализация: свои объявления и подпрограммы, в том числе тела заголовков интерфейса
+	NextToken();
+	ParseDeclarations(_ast);
+	MustBe(T_END);
+	if (!Is(T_EOF))
+		throw exception();
+
+	for (auto &i : _ast->Funcs)
+	{
+		if (i.second->seq == nullptr)
+			throw exception();
+	}
+}
+
+void Parser::ParseUses()
+{
+	if (!Is(T_USES))
+		return;
+	do
+	{
+		ShouldBe(T_ID);
+		ImportUnit(GetCurrentSymbol());
+	} while (Is(T_COMMA));
+	MustBe(T_SEMICOLON);
+}
+
+// Копия объявления из интерфейса модуля в текущей арене
+static ScopableNode * CloneDecl(const ScopableNode *pNode)
+{
+	if (const Function *pFunc = NodeCast<Function>(pNode))
+	{
+		ParamList *pList = ArenaNew<ParamList>();
+		for (auto &i : pFunc->_params->_params)
+			pList->_params.push_back(make_pair(i.first, ArenaNew<Var>(i.second->_type, false, i.second->isRef)));
+		return ArenaNew<Function>(pFunc->_ID, pList, pFunc->_prtype->_type);
+	}
+	if (const ConstArray *pArr = NodeCast<ConstArray>(pNode))
+	{
+		ConstArray *pCopy = ArenaNew<ConstArray>(pArr->_type, pArr->_low);
+		pCopy->_vals = pArr->_vals;
+		return pCopy;
 	}
-	throw exception();
+	if (const ConstInteger *pC = NodeCast<ConstInteger>(pNode))
+		return ArenaNew<ConstInteger>(pC->_val);
+	if (const ConstReal *pC = NodeCast<ConstReal>(pNode))
+		return ArenaNew<ConstReal>(pC->_val);
+	if (const ConstBoolean *pC = NodeCast<ConstBoolean>(pNode))
+		return ArenaNew<ConstBoolean>(pC->_val);
+	return ArenaNew<Var>(static_cast<const Var *>(pNode)->_type);
 }
 
-Const * Parser::ParseConst()
+void Parser::ImportUnit(SymbolID name)
 {
+	// Интерфейс модуля разбирается один раз (UnitBuilder), а анализатор получает копии
+	// его объявлений в своей арене: деревья разных модулей не делят узлы между потоками
+	const Root *pIface = _pUnits != nullptr ? _pUnits->Find(name) : nullptr;
+	if (pIface == nullptr)
+		throw exception();
+
+	// Объявления модулей, которые использует сам модуль, дальше не передаются
+	for (auto &i : pIface->Interface)
+	{
+		if (!_ast->Import(name, i.first, CloneDecl(i.second)))
+			throw exception();
+	}
+	_ast->Uses.push_back(name);
+}
+
+bool Parser::ImplementHeader(Function *pFunc)
+{
+	// Тело подпрограммы из интерфейса модуля: заголовок заменяется целиком,
+	// имена параметров могут отличаться, типы - нет
+	if (!_ast->isUnit)
+		return false;
+	auto it = _ast->scp.scope.find(pFunc->GetID());
+	Function *pHeader = NodeCast<Function>(it->second);
+	if (pHeader == nullptr || pHeader->seq != nullptr
+		|| find(_ast->Interface.begin(), _ast->Interface.end(), make_pair(pFunc->GetID(), it->second)) == _ast->Interface.end())
+		return false;
+	if (pHeader->GetNumOfParams() != pFunc->GetNumOfParams() || pHeader->_prtype->_type != pFunc->_prtype->_type)
+		return false;
+	for (unsigned i = 0; i < pFunc->GetNumOfParams(); ++i)
+	{
+		const Var *pA = pHeader->_params->_params[i].second;
+		const Var *pB = pFunc->_params->_params[i].second;
+		if (pA->_type != pB->_type || pA->isRef != pB->isRef)
+			return false;
+	}
+
+	it->second = pFunc;
+	for (auto &i : _ast->Funcs)
+	{
+		if (i.second == pHeader)
+			i.second = pFunc;
+	}
+	for (auto &i : _ast->Interface)
+	{
+		if (i.second == pHeader)
+			i.second = pFunc;
+	}
+	return true;
+}
+
+Const * Parser::ParseNumber(bool neg)
+{
+	// Литерал разбирается прямо в буфере лексемы, до перехода к следующей
+	StrRef val = GetValue();
+	NumLiteral lit;
+	if (!ParseNumLiteral(val._data, val._size, lit))
+		throw exception();
+	NextToken();
+	if (lit._isReal)
+		return ArenaNew<ConstReal>(neg ? -lit._real : lit._real);
+	return ArenaNew<ConstInteger>(neg ? 0 - lit._integer : lit._integer);
+}
 
-	if (!Is(T_COND) || GetCurrentValue()[0] != '=')
+long long Parser::ParseBound()
+{
+	bool neg = false;
+	if (Is(T_TERMOP))
+	{
+		int op = GetCurrentSubKind();
+		if (op != BinaryOp::SUB && op != BinaryOp::ADD)
+			throw exception();
+		neg = (op == BinaryOp::SUB);
+	}
+	if (!Is(T_UNUMBER))
+		throw exception();
+	ConstInteger *pC = NodeCast<ConstInteger>(ParseNumber(neg));
+	// Индексы в сгенерированном коде 32-битные
+	if (pC == nullptr || (long long)pC->_val < INT_MIN || (long long)pC->_val > INT_MAX)
 		throw exception();
-	//if (Is(T_STRING))
-	//	return new ConstString(GetCurrentValue());
-	else if (Is(T_UNUMBER))
-		return ParseConstNumber(GetCurrentValue());
-	//else if (Is(T_ID)) {
-	//	std::string val = GetCurrentValue();
-	//	return new ConstID(GetCurrentValue());
-	//}
-	else if (Is(T_FALSE) || Is(T_TRUE))
+	return (long long)pC->_val;
+}
+
+unsigned long long Parser::ParseTableValue(Var::TYPE type)
+{
+	if (Is(T_FALSE) || Is(T_TRUE))
 	{
+		if (type != Var::BOOLEAN)
+			throw exception();
 		bool b = Is(T_TRUE);
 		NextToken();
-		return new ConstBoolean(b);
+		return b;
 	}
-	else if (Is(T_TERMOP))
+
+	bool neg = false;
+	if (Is(T_TERMOP))
 	{
-		char c = GetCurrentValue()[0];
-		if (c != '-' && c != '+')
+		int op = GetCurrentSubKind();
+		if (op != BinaryOp::SUB && op != BinaryOp::ADD)
 			throw exception();
-		if (Is(T_UNUMBER))
-			return ParseConstNumber(GetCurrentValue(), (c == '-'));
-		/*else if (Is(T_ID))
-		{
-			Const *cnst;
-			cnst = new ConstID(GetCurrentValue());
-			cnst->SetNeg(c == '-');
+		neg = (op == BinaryOp::SUB);
+	}
+	if (!Is(T_UNUMBER) || type == Var::BOOLEAN)
+		throw exception();
 
-			return cnst;
-		}*/
-		else
-			throw exception();
+	// Элементы сразу пишутся в таблицу, отдельных узлов Const для них нет
+	StrRef val = GetValue();
+	NumLiteral lit;
+	if (!ParseNumLiteral(val._data, val._size, lit))
+		throw exception();
+	NextToken();
+
+	if (type == Var::REAL)
+	{
+		double d = lit._isReal ? lit._real : (double)lit._integer;
+		if (neg)
+			d = -d;
+		unsigned long long bits;
+		memcpy(&bits, &d, sizeof(bits));
+		return bits;
 	}
-	else
+	if (lit._isReal)
+		throw exception();
+	// Элементы хранятся в таблице с шириной типа (i32 или i8), значение вне диапазона
+	// было бы молча обрезано
+	long long v = neg ? -(long long)lit._integer : (long long)lit._integer;
+	if (lit._integer > (unsigned long long)INT_MAX + 1
+		|| (type == Var::INTEGER && (v < INT_MIN || v > INT_MAX))
+		|| (type == Var::CHAR && (v < 0 || v > UCHAR_MAX)))
+		throw exception();
+	return (unsigned long long)v;
+}
+
+ConstArray * Parser::ParseConstArray()
+{
+	MustBe(T_COLON);
+	MustBe(T_ARRAY);
+	MustBe(T_LSBR);
+	long long low = ParseBound();
+	MustBe(T_DOTDOT);
+	long long high = ParseBound();
+	MustBe(T_RSBR);
+	MustBe(T_OF);
+	if (!Is(T_VARTYPE))
+		throw exception();
+	Var::TYPE type = (Var::TYPE)GetCurrentSubKind();
+	if (high < low || !Is(T_COND) || GetCurrentSubKind() != Condition::EQ)
+		throw exception();
+	MustBe(T_LBR);
+
+	ConstArray *pArr = ArenaNew<ConstArray>(type, low);
+	unsigned long long count = (unsigned long long)(high - low + 1);
+	// В режиме массива лексем число элементов заранее ограничено числом лексем
+	if (_lex == nullptr && count < _nTokens)
+		pArr->_vals.reserve((size_t)count);
+	while (true)
+	{
+		pArr->_vals.push_back(ParseTableValue(type));
+		if (!Is(T_COMMA))
+			break;
+		NextToken();
+	}
+	MustBe(T_RBR);
+	if (pArr->_vals.size() != count)
 		throw exception();
+	return pArr;
+}
+
+Const * Parser::ParseConst(Function *func)
+{
+	if (Is(T_COLON))
+		return ParseConstArray();
+	if (!Is(T_COND) || GetCurrentSubKind() != Condition::EQ)
+		throw exception();
+
+	// Значение - константное выражение над литералами и объявленными выше константами
+	Expression *pExpr = ParseExpression();
+	if (pExpr->_type == Expression::E_CONST && !pExpr->isNeg)
+		return static_cast<ExprConst *>(pExpr)->_val;
+
+	NameResolver resolver;
+	resolver.ResolveExpression(&func->scp, pExpr);
+	Const *cnst = ConstFolder().Evaluate(pExpr);
+	if (cnst == nullptr)
+		throw exception();
+	return cnst;
 }
 
 Function * Parser::ParseFunction(Function *par, bool isFunc)
 {
+	size_t parent = _curRoutine;
+	if (_lex == nullptr)
+	{
+		RoutineRange range = { nullptr, parent, _pos, 0, 0, 0, (size_t)-1 };
+		_curRoutine = _routines.size();
+		_routines.push_back(range);
+	}
+
 	//Идентификатор
 	ShouldBe(T_ID);
-	string id = GetCurrentValue();
+	SymbolID id = GetCurrentSymbol();
 	//Распознаем список параметров
 	ParamList* pList = ParseParamList();
 
@@ -270,20 +580,33 @@ Function * Parser::ParseFunction(Function *par, bool isFunc)
 		MustBe(T_COLON);
 		if (!Is(T_VARTYPE))
 			throw exception();
-		rtype = Str2Type(GetCurrentValue());
+		rtype = (Var::TYPE)GetCurrentSubKind();
 	}
 	MustBe(T_SEMICOLON);
-	Function *pFunc = new Function(id, pList, rtype);
+	Function *pFunc = ArenaNew<Function>(id, pList, rtype);
+	if (_lex == nullptr)
+	{
+		_routines[_curRoutine].pFunc = pFunc;
+		_routines[_curRoutine].decls = _pos;
+	}
 	pFunc->scp.SetParScope(&par->scp);
 	// Добавляем параметры в область видимости
 	for (auto &i : pList->_params)
 		pFunc->scp.Add(i.first, i.second);
+	// Заголовок из интерфейса модуля: тело будет в implementation
+	if (_headersOnly)
+		return pFunc;
 
 	ParseDeclarations(pFunc);
 	// Добавляем возращаемое значение в область видимости
 	pFunc->scp.Add(pFunc->_ID, pFunc->_prtype);
-	pFunc->seq = ParseStmntSeq();
+	ParseBody(pFunc);
 	MustBe(T_SEMICOLON);
+	if (_lex == nullptr)
+	{
+		_routines[_curRoutine].end = _pos;
+		_curRoutine = parent;
+	}
 	return pFunc;
 }
 
@@ -303,12 +626,12 @@ Statement * Parser::ParseStatement()
 			NextToken();
 			elseStnt = ParseStatement();
 		}
-		return new IfStatement(cond, thenStnt, elseStnt);
+		return ArenaNew<IfStatement>(cond, thenStnt, elseStnt);
 	}
 	else if (Is(T_FOR))
 	{
 		ShouldBe(T_ID);
-		string var = GetCurrentValue();
+		SymbolID var = GetCurrentSymbol();
 
 		MustBe(T_ASSIGN);
 
@@ -329,7 +652,7 @@ Statement * Parser::ParseStatement()
 
 		Statement *st = ParseStatement();
 
-		return new ForStatement(var, expr, finExpr, st, type);
+		return ArenaNew<ForStatement>(var, expr, finExpr, st, type);
 	}
 	else if(Is(T_WHILE))
 	{
@@ -337,16 +660,16 @@ Statement * Parser::ParseStatement()
 		Expression *cond = ParseExpression();
 		MustBe(T_DO);
 		Statement *st = ParseStatement();
-		return new WhileStatement(cond, st);
+		return ArenaNew<WhileStatement>(cond, st);
 	}
 	else if (Is(T_ID))
 	{
-		string var = GetCurrentValue();
+		SymbolID var = GetCurrentSymbol();
 		if (Is(T_ASSIGN))
 		{
 			NextToken();
 			Expression *expr = ParseExpression();
-			return new AssignStatement(var, expr);
+			return ArenaNew<AssignStatement>(var, expr);
 		}
 		else
 		{
@@ -363,12 +686,12 @@ Statement * Parser::ParseStatement()
 			}
 			MustBe(T_RBR);
 
-			return new ProcCallStatement(var, params);
+			return ArenaNew<ProcCallStatement>(var, params);
 		}
 	}
 	else if (Is(T_REPEAT))
 	{
-		StatementSeq *seq = new StatementSeq();
+		StatementSeq *seq = ArenaNew<StatementSeq>();
 		do
 		{
 			NextToken();
@@ -377,107 +700,217 @@ Statement * Parser::ParseStatement()
 		MustBe(T_UNTIL);
 		Expression *expr = ParseExpression();
 
-		return new RepeatStatement(expr, seq);
+		return ArenaNew<RepeatStatement>(expr, seq);
 	}
-	else return new Statement(Statement::TYPE::S_EMPTY);
+	else return ArenaNew<Statement>(Statement::S_EMPTY);
 }
 
-Expression * Parser::ParseExpression()
-{
-	Expression *left = ParseSimpleExpression();
-	if (Is(T_COND))
-	{
-		Condition::OP op = Str2Cond(GetCurrentValue());
-		Expression * right = ParseSimpleExpression();
-		return new Condition(left, right, op);
-	}
-	return left;
-}
+// Разбор выражения без рекурсии: операнды и отложенные операции хранятся в явных стеках,
+// поэтому глубина вложенности скобок и вызовов ограничена только памятью.
+// Приоритеты соответствуют прежнему рекурсивному спуску:
+//   сравнение < знак простого выражения < аддитивные < мультипликативные < '~'.
+// Знак в начале простого выражения относится ко всему простому выражению,
+// '~' - только к следующему множителю.
+namespace {
+
+enum ExprOpKind { EO_BINARY, EO_COND, EO_SIGN, EO_NEG };
+
+struct ExprOp {
+	unsigned char _kind; // ExprOpKind
+	unsigned char _op; // BinaryOp::OP или Condition::OP
+	unsigned char _prec;
+};
+
+const unsigned char PREC_COND = 1, PREC_SIGN = 2, PREC_TERM = 3, PREC_FACTOR = 4, PREC_NEG = 5;
+
+// Группа выражения: скобки, аргументы вызова или индекс таблицы
+enum ExprFrameKind { EF_PAREN, EF_CALL, EF_INDEX };
+
+struct ExprFrame {
+	ExprFrameKind _kind;
+	SymbolID _callee; // Функция или таблица
+	size_t _opBase; // Начало операций группы в стеке операций
+	size_t _argBase; // Начало аргументов вызова в стеке операндов
+	bool _hasCond;
+};
 
-Expression * Parser::ParseSimpleExpression()
+void ApplyOp(const ExprOp &op, std::vector<Expression *> &operands)
 {
-	bool isNeg = false;
-	if (Is(T_TERMOP))
+	switch (op._kind) {
+	case EO_SIGN:
+	case EO_NEG:
+		operands.back()->Negate();
+		break;
+	case EO_BINARY:
+	case EO_COND:
 	{
-		char c = GetCurrentValue()[0];
-		if (c != '+' && c != '-')
-			throw exception();
-		isNeg = (c == '-');
+		Expression *right = operands.back();
+		operands.pop_back();
+		Expression *left = operands.back();
+		operands.back() = op._kind == EO_BINARY ?
+			(Expression *)ArenaNew<BinaryOp>(left, right, (BinaryOp::OP)op._op) :
+			(Expression *)ArenaNew<Condition>(left, right, (Condition::OP)op._op);
+		break;
 	}
-	Expression *left = ParseTerm();
-	while (Is(T_TERMOP))
-	{
-		BinaryOp::OP op = Str2Arithm(GetCurrentValue());
-		Expression *right = ParseTerm();
-		left = new BinaryOp(left, right, op);
 	}
-	if (isNeg)
-		left->Negate();
-	return left;
 }
 
-Expression * Parser::ParseTerm()
+// Выполняет отложенные операции группы с приоритетом не ниже prec
+void Reduce(std::vector<ExprOp> &ops, size_t base, unsigned char prec, std::vector<Expression *> &operands)
 {
-	Expression *left = ParseFactor();
-
-	while (Is(T_FACTOROP))
-	{
-		BinaryOp::OP op = Str2Arithm(GetCurrentValue());
-		Expression *right = ParseFactor();
-		left = new BinaryOp(left, right, op);
+	while (ops.size() > base && ops.back()._prec >= prec) {
+		ApplyOp(ops.back(), operands);
+		ops.pop_back();
 	}
-	return left;
 }
 
-Expression * Parser::ParseFactor()
+}
+
+Expression * Parser::ParseExpression()
 {
-	if (Is(T_ID))
+	std::vector<Expression *> operands;
+	std::vector<ExprOp> ops;
+	std::vector<ExprFrame> frames;
+
+	ExprFrame top = { EF_PAREN, 0, 0, 0, false };
+	frames.push_back(top);
+
+	bool expectOperand = true;
+	bool simpleStart = true; // Начало простого выражения: допустим знак
+
+	while (true)
 	{
-		string id = GetCurrentValue();
-		if (!Is(T_LBR))
-			return new ExprID(id);
-		vector<Expression *> vec;
-		do
+		ExprFrame &frame = frames.back();
+
+		if (expectOperand)
 		{
-			NextToken();
-			vec.push_back(ParseExpression());
-		} while (Is(T_COMMA));
-		MustBe(T_RBR);
+			if (Is(T_TERMOP) && simpleStart)
+			{
+				int op = GetCurrentSubKind();
+				if (op != BinaryOp::ADD && op != BinaryOp::SUB)
+					throw exception();
+				if (op == BinaryOp::SUB)
+				{
+					ExprOp sign = { EO_SIGN, 0, PREC_SIGN };
+					ops.push_back(sign);
+				}
+				simpleStart = false;
+				continue;
+			}
+			simpleStart = false;
 
-		return new FuncCallExpr(id, vec);
-	}
-	//else if (Is(T_STRING))
-	//	return new ExprConst(new ConstString(GetCurrentValue()));
-	else if (Is(T_UNUMBER))
-		return new ExprConst(ParseConstNumber(GetCurrentValue()));
-	/*else if (Is(T_NIL))
-		return new ExprConst(ExprConst::NIL);*/
-	else if (Is(T_FALSE) || Is(T_TRUE))
-	{
-		bool b = Is(T_TRUE);
-		NextToken();
-		return new ExprConst(new ConstBoolean(b));
-	}
-	else if (Is(T_NEG))
-	{
-		NextToken();
-		Expression *ex = ParseFactor();
-		ex->Negate();
-		return ex;
-	}
-	else if (Is(T_LBR))
-	{
-		NextToken();
-		Expression *ex = ParseExpression();
-		MustBe(T_RBR);
-		return ex;
+			if (Is(T_ID))
+			{
+				SymbolID id = GetCurrentSymbol();
+				if (Is(T_LBR))
+				{
+					// Вызов функции: аргументы разбираются как отдельные выражения
+					NextToken();
+					ExprFrame call = { EF_CALL, id, ops.size(), operands.size(), false };
+					frames.push_back(call);
+					simpleStart = true;
+					continue;
+				}
+				if (Is(T_LSBR))
+				{
+					NextToken();
+					ExprFrame index = { EF_INDEX, id, ops.size(), operands.size(), false };
+					frames.push_back(index);
+					simpleStart = true;
+					continue;
+				}
+				operands.push_back(ArenaNew<ExprID>(id));
+			}
+			//else if (Is(T_STRING))
+			//	operands.push_back(new ExprConst(new ConstString(GetCurrentValue())));
+			else if (Is(T_UNUMBER))
+				operands.push_back(ArenaNew<ExprConst>(ParseNumber()));
+			else if (Is(T_FALSE) || Is(T_TRUE))
+			{
+				bool b = Is(T_TRUE);
+				NextToken();
+				operands.push_back(ArenaNew<ExprConst>(ArenaNew<ConstBoolean>(b)));
+			}
+			else if (Is(T_NEG))
+			{
+				NextToken();
+				ExprOp neg = { EO_NEG, 0, PREC_NEG };
+				ops.push_back(neg);
+				continue;
+			}
+			else if (Is(T_LBR))
+			{
+				NextToken();
+				ExprFrame paren = { EF_PAREN, 0, ops.size(), operands.size(), false };
+				frames.push_back(paren);
+				simpleStart = true;
+				continue;
+			}
+			else
+				throw exception();
+
+			expectOperand = false;
+			continue;
+		}
+
+		// Ожидается операция или конец группы
+		if (Is(T_FACTOROP) || Is(T_TERMOP))
+		{
+			unsigned char prec = Is(T_FACTOROP) ? PREC_FACTOR : PREC_TERM;
+			ExprOp op = { EO_BINARY, (unsigned char)GetCurrentSubKind(), prec };
+			Reduce(ops, frame._opBase, prec, operands);
+			ops.push_back(op);
+			expectOperand = true;
+		}
+		else if (Is(T_COND) && !frame._hasCond)
+		{
+			ExprOp op = { EO_COND, (unsigned char)GetCurrentSubKind(), PREC_COND };
+			Reduce(ops, frame._opBase, PREC_COND, operands);
+			ops.push_back(op);
+			frame._hasCond = true;
+			expectOperand = true;
+			simpleStart = true;
+		}
+		else if (frames.size() == 1)
+		{
+			// Конец выражения: следующую лексему разбирает вызывающий
+			Reduce(ops, 0, 0, operands);
+			return operands.back();
+		}
+		else if (frame._kind == EF_CALL && Is(T_COMMA))
+		{
+			NextToken();
+			Reduce(ops, frame._opBase, 0, operands);
+			frame._hasCond = false;
+			expectOperand = true;
+			simpleStart = true;
+		}
+		else if (frame._kind == EF_INDEX ? Is(T_RSBR) : Is(T_RBR))
+		{
+			NextToken();
+			Reduce(ops, frame._opBase, 0, operands);
+			if (frame._kind == EF_CALL)
+			{
+				std::vector<Expression *> args(operands.begin() + frame._argBase, operands.end());
+				operands.resize(frame._argBase);
+				operands.push_back(ArenaNew<FuncCallExpr>(frame._callee, args));
+			}
+			else if (frame._kind == EF_INDEX)
+			{
+				if (operands.size() != frame._argBase + 1)
+					throw exception();
+				operands.back() = ArenaNew<ExprIndex>(frame._callee, operands.back());
+			}
+			frames.pop_back();
+		}
+		else
+			throw exception();
 	}
-	throw exception();
 }
 
 ParamList * Parser::ParseParamList()
 {
-	ParamList *pList = new ParamList;
+	ParamList *pList = ArenaNew<ParamList>();
 	if (Is(T_LBR))
 	{
 		do
@@ -489,23 +922,24 @@ ParamList * Parser::ParseParamList()
 				bool byRef = Is(T_VAR);
 				if (Is(T_VAR))
 					NextToken();
-				vector<string> ids;
-				//MustBe(T_ID);
-				ids.push_back(GetCurrentValue());
+				vector<SymbolID> ids;
+				if (!Is(T_ID))
+					throw exception();
+				ids.push_back(GetCurrentSymbol());
 				while (Is(T_COMMA))
 				{
 					ShouldBe(T_ID);
-					ids.push_back(GetCurrentValue());
+					ids.push_back(GetCurrentSymbol());
 				}
 				MustBe(T_COLON);
 
 				if (!Is(T_VARTYPE))
 					throw exception();
 
-				Var::TYPE type = Str2Type(GetCurrentValue());
+				Var::TYPE type = (Var::TYPE)GetCurrentSubKind();
 
 				for (auto& i : ids)
-					pList->_params.push_back({ i, new Var(type, false, byRef)});
+					pList->_params.push_back({ i, ArenaNew<Var>(type, false, byRef)});
 			}
 		} while (Is(T_SEMICOLON));
 		MustBe(T_RBR);
@@ -0,0 +1,78 @@
+#include "resolver.h"
+
+#include <string>
+
+void NameResolver::Resolve(Root *pRoot)
+{
+	_lookups = 0;
+	Walk(pRoot);
+}
+
+void NameResolver::ResolveExpression(Scope *pScope, Expression *pExpr)
+{
+	_pScope = pScope;
+	WalkExpression(pExpr);
+}
+
+Var * NameResolver::FindVar(SymbolID name)
+{
+	++_lookups;
+	Var *pVar = _pScope->Get<Var>(name);
+	if (pVar == nullptr)
+		throw std::exception((std::string("unknown variable '") + SymName(name) + "'").c_str());
+	if (NodeCast<ConstArray>(pVar) != nullptr)
+		throw std::exception("table used without index");
+	return pVar;
+}
+
+Var * NameResolver::FindTarget(SymbolID name)
+{
+	Var *pVar = FindVar(name);
+	if (pVar->isConst)
+		throw std::exception("cannot assign to constant");
+	return pVar;
+}
+
+Function * NameResolver::FindFunction(SymbolID name, size_t nArgs)
+{
+	++_lookups;
+	Function *pFunc = _pScope->Get<Function>(name);
+	if (pFunc == nullptr)
+		throw std::exception("Unknown function referenced");
+	if (pFunc->GetNumOfParams() != nArgs)
+		throw std::exception("Incorrect # arguments passed");
+	return pFunc;
+}
+
+void NameResolver::VisitFor(ForStatement *pEl)
+{
+	pEl->_pNode = FindTarget(pEl->_var);
+}
+
+void NameResolver::VisitAssign(AssignStatement *pEl)
+{
+	pEl->_pNode = FindTarget(pEl->_var);
+}
+
+void NameResolver::VisitProcCall(ProcCallStatement *pEl)
+{
+	pEl->_pFunc = FindFunction(pEl->_id, pEl->_params.size());
+}
+
+void NameResolver::VisitID(ExprID *pEl)
+{
+	pEl->_pNode = FindVar(pEl->id);
+}
+
+void NameResolver::VisitIndex(ExprIndex *pEl)
+{
+	++_lookups;
+	pEl->_pNode = _pScope->Get<ConstArray>(pEl->_id);
+	if (pEl->_pNode == nullptr)
+		throw std::exception("not an array");
+}
+
+void NameResolver::VisitCall(FuncCallExpr *pEl)
+{
+	pEl->_pFunc = FindFunction(pEl->_name, pEl->_params.size());
+}
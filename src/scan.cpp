@@ -0,0 +1,257 @@
+#include "scan.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SCAN_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SCAN_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_AVX2
+#define TARGET_SSE2
+#endif
+
+static inline bool isSpaceChar(unsigned char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+static inline bool isNewlineChar(unsigned char c) { return c == '\n' || c == '\r'; }
+static inline bool isAlnumChar(unsigned char c) { return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || (c >= '0' && c <= '9'); }
+static inline bool isDigitChar(unsigned char c) { return c >= '0' && c <= '9'; }
+
+// Скалярные версии, они же дочитывают хвосты векторных
+// =====================================================================
+
+static const char *SkipSpacesScalar(const char *p, const char *end, unsigned &lines)
+{
+	for (; p < end && isSpaceChar(*p); ++p)
+		if (isNewlineChar(*p))
+			lines++;
+	return p;
+}
+
+static const char *SkipAlnumScalar(const char *p, const char *end)
+{
+	while (p < end && isAlnumChar(*p))
+		++p;
+	return p;
+}
+
+static const char *SkipDigitsScalar(const char *p, const char *end)
+{
+	while (p < end && isDigitChar(*p))
+		++p;
+	return p;
+}
+
+#ifdef SCAN_X86
+
+static inline unsigned PopCount(unsigned x)
+{
+	x = x - ((x >> 1) & 0x55555555u);
+	x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+	return (((x + (x >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+}
+
+static inline unsigned TrailingZeros(unsigned x)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, x);
+	return idx;
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+// SSE2: 16 байт за итерацию
+// =====================================================================
+
+// Байты в диапазоне [lo, lo + n): сдвиг в знаковую область и одно сравнение
+TARGET_SSE2 static inline __m128i InRange16(__m128i v, char lo, char n)
+{
+	__m128i x = _mm_add_epi8(v, _mm_set1_epi8((char)(-128 - lo)));
+	return _mm_cmplt_epi8(x, _mm_set1_epi8((char)(-128 + n)));
+}
+
+TARGET_SSE2 static inline __m128i Alnum16(__m128i v)
+{
+	__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	return _mm_or_si128(InRange16(lower, 'a', 26), InRange16(v, '0', 10));
+}
+
+TARGET_SSE2 static const char *SkipSpacesSSE2(const char *p, const char *end, unsigned &lines)
+{
+	const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+	const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i nl = _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr));
+		__m128i ws = _mm_or_si128(nl, _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)));
+		unsigned wsMask = (unsigned)_mm_movemask_epi8(ws);
+		unsigned nlMask = (unsigned)_mm_movemask_epi8(nl);
+
+		if (wsMask != 0xFFFF) {
+			unsigned n = TrailingZeros(~wsMask);
+			lines += PopCount(nlMask & ((1u << n) - 1));
+			return p + n;
+		}
+		lines += PopCount(nlMask);
+		p += 16;
+	}
+	return SkipSpacesScalar(p, end, lines);
+}
+
+TARGET_SSE2 static const char *SkipAlnumSSE2(const char *p, const char *end)
+{
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned mask = (unsigned)_mm_movemask_epi8(Alnum16(v));
+		if (mask != 0xFFFF)
+			return p + TrailingZeros(~mask);
+		p += 16;
+	}
+	return SkipAlnumScalar(p, end);
+}
+
+TARGET_SSE2 static const char *SkipDigitsSSE2(const char *p, const char *end)
+{
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned mask = (unsigned)_mm_movemask_epi8(InRange16(v, '0', 10));
+		if (mask != 0xFFFF)
+			return p + TrailingZeros(~mask);
+		p += 16;
+	}
+	return SkipDigitsScalar(p, end);
+}
+
+// AVX2: 32 байта за итерацию
+// =====================================================================
+
+TARGET_AVX2 static inline __m256i InRange32(__m256i v, char lo, char n)
+{
+	__m256i x = _mm256_add_epi8(v, _mm256_set1_epi8((char)(-128 - lo)));
+	return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + n)), x);
+}
+
+TARGET_AVX2 static const char *SkipSpacesAVX2(const char *p, const char *end, unsigned &lines)
+{
+	const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+	const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		__m256i nl = _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr));
+		__m256i ws = _mm256_or_si256(nl, _mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)));
+		unsigned wsMask = (unsigned)_mm256_movemask_epi8(ws);
+		unsigned nlMask = (unsigned)_mm256_movemask_epi8(nl);
+
+		if (wsMask != 0xFFFFFFFFu) {
+			unsigned n = TrailingZeros(~wsMask);
+			lines += PopCount(nlMask & ((1u << n) - 1));
+			return p + n;
+		}
+		lines += PopCount(nlMask);
+		p += 32;
+	}
+	return SkipSpacesSSE2(p, end, lines);
+}
+
+TARGET_AVX2 static const char *SkipAlnumAVX2(const char *p, const char *end)
+{
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		__m256i alnum = _mm256_or_si256(InRange32(lower, 'a', 26), InRange32(v, '0', 10));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(alnum);
+		if (mask != 0xFFFFFFFFu)
+			return p + TrailingZeros(~mask);
+		p += 32;
+	}
+	return SkipAlnumSSE2(p, end);
+}
+
+TARGET_AVX2 static const char *SkipDigitsAVX2(const char *p, const char *end)
+{
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		unsigned mask = (unsigned)_mm256_movemask_epi8(InRange32(v, '0', 10));
+		if (mask != 0xFFFFFFFFu)
+			return p + TrailingZeros(~mask);
+		p += 32;
+	}
+	return SkipDigitsSSE2(p, end);
+}
+
+// Определение возможностей процессора
+// =====================================================================
+
+static void CpuId(int regs[4], int leaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(regs, leaf, 0);
+#else
+	__asm__ __volatile__("cpuid" : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3]) : "a"(leaf), "c"(0));
+#endif
+}
+
+static unsigned long long XGetBV()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned lo, hi;
+	__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+static bool HasSSE2()
+{
+	int regs[4];
+	CpuId(regs, 1);
+	return (regs[3] & (1 << 26)) != 0;
+}
+
+static bool HasAVX2()
+{
+	int regs[4];
+	CpuId(regs, 0);
+	if (regs[0] < 7)
+		return false;
+
+	// AVX должен быть включен операционной системой (OSXSAVE и сохранение YMM)
+	CpuId(regs, 1);
+	if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0)
+		return false;
+	if ((XGetBV() & 0x6) != 0x6)
+		return false;
+
+	CpuId(regs, 7);
+	return (regs[1] & (1 << 5)) != 0;
+}
+
+#endif
+
+static ScanKernels SelectKernels()
+{
+#ifdef SCAN_X86
+	if (HasAVX2()) {
+		ScanKernels k = { SkipSpacesAVX2, SkipAlnumAVX2, SkipDigitsAVX2, "avx2" };
+		return k;
+	}
+	if (HasSSE2()) {
+		ScanKernels k = { SkipSpacesSSE2, SkipAlnumSSE2, SkipDigitsSSE2, "sse2" };
+		return k;
+	}
+#endif
+	ScanKernels k = { SkipSpacesScalar, SkipAlnumScalar, SkipDigitsScalar, "scalar" };
+	return k;
+}
+
+const ScanKernels g_Scan = SelectKernels();
@@ -0,0 +1,65 @@
+#include "symbols.h"
+
+#include <cstring>
+
+SymbolTable *SymbolTable::m_pInst = nullptr;
+
+SymbolTable::SymbolTable() : _slots(1024, 0) {}
+
+SymbolTable * SymbolTable::getInstance()
+{
+	if (m_pInst == nullptr)
+		m_pInst = new SymbolTable();
+	return m_pInst;
+}
+
+// FNV-1a
+unsigned SymbolTable::Hash(const char *s, size_t len)
+{
+	unsigned h = 2166136261u;
+	for (size_t i = 0; i < len; ++i) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+void SymbolTable::Grow()
+{
+	std::vector<SymbolID> slots(_slots.size() * 2, 0);
+	size_t mask = slots.size() - 1;
+
+	for (SymbolID id = 0; id < _names.size(); ++id) {
+		size_t i = _hashes[id] & mask;
+		while (slots[i] != 0)
+			i = (i + 1) & mask;
+		slots[i] = id + 1;
+	}
+	_slots.swap(slots);
+}
+
+SymbolID SymbolTable::Intern(const char *s, size_t len)
+{
+	unsigned h = Hash(s, len);
+	size_t mask = _slots.size() - 1;
+	size_t i = h & mask;
+
+	while (_slots[i] != 0) {
+		SymbolID id = _slots[i] - 1;
+		const std::string &name = _names[id];
+		if (_hashes[id] == h && name.size() == len && memcmp(name.data(), s, len) == 0)
+			return id;
+		i = (i + 1) & mask;
+	}
+
+	SymbolID id = (SymbolID)_names.size();
+	_names.push_back(std::string(s, len));
+	_hashes.push_back(h);
+	_slots[i] = id + 1;
+
+	// Заполненность не больше половины
+	if (_names.size() * 2 > _slots.size())
+		Grow();
+
+	return id;
+}
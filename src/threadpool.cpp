@@ -0,0 +1,78 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned nThreads) : _active(0), _stop(false)
+{
+	if (nThreads == 0)
+		nThreads = HardwareThreads();
+
+	for (unsigned i = 0; i < nThreads; ++i)
+		_workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_hasTask.notify_all();
+
+	for (auto &i : _workers)
+		i.join();
+}
+
+unsigned ThreadPool::HardwareThreads()
+{
+	unsigned n = std::thread::hardware_concurrency();
+	return n != 0 ? n : 1;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (!_stop && _tasks.empty())
+				_hasTask.wait(lock);
+			if (_stop && _tasks.empty())
+				return;
+
+			task = std::move(_tasks.front());
+			_tasks.pop_front();
+			_active++;
+		}
+
+		task();
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_active--;
+			if (_active == 0 && _tasks.empty())
+				_allDone.notify_all();
+		}
+	}
+}
+
+void ThreadPool::Run(const std::function<void()> &task)
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_tasks.push_back(task);
+	}
+	_hasTask.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (_active != 0 || !_tasks.empty())
+		_allDone.wait(lock);
+}
+
+void ThreadPool::ParallelFor(size_t n, const std::function<void(size_t)> &fn)
+{
+	for (size_t i = 0; i < n; ++i)
+		Run([&fn, i]() { fn(i); });
+	Wait();
+}
@@ -0,0 +1,57 @@
+#include "tiering.h"
+
+#include <chrono>
+#include <unordered_map>
+
+TieredRunner::TieredRunner(Parser *pP, const Bytecode &code, VirtualMachine &vm, unsigned threshold)
+	: _pParser(pP), _code(code), _vm(vm), _pGen(nullptr), _compiler(1), _stop(false),
+	  _failed(false), _compiled(0), _compileTime(0.0)
+{
+	// Тело Root выполняется один раз и подменено быть не может
+	_vm.SetHotHandler(threshold, [this](int func) {
+		if (func != 0)
+			_compiler.Run([this, func] { Compile(func); });
+	});
+}
+
+TieredRunner::~TieredRunner()
+{
+	Stop();
+	if (_pGen != nullptr)
+		_pGen->Release();
+}
+
+void TieredRunner::Stop()
+{
+	_stop = true;
+	_compiler.Wait();
+}
+
+void TieredRunner::Compile(int func)
+{
+	if (_stop || _failed)
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+	if (_pGen == nullptr) {
+		_pGen = CodeGenerator::getInstance();
+		std::unordered_map<const Var *, void *> globals;
+		for (size_t i = 0; i < _code.globals.size(); ++i) {
+			if (_code.globals[i] != nullptr)
+				globals[_code.globals[i]] = _vm.Memory() + i;
+		}
+		_failed = !_pGen->BeginTiered(_pParser, globals, _error);
+	}
+	// После ошибки модуль может быть недостроен: дальше все остается в интерпретаторе
+	void *pCode = nullptr;
+	if (!_failed)
+		pCode = _pGen->CompileTiered(_pParser, _code.funcs[func].pFunc, _error);
+	_compileTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (pCode == nullptr) {
+		_failed = true;
+		return;
+	}
+	_vm.Install(func, reinterpret_cast<NativeFunc>(pCode));
+	++_compiled;
+}
@@ -0,0 +1,162 @@
+#include "tokenizer.h"
+#include "threadpool.h"
+
+// Куски меньше этого размера не стоят запуска отдельной задачи
+static const size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+static bool isSplitSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+// Результат разбора одного куска
+struct Chunk {
+	size_t begin, end;
+	std::vector<TokenInfo> tokens; // Смещения и строки пока локальные
+	SymbolTable symbols; // Локальные номера имен
+	unsigned lines; // Число переводов строк в куске
+	bool failed;
+	unsigned errLine;
+
+	Chunk() : begin(0), end(0), lines(0), failed(false), errLine(0) {}
+};
+
+static void LexChunk(const char *buf, Chunk &chunk, bool isLast, SymbolTable *pSymbols)
+{
+	Lexer lex(buf + chunk.begin, chunk.end - chunk.begin, pSymbols);
+	// В среднем лексема вместе с пробелами занимает больше 4 байт
+	chunk.tokens.reserve((chunk.end - chunk.begin) / 4 + 1);
+	try {
+		while (true) {
+			Token tok = lex.GetToken();
+			if (tok == T_EOF && !isLast)
+				break;
+
+			StrRef val = lex.GetValue();
+			TokenInfo info;
+			info._tok = tok;
+			info._subKind = lex.GetSubKind();
+			info._symbol = lex.GetSymbol();
+			info._line = lex.GetLine();
+			info._offset = val._data != nullptr ? val._data - buf : chunk.end;
+			info._length = val._size;
+			chunk.tokens.push_back(info);
+
+			if (tok == T_EOF)
+				break;
+		}
+	}
+	catch (const std::exception &) {
+		chunk.failed = true;
+		chunk.errLine = lex.GetLine();
+	}
+	chunk.lines = lex.GetLine();
+}
+
+bool PreTokenize(const char *buf, size_t size, unsigned nThreads,
+	std::vector<TokenInfo> &tokens, unsigned &errLine)
+{
+	if (nThreads == 0)
+		nThreads = ThreadPool::HardwareThreads();
+
+	size_t nChunks = size / MIN_CHUNK_SIZE;
+	if (nChunks > nThreads * 4)
+		nChunks = nThreads * 4;
+	if (nChunks == 0)
+		nChunks = 1;
+
+	// Один кусок разбираем на месте, сразу с глобальной таблицей имен
+	if (nChunks == 1) {
+		Chunk chunk;
+		chunk.end = size;
+		LexChunk(buf, chunk, true, SymbolTable::getInstance());
+		if (chunk.failed) {
+			errLine = chunk.errLine;
+			return false;
+		}
+		tokens.swap(chunk.tokens);
+		return true;
+	}
+
+	ThreadPool pool(nThreads);
+
+	// 1. Четность числа кавычек в каждой равной доле буфера
+	std::vector<size_t> nominal(nChunks + 1);
+	for (size_t i = 0; i <= nChunks; ++i)
+		nominal[i] = size / nChunks * i;
+	nominal[nChunks] = size;
+
+	std::vector<char> quoteParity(nChunks, 0);
+	pool.ParallelFor(nChunks, [&](size_t i) {
+		char parity = 0;
+		for (size_t j = nominal[i]; j < nominal[i + 1]; ++j)
+			parity ^= (buf[j] == '\'');
+		quoteParity[i] = parity;
+	});
+
+	// 2. Сдвигаем каждую границу вперед до пробельного символа вне строки
+	std::vector<Chunk> chunks(nChunks);
+	char inString = 0;
+	size_t prevEnd = 0;
+	for (size_t i = 0; i < nChunks; ++i) {
+		size_t pos = nominal[i];
+		if (i != 0) {
+			char state = inString;
+			while (pos < size && (state || !isSplitSpace(buf[pos]))) {
+				state ^= (buf[pos] == '\'');
+				++pos;
+			}
+		}
+		if (pos < prevEnd)
+			pos = prevEnd;
+		chunks[i].begin = pos;
+		if (i != 0)
+			chunks[i - 1].end = pos;
+		prevEnd = pos;
+		inString ^= quoteParity[i];
+	}
+	chunks[nChunks - 1].end = size;
+
+	// 3. Разбор кусков
+	pool.ParallelFor(nChunks, [&](size_t i) {
+		LexChunk(buf, chunks[i], i + 1 == nChunks, &chunks[i].symbols);
+	});
+
+	// 4. Базовые номера строк и позиции в общем массиве
+	std::vector<unsigned> lineBase(nChunks);
+	std::vector<size_t> outBase(nChunks);
+	unsigned lines = 0;
+	size_t total = 0;
+	for (size_t i = 0; i < nChunks; ++i) {
+		if (chunks[i].failed) {
+			errLine = lines + chunks[i].errLine;
+			return false;
+		}
+		lineBase[i] = lines;
+		outBase[i] = total;
+		lines += chunks[i].lines;
+		total += chunks[i].tokens.size();
+	}
+
+	// 5. Перенос локальных имен в глобальную таблицу (по одному разу на имя в куске)
+	std::vector<std::vector<SymbolID>> remap(nChunks);
+	SymbolTable *pGlobal = SymbolTable::getInstance();
+	for (size_t i = 0; i < nChunks; ++i) {
+		SymbolTable &local = chunks[i].symbols;
+		remap[i].resize(local.Size());
+		for (SymbolID id = 0; id < local.Size(); ++id)
+			remap[i][id] = pGlobal->Intern(local.Name(id));
+	}
+
+	// 6. Склейка
+	tokens.resize(total);
+	pool.ParallelFor(nChunks, [&](size_t i) {
+		TokenInfo *pOut = tokens.data() + outBase[i];
+		for (const auto &t : chunks[i].tokens) {
+			*pOut = t;
+			pOut->_line += lineBase[i];
+			if (t._tok == T_ID)
+				pOut->_symbol = remap[i][t._symbol];
+			++pOut;
+		}
+	});
+
+	return true;
+}
@@ -0,0 +1,209 @@
+#include "units.h"
+#include "astcache.h"
+#include "callgraph.h"
+#include "codegen.h"
+#include "fold.h"
+#include "resolver.h"
+#include "threadpool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+unsigned long long Mix(unsigned long long h, unsigned long long v)
+{
+	h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 32);
+}
+
+}
+
+void UnitBuilder::Fail(const string &error)
+{
+	// Сообщается первая ошибка: она ближе всего к причине
+	if (_error.empty())
+		_error = error;
+}
+
+string UnitBuilder::BitcodePath(const Unit *pUnit) const
+{
+	return _outDir + '/' + SymName(pUnit->_name) + ".bc";
+}
+
+string UnitBuilder::StampPath(const Unit *pUnit) const
+{
+	return _outDir + '/' + SymName(pUnit->_name) + ".stamp";
+}
+
+const Root * UnitBuilder::Find(SymbolID name)
+{
+	auto it = _units.find(name);
+	if (it != _units.end()) {
+		Unit *pUnit = it->second.get();
+		if (pUnit->_loading) {
+			Fail("units '" + SymName(name) + "' use each other in a cycle");
+			return nullptr;
+		}
+		return pUnit->_error.empty() ? pUnit->_pIface->_ast : nullptr;
+	}
+
+	Unit *pUnit = new Unit();
+	_units[name].reset(pUnit);
+	pUnit->_name = name;
+	pUnit->_path = _srcDir + SymName(name) + ".pas";
+	pUnit->_loading = false;
+	pUnit->_ifaceHash = 0;
+	pUnit->_key = 0;
+	if (!pUnit->_file.Open(pUnit->_path)) {
+		pUnit->_error = "unit '" + SymName(name) + "' not found (" + pUnit->_path + ")";
+		Fail(pUnit->_error);
+		return nullptr;
+	}
+
+	// Модули из uses интерфейса загружаются рекурсивно, во время его разбора
+	const char *src = pUnit->_file.Data();
+	size_t size = pUnit->_file.Size();
+	Parser *P = new Parser(src, size);
+	pUnit->_pIface.reset(P);
+	P->_pUnits = this;
+	P->_interfaceOnly = true;
+	pUnit->_loading = true;
+	P->ParseHeaders();
+	pUnit->_loading = false;
+
+	if (!P->IsSuccess() || !P->_ast->isUnit || P->_ast->_ID != name) {
+		ostringstream msg;
+		msg << "unit '" << SymName(name) << "': ";
+		if (P->IsSuccess())
+			msg << pUnit->_path << " does not declare this unit";
+		else
+			msg << "error on line " << P->_errLine;
+		pUnit->_error = msg.str();
+		Fail(pUnit->_error);
+		return nullptr;
+	}
+
+	// Интерфейс модуля зависит и от интерфейсов, которые он использует: константа
+	// интерфейса может быть вычислена по чужой
+	unsigned long long usesHash = 0;
+	for (auto i : P->_ast->Uses)
+		usesHash = Mix(usesHash, _units[i]->_ifaceHash);
+	pUnit->_ifaceHash = Mix(AstCache::HashSource(src + P->_interfaceBegin, P->_interfaceEnd - P->_interfaceBegin), usesHash);
+	pUnit->_key = Mix(Mix(VERSION, AstCache::HashSource(src, size)), usesHash);
+
+	_order.push_back(pUnit);
+	return P->_ast;
+}
+
+bool UnitBuilder::IsUpToDate(const Unit *pUnit) const
+{
+	ifstream stamp(StampPath(pUnit));
+	unsigned long long key;
+	if (!(stamp >> hex >> key) || key != pUnit->_key)
+		return false;
+	return ifstream(BitcodePath(pUnit)).good();
+}
+
+void UnitBuilder::Compile(Unit *pUnit)
+{
+	Parser *P = pUnit->_pParser.get();
+	try {
+		NameResolver resolver;
+		resolver.Resolve(P->_ast);
+		ArenaScope arenaScope(&P->_arena);
+		ConstFolder folder;
+		folder.Fold(P->_ast);
+		CallGraph graph;
+		graph.Prune(P->_ast);
+	}
+	catch (exception &ex) {
+		pUnit->_error = "unit '" + SymName(pUnit->_name) + "': " + ex.what();
+		return;
+	}
+
+	// Метка снимается до записи биткода: прерванная сборка не выдаст старый код за новый
+	string stampPath = StampPath(pUnit);
+	remove(stampPath.c_str());
+	string error;
+	if (!CodeGenerator::GenerateUnit(P, BitcodePath(pUnit), error)) {
+		pUnit->_error = "unit '" + SymName(pUnit->_name) + "': " + error;
+		return;
+	}
+
+	ofstream stamp(stampPath);
+	stamp << hex << setw(16) << setfill('0') << pUnit->_key << '\n';
+	stamp.close();
+	if (!stamp)
+		pUnit->_error = "cannot write " + stampPath;
+}
+
+bool UnitBuilder::Build()
+{
+	if (!_error.empty())
+		return false;
+	auto start = chrono::steady_clock::now();
+
+	vector<Unit *> stale;
+	for (auto pUnit : _order) {
+		if (!IsUpToDate(pUnit))
+			stale.push_back(pUnit);
+	}
+
+	if (!stale.empty()) {
+#ifdef _WIN32
+		_mkdir(_outDir.c_str());
+#else
+		mkdir(_outDir.c_str(), 0777);
+#endif
+	}
+
+	// Разбор - в этом потоке: новые имена заносятся в общую таблицу имен
+	for (auto pUnit : stale) {
+		Parser *P = new Parser(pUnit->_file.Data(), pUnit->_file.Size());
+		pUnit->_pParser.reset(P);
+		P->_pUnits = this;
+		P->ParseHeaders();
+		if (!P->IsSuccess()) {
+			ostringstream msg;
+			msg << "unit '" << SymName(pUnit->_name) << "': error on line " << P->_errLine;
+			Fail(msg.str());
+			return false;
+		}
+	}
+
+	// Остальное - по модулю на поток, у каждого свой генератор и контекст LLVM
+	if (!stale.empty()) {
+		unsigned nThreads = _nThreads != 0 ? _nThreads : ThreadPool::HardwareThreads();
+		ThreadPool pool(nThreads < stale.size() ? nThreads : (unsigned)stale.size());
+		pool.ParallelFor(stale.size(), [&](size_t i) { Compile(stale[i]); });
+	}
+
+	for (auto pUnit : stale) {
+		pUnit->_pParser.reset();
+		if (!pUnit->_error.empty())
+			Fail(pUnit->_error);
+	}
+	_compiled = stale.size();
+	_buildTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	return _error.empty();
+}
+
+vector<string> UnitBuilder::Objects() const
+{
+	vector<string> res;
+	for (auto pUnit : _order)
+		res.push_back(BitcodePath(pUnit));
+	return res;
+}
@@ -0,0 +1,253 @@
+#include "vm.h"
+
+#include <climits>
+
+#if defined(__GNUC__)
+#define VM_THREADED 1
+#endif
+
+namespace {
+
+// Целое в 32 битах, как в регистре сгенерированного кода
+inline long long Wrap(unsigned v)
+{
+	return (int)v;
+}
+
+// fptosi: значение вне диапазона дает 0x80000000, как cvttsd2si
+inline long long ToInt(double d)
+{
+	return d > -2147483649.0 && d < 2147483648.0 ? (long long)(int)d : INT_MIN;
+}
+
+}
+
+void VirtualMachine::SetHotHandler(unsigned threshold, const std::function<void(int)> &onHot)
+{
+	_threshold = threshold;
+	_onHot = onHot;
+}
+
+void VirtualMachine::Install(int func, NativeFunc code)
+{
+	_native[func].store(code, std::memory_order_release);
+}
+
+void VirtualMachine::WidenGlobals()
+{
+	Slot *mem = _mem.get();
+	for (auto &i : _narrow) {
+		long long v = mem[i.first].i;
+		if (i.second == Var::INTEGER)
+			mem[i.first].i = (int)v;
+		else if (i.second == Var::CHAR)
+			mem[i.first].i = (signed char)v;
+		else
+			mem[i.first].i = v & 1;
+	}
+}
+
+int VirtualMachine::Run(const Bytecode &code)
+{
+	const Bytecode::Func &root = code.funcs[0];
+	if ((size_t)root.nRegs > _size)
+		throw std::exception("stack overflow");
+
+	Slot *mem = _mem.get();
+	const Instr *pCode = code.code.data();
+	const Slot *consts = code.consts.data();
+	const Bytecode::Func *funcs = code.funcs.data();
+	const Bytecode::Table *tables = code.tables.data();
+	const Slot *tableData = code.tableData.data();
+
+	// Глобальные переменные обнуляются, как общие переменные модуля LLVM
+	Slot *regs = mem;
+	for (int i = 0; i < root.nRegs; ++i)
+		regs[i].i = 0;
+	_calls.clear();
+	const Instr *ip = pCode + root.entry;
+	int func = 0; // Выполняемая функция
+
+	bool tiered = _threshold != 0;
+	if (tiered) {
+		_counts.assign(code.funcs.size(), 0);
+		_native.reset(new std::atomic<NativeFunc>[code.funcs.size()]);
+		for (size_t i = 0; i < code.funcs.size(); ++i)
+			_native[i].store(nullptr, std::memory_order_relaxed);
+		_narrow.clear();
+		for (size_t i = 0; i < code.globals.size(); ++i) {
+			if (code.globals[i] != nullptr && code.globals[i]->_type != Var::REAL)
+				_narrow.push_back(std::make_pair((int)i, code.globals[i]->_type));
+		}
+	}
+	unsigned *counts = _counts.data();
+
+#ifdef VM_THREADED
+	static const void *s_labels[] = {
+#define VM_LABEL(name, n) &&L_##name,
+		BYTECODE_OPS(VM_LABEL)
+#undef VM_LABEL
+	};
+#define VM_CASE(name) L_##name:
+#define VM_DISPATCH() goto *s_labels[ip->op]
+#else
+#define VM_CASE(name) case OP_##name:
+#define VM_DISPATCH() goto dispatch
+#endif
+#define VM_NEXT() do { ++ip; VM_DISPATCH(); } while (0)
+#define VM_JUMP(target) do { ip = pCode + (target); VM_DISPATCH(); } while (0)
+#define A regs[ip->a]
+#define B regs[ip->b]
+#define C regs[ip->c]
+
+#ifdef VM_THREADED
+	VM_DISPATCH();
+#else
+dispatch:
+	switch (ip->op) {
+#endif
+
+	VM_CASE(MOV) A = B; VM_NEXT();
+	VM_CASE(LOADI) A.i = ip->b; VM_NEXT();
+	VM_CASE(LOADK) A = consts[ip->b]; VM_NEXT();
+	VM_CASE(GETG) A = mem[ip->b]; VM_NEXT();
+	VM_CASE(SETG) mem[ip->a] = B; VM_NEXT();
+	VM_CASE(ADDR) A.i = (regs - mem) + ip->b; VM_NEXT();
+	VM_CASE(LOADR) A = mem[B.i]; VM_NEXT();
+	VM_CASE(STORER) mem[A.i] = B; VM_NEXT();
+
+	VM_CASE(ADD_I) A.i = Wrap((unsigned)B.i + (unsigned)C.i); VM_NEXT();
+	VM_CASE(SUB_I) A.i = Wrap((unsigned)B.i - (unsigned)C.i); VM_NEXT();
+	VM_CASE(MUL_I) A.i = Wrap((unsigned)B.i * (unsigned)C.i); VM_NEXT();
+	VM_CASE(DIV_I)
+		// Операнды 32-битные, поэтому в 64 битах MIN div -1 не переполняется
+		if (C.i == 0)
+			throw std::exception("division by zero");
+		A.i = Wrap((unsigned)(B.i / C.i));
+		VM_NEXT();
+	VM_CASE(MOD_I)
+		if (C.i == 0)
+			throw std::exception("division by zero");
+		A.i = B.i % C.i;
+		VM_NEXT();
+	VM_CASE(AND_I) A.i = B.i & C.i; VM_NEXT();
+	VM_CASE(OR_I) A.i = B.i | C.i; VM_NEXT();
+	VM_CASE(ADDK_I) A.i = Wrap((unsigned)B.i + (unsigned)ip->c); VM_NEXT();
+	VM_CASE(NEG_I) A.i = Wrap(0u - (unsigned)B.i); VM_NEXT();
+
+	VM_CASE(ADD_R) A.d = B.d + C.d; VM_NEXT();
+	VM_CASE(SUB_R) A.d = B.d - C.d; VM_NEXT();
+	VM_CASE(MUL_R) A.d = B.d * C.d; VM_NEXT();
+	VM_CASE(DIV_R) A.d = B.d / C.d; VM_NEXT();
+	VM_CASE(NEG_R) A.d = 0.0 - B.d; VM_NEXT();
+
+	VM_CASE(NORM_C) A.i = (signed char)B.i; VM_NEXT();
+	VM_CASE(NORM_B) A.i = B.i & 1; VM_NEXT();
+	VM_CASE(I2R) A.d = (double)B.i; VM_NEXT();
+	VM_CASE(R2I) A.i = ToInt(B.d); VM_NEXT();
+	VM_CASE(R2C) A.i = (signed char)ToInt(B.d); VM_NEXT();
+	VM_CASE(R2B) A.i = B.d < 0.0 || B.d > 0.0; VM_NEXT();
+	VM_CASE(I2B) A.i = B.i != 0; VM_NEXT();
+
+	VM_CASE(EQ_I) A.i = B.i == C.i; VM_NEXT();
+	VM_CASE(NE_I) A.i = B.i != C.i; VM_NEXT();
+	VM_CASE(LT_I) A.i = B.i < C.i; VM_NEXT();
+	VM_CASE(LE_I) A.i = B.i <= C.i; VM_NEXT();
+	VM_CASE(GT_I) A.i = B.i > C.i; VM_NEXT();
+	VM_CASE(GE_I) A.i = B.i >= C.i; VM_NEXT();
+	// Сравнения упорядоченные: с NaN все ложны
+	VM_CASE(EQ_R) A.i = B.d == C.d; VM_NEXT();
+	VM_CASE(NE_R) A.i = B.d < C.d || B.d > C.d; VM_NEXT();
+	VM_CASE(LT_R) A.i = B.d < C.d; VM_NEXT();
+	VM_CASE(LE_R) A.i = B.d <= C.d; VM_NEXT();
+	VM_CASE(GT_R) A.i = B.d > C.d; VM_NEXT();
+	VM_CASE(GE_R) A.i = B.d >= C.d; VM_NEXT();
+
+	VM_CASE(JMP) VM_JUMP(ip->a);
+	VM_CASE(LOOP)
+		if (tiered && ++counts[func] == _threshold)
+			_onHot(func);
+		VM_JUMP(ip->a);
+	VM_CASE(JF)
+		if (A.i == 0)
+			VM_JUMP(ip->b);
+		VM_NEXT();
+	VM_CASE(JEQ_I) if (B.i == C.i) VM_JUMP(ip->a); VM_NEXT();
+	VM_CASE(JNE_I) if (B.i != C.i) VM_JUMP(ip->a); VM_NEXT();
+	VM_CASE(JLT_I) if (B.i < C.i) VM_JUMP(ip->a); VM_NEXT();
+	VM_CASE(JLE_I) if (B.i <= C.i) VM_JUMP(ip->a); VM_NEXT();
+	VM_CASE(JGT_I) if (B.i > C.i) VM_JUMP(ip->a); VM_NEXT();
+	VM_CASE(JGE_I) if (B.i >= C.i) VM_JUMP(ip->a); VM_NEXT();
+
+	VM_CASE(TAB)
+	{
+		const Bytecode::Table &table = tables[ip->c];
+		unsigned long long k = (unsigned long long)(B.i - table.low);
+		if (k >= table.size)
+			throw std::exception("table index out of range");
+		A = tableData[table.first + k];
+		VM_NEXT();
+	}
+
+	VM_CASE(CALL)
+	{
+		// Кадр вызываемой начинается с аргументов; результат и переменные обнуляются
+		const Bytecode::Func &callee = funcs[ip->b];
+		Slot *args = regs + ip->c;
+		if (tiered) {
+			if (++counts[ip->b] == _threshold)
+				_onHot(ip->b);
+			NativeFunc pNative = _native[ip->b].load(std::memory_order_acquire);
+			if (pNative != nullptr) {
+				Slot res;
+				res.i = 0;
+				pNative(mem, args, &res);
+				WidenGlobals();
+				if (ip->a >= 0)
+					A = res;
+				VM_NEXT();
+			}
+		}
+		if ((size_t)(args - mem) + callee.nRegs > _size)
+			throw std::exception("stack overflow");
+		for (int i = callee.nParams, end = callee.nParams + callee.nLocals; i < end; ++i)
+			args[i].i = 0;
+		CallInfo call = { ip + 1, regs, ip->a, func };
+		_calls.push_back(call);
+		regs = args;
+		func = ip->b;
+		VM_JUMP(callee.entry);
+	}
+
+	VM_CASE(RET)
+	{
+		Slot res;
+		res.i = 0;
+		if (ip->a >= 0)
+			res = A;
+		if (_calls.empty())
+			return (int)res.i;
+		const CallInfo &call = _calls.back();
+		regs = call.regs;
+		ip = call.ret;
+		func = call.func;
+		if (call.dst >= 0)
+			regs[call.dst] = res;
+		_calls.pop_back();
+		VM_DISPATCH();
+	}
+
+#ifndef VM_THREADED
+	default:
+		throw std::exception("invalid instruction");
+	}
+#endif
+
+#undef A
+#undef B
+#undef C
+#undef VM_JUMP
+#undef VM_NEXT
+#undef VM_DISPATCH
+#undef VM_CASE
+}
@@ -0,0 +1,32 @@
+unit geometry;
+interface
+uses tally;
+const
+  sides = step + 1;
+  corners: array [0..3] of integer = (1, 2, 4, 8);
+var
+  area: integer;
+function square(x: integer): integer;
+procedure grow(d: integer);
+
+implementation
+var
+  calls: integer;
+
+function twice(x: integer): integer;
+begin
+  twice := x * 2
+end;
+
+function square(x: integer): integer;
+begin
+  calls := calls + 1;
+  square := x * x
+end;
+
+procedure grow(d: integer);
+begin
+  area := area + twice(d) * sides;
+  count(d)
+end;
+end
@@ -0,0 +1,20 @@
+unit tally;
+interface
+const
+  step = 3;
+var
+  total: integer;
+procedure count(k: integer);
+function scaled(k: integer): integer;
+
+implementation
+procedure count(k: integer);
+begin
+  total := total + k * step
+end;
+
+function scaled(n: integer): integer;
+begin
+  scaled := n * step + 1
+end;
+end
@@ -0,0 +1,28 @@
+program tables;
+const
+  n = 5;
+  primes: array [1..5] of integer = (2, 3, 5, 7, 11);
+  coef: array [-2..2] of real = (0.1, 0.2, 0.3E1, -4.5E-1, 1E2);
+  odd: array [0..3] of boolean = (false, true, false, true);
+var
+  i, s: integer;
+  r: real;
+
+function weight(k: integer): real;
+begin
+  weight := coef[k - 3] * primes[k]
+end;
+
+begin
+  s := 0;
+  r := 0.0;
+  for i := 1 to n do
+  begin
+    if odd[primes[i] mod 4] then
+      s := s + primes[i]
+    else
+      s := s - 1;
+    r := r + weight(i)
+  end;
+  tables := s * 1000 + r
+end
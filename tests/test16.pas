@@ -0,0 +1,23 @@
+program folding;
+const
+  size = 8;
+  half = size div 2;
+  area = size * size - half;
+  scale = area / 10;
+  big = (half > 3) and (area <> 0);
+  steps: array [0..3] of integer = (1, 2, 4, 8);
+  last = -steps[3] * 2;
+var
+  i, s: integer;
+  r: real;
+begin
+  s := 2 * 3 + half;
+  for i := 1 to size - 1 do
+    s := s + i * (half + 1);
+  r := scale * 2 + 0.5;
+  if big then
+    s := s + last
+  else
+    s := 0;
+  folding := s + r
+end
@@ -0,0 +1,50 @@
+program pure;
+const
+  n = 10;
+var
+  g, s: integer;
+
+function poly(x: integer): integer;
+begin
+  poly := x * x * 3 - x + 7
+end;
+
+function fact(k: integer): integer;
+begin
+  if k <= 1 then
+    fact := 1
+  else
+    fact := k * fact(k - 1)
+end;
+
+function fib(k: integer): integer;
+var
+  a, b, t, i: integer;
+begin
+  a := 0;
+  b := 1;
+  for i := 1 to k do
+  begin
+    t := a + b;
+    a := b;
+    b := t
+  end;
+  fib := a
+end;
+
+function mean(a, b: real): real;
+begin
+  mean := (a + b) / 2
+end;
+
+function shifted(x: integer): integer;
+begin
+  shifted := x + g
+end;
+
+begin
+  g := 100;
+  s := poly(4) + fact(6) + fib(n) + mean(1.5, 2.5);
+  s := s + shifted(1);
+  pure := s + poly(s mod 7)
+end
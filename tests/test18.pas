@@ -0,0 +1,45 @@
+program reach;
+var
+  g, s: integer;
+
+function unused(x: integer): integer;
+  function inner(y: integer): integer;
+  begin
+    inner := y * 3
+  end;
+begin
+  unused := inner(x) + g
+end;
+
+procedure ping(k: integer);
+begin
+  g := g + k;
+  if k > 0 then
+    pong(k - 1)
+  else
+    g := g * 2
+end;
+
+procedure pong(k: integer);
+begin
+  ping(k)
+end;
+
+function outer(x: integer): integer;
+  function helper(y: integer): integer;
+  begin
+    helper := y + 5
+  end;
+  function spare(y: integer): integer;
+  begin
+    spare := helper(y) * 2
+  end;
+begin
+  outer := helper(x) * 10 + g
+end;
+
+begin
+  g := 1;
+  s := outer(4);
+  reach := s + g
+end
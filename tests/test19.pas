@@ -0,0 +1,20 @@
+program units;
+uses geometry, tally;
+var
+  i, s: integer;
+
+function twice(x: integer): integer;
+begin
+  twice := x + x + 1
+end;
+
+begin
+  s := 0;
+  for i := 1 to 3 do
+  begin
+    grow(i);
+    s := s + square(i) + corners[i]
+  end;
+  count(10);
+  units := s + area + total + twice(sides) + scaled(2)
+end
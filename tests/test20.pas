@@ -0,0 +1,46 @@
+program interp;
+var
+  n, s, k: integer;
+  r: real;
+  c: char;
+  ok: boolean;
+
+function gcd(a, b: integer): integer;
+begin
+  if b = 0 then
+    gcd := a
+  else
+    gcd := gcd(b, a mod b)
+end;
+
+procedure swap(var x, y: integer);
+var t: integer;
+begin
+  t := x;
+  x := y;
+  y := t
+end;
+
+function avg(a, b: real): real;
+begin
+  avg := (a + b) / 2
+end;
+
+begin
+  n := 84;
+  k := 36;
+  swap(n, k);
+  s := gcd(n, k) * 100 + n;
+  for k := 10 downto 1 do
+    s := s + k mod 3;
+  r := avg(s, 0.5);
+  c := 300;
+  ok := r > s / 2;
+  repeat
+    n := n - 7
+  until n < 0;
+  if ok then
+    interp := s + c + n
+  else
+    interp := -1
+end
@@ -0,0 +1,32 @@
+program tier;
+var i, s, cnt: integer;
+  acc: real;
+  c: char;
+  flag: boolean;
+
+function work(n: integer; var total: integer): integer;
+var k, r: integer;
+begin
+  r := 0;
+  for k := 1 to n do
+    r := r + (k * n) mod 7;
+  total := r * 2 - n;
+  cnt := cnt + 1;
+  acc := acc + 0.5;
+  c := c + 3;
+  if flag then flag := false else flag := true;
+  work := r
+end;
+
+function fib(n: integer): integer;
+begin
+  if n < 2 then fib := n else fib := fib(n - 1) + fib(n - 2)
+end;
+
+begin
+  s := 0;
+  flag := false;
+  for i := 1 to 3000 do
+    s := s + work(i mod 50, s) mod 3;
+  tier := s + cnt + acc + c + flag + fib(20)
+end
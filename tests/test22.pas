@@ -0,0 +1,35 @@
+program lazy;
+var
+  n, s: integer;
+  verbose: boolean;
+
+function square(x: integer): integer;
+begin
+  square := x * x
+end;
+
+function report(x: integer): integer;
+var k, t: integer;
+begin
+  t := 0;
+  for k := 1 to x do
+    t := t + square(k) mod 10;
+  report := t
+end;
+
+function checksum(x: integer): integer;
+begin
+  checksum := (x * 31 + 7) mod 1000
+end;
+
+begin
+  verbose := false;
+  s := 0;
+  for n := 1 to 20 do
+    s := s + square(n);
+  if verbose then
+    s := s + report(s)
+  else
+    s := checksum(s);
+  lazy := s
+end
@@ -0,0 +1,16 @@
+program optlevels;
+var i, s: integer;
+function sq(x: integer): integer;
+begin
+  sq := x * x mod 1013
+end;
+function step(a, b: integer): integer;
+begin
+  step := (sq(a) + sq(b) + a) mod 65536
+end;
+begin
+  s := 1;
+  for i := 1 to 100000 do
+    s := step(s, i);
+  optlevels := s
+end